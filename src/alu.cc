@@ -0,0 +1,26 @@
+#include "alu.h"
+
+namespace ALU {
+	FlagTable::FlagTable() {
+		for (unsigned int a = 0; a < 0x100; ++a) {
+			for (unsigned int b = 0; b < 0x100; ++b) {
+				BYTE flags = 0;
+				if (a + b > 0xff) flags |= Flags::STATUS::C;
+				if ((a & 0x0f) + (b & 0x0f) > 0x0f) flags |= Flags::STATUS::DC;
+				if (((a + b) & 0xff) == 0) flags |= Flags::STATUS::Z;
+				m_add[a << 8 | b] = flags;
+
+				flags = 0;
+				if (a >= b) flags |= Flags::STATUS::C;
+				if ((a & 0x0f) >= (b & 0x0f)) flags |= Flags::STATUS::DC;
+				if (a == b) flags |= Flags::STATUS::Z;
+				m_sub[a << 8 | b] = flags;
+			}
+		}
+	}
+
+	const FlagTable &FlagTable::instance() {
+		static FlagTable table;
+		return table;
+	}
+}
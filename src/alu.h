@@ -0,0 +1,46 @@
+#pragma once
+//___________________________________________________________________________________
+//  The STATUS flags Z, DC and C for 8 bit arithmetic, shared by every instruction which
+// sets them.
+//  Adding sets C and DC on a carry out of bits 7 and 3.  Subtracting sets them when there
+// is *no* borrow, which is just the carry out of a + ~b + 1, so one function does both.
+//  The carry into any bit is that bit of a ^ b ^ sum, so there is nothing to branch on.
+// FlagTable holds the same answers precomputed for every pair of operands, worked out the
+// long way.  test_alu compares the two, and times them.  They come out about even in a
+// tight loop, where the tables stay in cache, but in the simulator proper 128K of tables
+// must compete with everything else, so instructions use the arithmetic.
+#include "devices/constants.h"
+#include "devices/flags.h"
+
+namespace ALU {
+	inline BYTE zero(BYTE a_result) {
+		return (a_result == 0) * Flags::STATUS::Z;
+	}
+
+	inline BYTE add(BYTE a, BYTE b, BYTE a_carry, BYTE &a_flags) {      // a + b + carry
+		unsigned int sum = a + b + a_carry;
+		a_flags = (sum >> 8) * Flags::STATUS::C | ((a ^ b ^ sum) >> 4 & 1) * Flags::STATUS::DC | zero(sum);
+		return sum;
+	}
+
+	inline BYTE add(BYTE a, BYTE b, BYTE &a_flags) {
+		return add(a, b, 0, a_flags);
+	}
+
+	inline BYTE sub(BYTE a, BYTE b, BYTE &a_flags) {                    // a - b
+		return add(a, ~b, 1, a_flags);
+	}
+
+	class FlagTable {
+		BYTE m_add[0x10000];
+		BYTE m_sub[0x10000];
+
+		FlagTable();
+
+	  public:
+		static const FlagTable &instance();
+
+		BYTE add(BYTE a, BYTE b) const { return m_add[a << 8 | b]; }
+		BYTE sub(BYTE a, BYTE b) const { return m_sub[a << 8 | b]; }
+	};
+}
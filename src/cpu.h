@@ -27,26 +27,31 @@
 
 #include "devices/constants.h"
 #include "devices/devices.h"
+#include "devices/connection_node.h"
 #include "utils/hex.h"
 #include "utils/assembler.h"
 #include "utils/utility.h"
 #include "cpu_data.h"
 #include "instructions.h"
+#include "fast_forward.h"
 
 //___________________________________________________________________________________
 // Models the 16fxxx CPU
 class CPU {
 	CPU_DATA data;
 	InstructionSet instructions;
+	DecodedFlash decoded;
+	WaitLoop waiting;
 	SmartPtr<Instruction>current;
 	WORD opcode;
 	bool active;
 	bool debug;
 	bool paused;
-	bool skip;
-	int  cycles;
+	bool &skip;                 // the pipeline state lives in data.sram.core()
+	int  &cycles;
 	int  nsteps;
-	bool interrupt_pending;
+	bool &interrupt_pending;
+	bool skip_loops;
 
 	std::queue<std::string> instruction_cycles;
 	std::string disassembled;
@@ -61,11 +66,11 @@ class CPU {
 			else {
 //				if (debug) std::cout << "Fetch instruction @" << std::hex << (int)PC << std::endl;
 				opcode = data.flash.fetch(PC);
-				current = instructions.find(opcode);
+				current = decoded.at(PC);
 			}
 			if (current) cycles = current->cycles;
 			data.execPC = PC;
-			++PC; PC = PC % data.flash.size();
+			PC = data.flash.wrap(PC + 1);
 			data.sram.set_PC(PC);
 		}
 	}
@@ -103,6 +108,100 @@ class CPU {
 		cycle();
 	}
 
+	// An enabled interrupt wakes the device from SLEEP, whether or not GIE is set.
+	bool wake_up_pending() {
+		BYTE intcon = data.Registers["INTCON"]->get_value();
+		BYTE flags = Flags::INTCON::T0IF | Flags::INTCON::INTF | Flags::INTCON::RBIF;
+		if (intcon & (intcon >> 3) & flags) return true;          // each enable bit sits 3 bits above its flag
+		if (intcon & Flags::INTCON::PEIE) {
+			BYTE pir1 = data.Registers["PIR1"]->get_value();
+			BYTE pie1 = data.Registers["PIE1"]->get_value();
+			if (pir1 & pie1) return true;
+		}
+		return false;
+	}
+
+	//  While asleep the oscillator is stopped, and nothing happens until a wake-up source
+	// fires.  Events already queued go first, since a pin change or comparator output may
+	// wake us.  Otherwise only an alarm can, so we move time straight to the next one
+	// rather than wait for it.
+	void idle() {
+		Clock::Cycle when;
+		if (data.device_events.size() || (paused && !nsteps) || !data.clock.next_alarm(when))
+			sleep_for_us(std::min(data.clock_delay_us, 1000UL));
+		else
+			data.clock.advance(when);
+	}
+
+	Pipeline pipeline() {
+		return Pipeline{current, opcode, data.sram.get_PC(), data.execPC, cycles, skip, disassembled};
+	}
+
+	void restore(const Pipeline &a_state) {
+		current = a_state.current;
+		opcode = a_state.opcode;
+		data.sram.set_PC(a_state.PC);
+		data.execPC = a_state.execPC;
+		cycles = a_state.cycles;
+		skip = a_state.skip;
+		disassembled = a_state.disassembled;
+	}
+
+	// Each short backward jump may close a polling or delay loop.  See fast_forward.h
+	void watch_loop(SmartPtr<Instruction> &a_executed, WORD a_at) {
+		if (waiting.armed()) {
+			waiting.observe(data, pipeline());
+		} else if (a_executed && a_executed->mnemonic == "GOTO") {
+			WORD target = data.sram.get_PC();
+			if (target <= a_at && a_at - target < WaitLoop::longest)
+				waiting.arm(decoded, data, target, a_at);
+		}
+	}
+
+	// Something may have changed a register the loop reads
+	void loop_disturbed() {
+		if (waiting.parked())
+			restore(waiting.resume(data));
+		else if (waiting.armed())
+			waiting.disturb();
+	}
+
+	//  A parked loop can do nothing until some device acts, or its counter runs out.  If
+	// no device needs to see every cycle, we may move the clock straight on to whichever
+	// comes first.
+	bool skip_ahead() {
+		Clock::Cycle when, left;
+		if (data.cycle_driven()) return false;
+		bool found = data.clock.next_deadline(when);
+		if (waiting.remaining(left) && (!found || data.clock.cycles() + left + 1 < when)) {
+			when = data.clock.cycles() + left + 1;
+			found = true;
+		}
+		if (!found) return false;
+		Clock::Cycle skipped = data.clock.skip(when);
+		waiting.elapse(skipped);
+		if (waiting.expired()) restore(waiting.resume(data));
+		return skipped > 0;
+	}
+
+	//  A basic block touches nothing outside the CPU, so if nothing else can happen in the
+	// cycles it spans, we may run all of it now and move the clock on by its length.
+	bool run_block() {
+		if (paused || debug || CpuEvent::observed()) return false;   // stepping or tracing wants every instruction
+		if (!skip_loops || skip || !current || cycles != 1 || interrupt_pending || waiting.armed()) return false;
+		if (instruction_cycles.size() > 1 || data.device_events.size() || data.cycle_driven()) return false;
+		const DecodedFlash::Block &block = decoded.block(data.execPC, data);
+		Clock::Cycle n = block.steps.size(), now = data.clock.cycles(), when;
+		if (n < 2) return false;
+		if (data.clock.next_deadline(when) && when <= now + n) return false;
+		if (!data.clock.jump(now, now + n - 1)) return false;
+		for (auto &step: block.steps) step(data);
+		cycles = 0;
+		data.execPC += n - 1;
+		data.sram.set_PC(data.flash.wrap(data.execPC + 1));
+		return true;
+	}
+
 	static void show_status(void *ob, const CpuEvent &e) {
 		if (e.etype == "after") {
 			std::cout << std::setfill('0') << std::hex << std::setw(4) <<  (int)e.PC << ":\t";
@@ -111,24 +210,28 @@ class CPU {
 	}
 
   public:
-	void reset() {
+	// TO and PD after reset tell the program why it was reset.  We come out of reset
+	// paused, unless the reset came from the program itself (the watchdog).
+	void reset(BYTE a_status=Flags::STATUS::TO | Flags::STATUS::PD, bool a_pause=true) {
 		data.clock.stop();
+		data.clock.wake();
 
 		data.device_events.clear();
 		while (! data.control.empty()) data.control.pop();
 
 		nsteps = 0;
-		paused = true;
+		if (a_pause) paused = true;
 		current = NULL;
 		data.SP = 8;
 		data.W = 0;
 		cycles = 0;
 		skip = 0;
 		disassembled = "";
+		waiting.disarm();
 		data.sram.reset();
 		interrupt_pending = false;
 
-		data.sram.write(SRAM::STATUS, 0b00011000, false);
+		data.sram.write(SRAM::STATUS, a_status, false);
 		data.sram.write(SRAM::OPTION, 0b11111111, false);
 		data.sram.write(SRAM::TRISA,  0b11111111, false);
 		data.sram.write(SRAM::TRISB,  0b11111111, false);
@@ -137,6 +240,11 @@ class CPU {
 		data.sram.write(SRAM::TXSTA,  0b00000010, false);
 
 		data.reset_registers();
+		data.tmr0.reset();
+		data.tmr2.reset();
+		data.ccp1.reset();
+		data.usart.reset();
+		data.wdt.reset();
 
 		nsteps = 2;        // fetch & execute the first instruction
 		data.clock.start();
@@ -147,9 +255,19 @@ class CPU {
 			if (!nsteps) return;
 			--nsteps;
 		}
+		if (waiting.parked()) {      // the loop would only repeat itself
+			waiting.elapse(1);
+			if (waiting.expired()) restore(waiting.resume(data));
+			return;
+		}
 		try {
-			execute();
+			SmartPtr<Instruction> executed = current;
+			WORD at = data.execPC;
+			if (!run_block()) execute();
 			fetch();
+			if (data.clock.asleep() && wake_up_pending())   // SLEEP with an interrupt already pending
+				data.clock.wake();
+			if (skip_loops) watch_loop(executed, at);
 		} catch (std::string &error) {
 			std::cerr << "Terminating because: " << error << "\n";
 			active=false;
@@ -157,6 +275,16 @@ class CPU {
 	}
 
 	void toggle_clock() { data.clock.toggle(); }
+	void trace(bool a_on) {         // print each instruction as it executes
+		debug = a_on;
+		if (debug) CpuEvent::subscribe((void *)this, &CPU::show_status);
+		else CpuEvent::unsubscribe((void *)this);
+	}
+	void fast_forward(bool a_on) {   // skip polling and delay loops, and run basic blocks
+		skip_loops = a_on;
+		if (!a_on) loop_disturbed();
+		waiting.disarm();
+	}
 
 	bool running() const { return active; }
 	void stop() {
@@ -165,6 +293,11 @@ class CPU {
 		active = false;
 	}
 
+	void serial(const std::string &a_output, const std::string &a_input="") {   // connect the USART to the host
+		data.usart.attach(new HostStream(a_output, a_input));
+		std::cout << "USART connected to " << data.usart.host()->name() << "\n";
+	}
+
 	void configure(const std::string &a_filename) {};
 	void load_eeprom(const std::string &a_filename) {};
 	bool load_hex(const std::string &a_filename) { return ::load_hex(a_filename, data); };
@@ -181,7 +314,11 @@ class CPU {
 		try {
 			if (not instruction_cycles.empty()) {
 				const std::string &name = instruction_cycles.front();
-				if (name == "INTERRUPT") {
+				if (waiting.parked() && (name == "INTERRUPT" || waiting.changed(data)))
+					restore(waiting.resume(data));
+				if (data.clock.asleep()) {    // cycles queued before SLEEP stopped the oscillator
+					if (name == "INTERRUPT") interrupt_pending = true;
+				} else if (name == "INTERRUPT") {
 					interrupt();
 				} else {
 					cycle();
@@ -194,7 +331,14 @@ class CPU {
 				}
 				return true;
 			} else if (data.device_events.size()) {
-				data.device_events.process_events();
+				{   // nets changed by these events are solved together, before the next cycle.
+					// A circuit that keeps changing is taken up again on the next call.
+					Connection_Node::Defer defer;
+					int rounds = 0;
+					do data.device_events.process_events(); while (defer.settle() && ++rounds < 100);
+				}
+				if (waiting.parked() && waiting.changed(data))
+					restore(waiting.resume(data));
 				return true;
 			} else if (!data.control.empty()) {
 				while (!data.control.empty()) {
@@ -206,6 +350,8 @@ class CPU {
 					if (e.name == "reset") reset();
 				}
 				return true;
+			} else if (waiting.parked() && !paused) {
+				return skip_ahead();
 			}
 		} catch (std::exception &e) {
 			std::cout << e.what() << std::endl;
@@ -253,6 +399,29 @@ class CPU {
 		}
 		if (generate_interrupt)
 			interrupt_pending = true;
+		if (name.find(".read") == name.npos)
+			loop_disturbed();
+		if ((name == "INTCON" || name == "PIR1" || name == "PIE1") && data.clock.asleep() && wake_up_pending())
+			data.clock.wake();
+	}
+
+	//  A watchdog timeout wakes a sleeping device with TO and PD both clear.  Otherwise
+	// it resets the device with TO clear, and PD as it was.
+	void wdt_event(WDT *w, const std::string &name, const std::vector<BYTE> &rdata) {
+		if (name != "Timeout") return;
+		BYTE &status = data.sram.status();
+		if (data.clock.asleep()) {
+			status &= ~(Flags::STATUS::TO | Flags::STATUS::PD);
+			data.clock.wake();
+		} else {
+			reset(status & Flags::STATUS::PD, false);
+		}
+	}
+
+	// A pin change may reach a port the loop reads
+	void pin_event(Connection *c, const std::string &name, const std::vector<BYTE> &rdata) {
+		if (waiting.watches(c->name()))
+			loop_disturbed();
 	}
 
 	//   This is called from within the clock thread.  If we process instructions directly
@@ -276,30 +445,40 @@ class CPU {
 	// Clock thread is independent of machine thread and UI thread
 	void run_clock(unsigned long delay_us, bool a_debug=false) {  // run the clock
 		data.clock_delay_us = delay_us;
-		debug = a_debug;
+		trace(a_debug);
 		while (running()) {
-			sleep_for_us(data.clock_delay_us);
-			toggle_clock();
+			if (data.clock.asleep()) {
+				idle();
+			} else {
+				sleep_for_us(data.clock_delay_us);
+				toggle_clock();
+			}
 		}
 	}
 
 	virtual ~CPU() {
 		DeviceEvent<Clock>::unsubscribe<CPU>(this, &CPU::clock_event);
 		DeviceEvent<Register>::unsubscribe<CPU>(this, &CPU::register_event);
+		DeviceEvent<WDT>::unsubscribe<CPU>(this, &CPU::wdt_event);
+		for (BYTE n = 1; n <= 18; ++n)
+			DeviceEvent<Connection>::unsubscribe<CPU>(this, &CPU::pin_event, &data.pins[n]);
 	}
 
 	void model(const std::string &a_model) {
 		data.model(a_model);
 	}
 
-	CPU(): active(true), debug(true), paused(true), skip(false), cycles(0), nsteps(0) {
+	CPU(): decoded(instructions, data.flash), active(true), debug(true), paused(true),
+		skip(data.sram.core().skip), cycles(data.sram.core().cycles), nsteps(0),
+		interrupt_pending(data.sram.core().interrupt_pending), skip_loops(true) {
 
 		DeviceEvent<Clock>::subscribe<CPU>(this, &CPU::clock_event);
 		DeviceEvent<Register>::subscribe<CPU>(this, &CPU::register_event);
+		DeviceEvent<WDT>::subscribe<CPU>(this, &CPU::wdt_event);
+		for (BYTE n = 1; n <= 18; ++n)
+			DeviceEvent<Connection>::subscribe<CPU>(this, &CPU::pin_event, &data.pins[n]);
 
-		if (debug) {   // Execution tracer
-			CpuEvent::subscribe((void *)this, &CPU::show_status);
-		}
+		trace(debug);
 		reset();
 	}
 };
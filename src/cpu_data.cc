@@ -1,4 +1,5 @@
 #include "cpu_data.h"
+#include "devices/transient.h"
 
 #include "utils/smart_ptr.cc"
 
@@ -78,9 +79,26 @@ class OPTION: public Register {
 	}
 };
 
+class Volatile: public Register {
+	// The device behind a volatile register changes it without telling us (TMR2), or
+	// acts on every write (TXREG), so a write must always reach the device, even one
+	// that appears to leave the value unchanged.
+
+  public:
+	Volatile(const WORD a_idx, const std::string &a_name, const std::string &a_doc = "") : Register(a_idx, a_name, a_doc) {}
+
+	virtual void write(SRAM &a_sram, const BYTE value) {
+		BYTE old = get_value();
+		if (!set_value(value, old))
+			trigger_change(value, old, 0);
+	}
+};
+
 
 CPU_DATA::CPU_DATA():
-		execPC(0), SP(0), W(0), Config(0), porta(pins), portb(pins), cfg1("CONFIG1"), cfg2("CONFIG2") {
+		Config(0), execPC(sram.core().execPC), SP(sram.core().SP), W(sram.core().W),
+		stack(sram.core().stack), wdt(clock), porta(pins), portb(pins),
+		tmr2(clock), ccp1(clock, tmr1, tmr2), usart(clock), cfg1("CONFIG1"), cfg2("CONFIG2") {
 	Registers["INDF"]   = new INDF();
 	Registers["TMR0"]   = new Register(SRAM::TMR0, "TMR0", "Timer 0");  // bank 0 and 2
 	Registers["PCL"]    = new Register(SRAM::PCL, "PCL", "Program Counters Low  Byte");  // all banks
@@ -96,14 +114,14 @@ CPU_DATA::CPU_DATA():
 	Registers["TMR1L"]  = new Register(SRAM::TMR1L, "TMR1L", "Holding Register for the Least Significant Byte of the 16-bit TMR1 Register");
 	Registers["TMR1H"]  = new Register(SRAM::TMR1H, "TMR1H", "Holding Register for the Most Significant Byte of the 16-bit TMR1 Register");
 	Registers["T1CON"]  = new Register(SRAM::T1CON, "T1CON", "— — T1CKPS1 T1CKPS0 T1OSCEN T1SYNC TMR1CS TMR1ON");
-	Registers["TMR2"]   = new Register(SRAM::TMR2, "TMR2", "TMR2 Module’s Register");
+	Registers["TMR2"]   = new Volatile(SRAM::TMR2, "TMR2", "TMR2 Module’s Register");
 	Registers["T2CON"]  = new Register(SRAM::T2CON, "T2CON", "— TOUTPS3 TOUTPS2 TOUTPS1 TOUTPS0 TMR2ON T2CKPS1 T2CKPS0");
 
 	Registers["CCPR1L"] = new Register(SRAM::CCPR1L, "CCPR1L", "Capture/Compare/PWM Register (LSB)");
 	Registers["CCPR1H"] = new Register(SRAM::CCPR1H, "CCPR1H", "Capture/Compare/PWM Register (MSB)");
-	Registers["CCP1CON"]= new Register(SRAM::CCP1CON, "CCPCON", "— — CCP1X CCP1Y CCP1M3 CCP1M2 CCP1M1 CCP1M0");
+	Registers["CCP1CON"]= new Register(SRAM::CCP1CON, "CCP1CON", "— — CCP1X CCP1Y CCP1M3 CCP1M2 CCP1M1 CCP1M0");
 	Registers["RCSTA"]  = new Register(SRAM::RCSTA, "RCSTA", "SPEN RX9 SREN CREN ADEN FERR OERR RX9D");
-	Registers["TXREG"]  = new Register(SRAM::TXREG, "TCREG", "USART Transmit Data Register");
+	Registers["TXREG"]  = new Volatile(SRAM::TXREG, "TXREG", "USART Transmit Data Register");
 	Registers["RCREG"]  = new Register(SRAM::RCREG, "RCREG", "USART Receive Data Register");
 	Registers["CMCON"]  = new Register(SRAM::CMCON, "CMCON", "C2OUT C1OUT C2INV C1INV CIS CM2 CM1 CM0");
 
@@ -137,14 +155,22 @@ CPU_DATA::CPU_DATA():
 	DeviceEvent<Comparator>::subscribe<CPU_DATA>(this, &CPU_DATA::comparator_changed);
 	DeviceEvent<Timer0>::subscribe<CPU_DATA>(this, &CPU_DATA::timer0_changed);
 	DeviceEvent<Timer1>::subscribe<CPU_DATA>(this, &CPU_DATA::timer1_changed);
+	DeviceEvent<Timer2>::subscribe<CPU_DATA>(this, &CPU_DATA::timer2_changed);
+	DeviceEvent<CCP1>::subscribe<CPU_DATA>(this, &CPU_DATA::ccp1_changed);
+	DeviceEvent<USART>::subscribe<CPU_DATA>(this, &CPU_DATA::usart_changed);
 	DeviceEvent<PORTB>::subscribe<CPU_DATA>(this, &CPU_DATA::portB_changed);
+	Transient::attach(clock);
 }
 
 CPU_DATA::~CPU_DATA() {
+	Transient::detach(clock);
 	DeviceEvent<Register>::unsubscribe<CPU_DATA>(this, &CPU_DATA::register_changed);
 	DeviceEvent<Comparator>::unsubscribe<CPU_DATA>(this, &CPU_DATA::comparator_changed);
 	DeviceEvent<Timer0>::unsubscribe<CPU_DATA>(this, &CPU_DATA::timer0_changed);
 	DeviceEvent<Timer1>::unsubscribe<CPU_DATA>(this, &CPU_DATA::timer1_changed);
+	DeviceEvent<Timer2>::unsubscribe<CPU_DATA>(this, &CPU_DATA::timer2_changed);
+	DeviceEvent<CCP1>::unsubscribe<CPU_DATA>(this, &CPU_DATA::ccp1_changed);
+	DeviceEvent<USART>::unsubscribe<CPU_DATA>(this, &CPU_DATA::usart_changed);
 	DeviceEvent<PORTB>::unsubscribe<CPU_DATA>(this, &CPU_DATA::portB_changed);
 }
 
@@ -161,6 +187,11 @@ void CPU_DATA::register_changed(Register *r, const std::string &name, const std:
 			}
 		} else {         // a read operation
 			BYTE sdata;
+			if (name == "TMR2.read" || name == "RCREG.read") {    // values the devices produce only when asked
+				BYTE value = (name == "TMR2.read")?tmr2.value():usart.receive();
+				r->set_value(value, value);
+				sram.write(r->index(), value, false);
+			}
 			if (r->index()) {
 				sdata = sram.read(r->index(), false);
 			} else {
@@ -211,6 +242,51 @@ void CPU_DATA::timer1_changed(Timer1 *t, const std::string &name, const std::vec
 	}
 }
 
+void CPU_DATA::timer2_changed(Timer2 *t, const std::string &name, const std::vector<BYTE> &data) {
+	if (name == "Interrupt") {
+		auto PIR1 = Registers["PIR1"];
+		BYTE idata = PIR1->get_value();
+		PIR1->write(sram, idata | Flags::PIR1::TMR2IF);
+	}
+}
+
+void CPU_DATA::ccp1_changed(CCP1 *c, const std::string &name, const std::vector<BYTE> &data) {
+	if (name == "Interrupt") {
+		auto PIR1 = Registers["PIR1"];
+		BYTE idata = PIR1->get_value();
+		PIR1->write(sram, idata | Flags::PIR1::CCP1IF);
+	} else if (name == "Capture") {
+		auto CCPR1L = Registers["CCPR1L"];
+		auto CCPR1H = Registers["CCPR1H"];
+		CCPR1L->set_value(data[0], data[0]);
+		CCPR1H->set_value(data[1], data[1]);   // update in memory, but don't trigger a change.
+		sram.write(CCPR1L->index(), data[0]);
+		sram.write(CCPR1H->index(), data[1]);  // update the SRAM value separately.
+	} else if (name == "Special Event") {      // compare match resets Timer1
+		Registers["TMR1L"]->write(sram, 0);
+		Registers["TMR1H"]->write(sram, 0);
+	}
+}
+
+void CPU_DATA::usart_changed(USART *u, const std::string &name, const std::vector<BYTE> &data) {
+	if (name == "TXIF" || name == "RCIF") {
+		auto PIR1 = Registers["PIR1"];
+		BYTE flag = (name == "TXIF")?Flags::PIR1::TXIF:Flags::PIR1::RCIF;
+		BYTE idata = PIR1->get_value();
+		PIR1->write(sram, data[0]?(idata | flag):(idata & ~flag));
+	} else if (name == "TRMT") {
+		auto TXSTA = Registers["TXSTA"];
+		BYTE d = data[0]?(TXSTA->get_value() | Flags::TXSTA::TRMT):(TXSTA->get_value() & ~Flags::TXSTA::TRMT);
+		TXSTA->set_value(d, d);            // update in memory, but don't trigger a change.
+		sram.write(TXSTA->index(), d);
+	} else if (name == "Receive Status") {
+		static const BYTE status = Flags::RCSTA::OERR | Flags::RCSTA::FERR | Flags::RCSTA::RX9D;
+		auto RCSTA = Registers["RCSTA"];
+		BYTE d = (RCSTA->get_value() & ~status) | (data[0] & status);
+		RCSTA->set_value(d, d);
+		sram.write(RCSTA->index(), d);
+	}
+}
 
 void CPU_DATA::comparator_changed(Comparator *c, const std::string &name, const std::vector<BYTE> &data) {
 	auto r = Registers.find("CMCON");
@@ -84,6 +84,8 @@ class CpuEvent {
 		if (subscribers.find(ob) != subscribers.end())
 			subscribers.erase(ob);
 	};
+
+	static bool observed() { return !subscribers.empty(); }   // is anybody following execution?
 };
 
 //____________________________________________________________________________________
@@ -115,16 +117,16 @@ class CPU_DATA {
 
 	Flash flash;
 
-	WORD execPC;  // PC of currently executing instruction.
-	WORD SP;      // SP after execute
-	WORD W;       // W after execute
 	WORD Config;  // Configuration word
 
-	WORD *stack = NULL;
 	std::map<std::string, SmartPtr<Register> > Registers;
 	std::map<BYTE, std::string> RegisterNames;
 
 	SRAM       sram;
+	WORD      &execPC;  // PC of currently executing instruction.
+	BYTE      &SP;      // SP after execute
+	BYTE      &W;       // W after execute
+	WORD      *stack;   // these all live in sram.core()
 	PINS       pins;
 	Clock      clock;
 	EEPROM     eeprom;
@@ -135,6 +137,8 @@ class CPU_DATA {
 	Timer0     tmr0;
 	Timer1     tmr1;
 	Timer2     tmr2;
+	CCP1       ccp1;    // capture/compare/pwm
+	USART      usart;
 	CONFIG     cfg1;
 	CONFIG     cfg2;
 
@@ -161,8 +165,7 @@ class CPU_DATA {
 	}
 
 	void push(WORD value) {
-		--SP;
-		SP = (SP + params.stack_size) % params.stack_size;
+		SP = (SP - 1) & (CoreState::STACK - 1);
 		stack[SP] = value;
 	}
 
@@ -171,11 +174,14 @@ class CPU_DATA {
 	void comparator_changed(Comparator *c, const std::string &name, const std::vector<BYTE> &data);
 	void timer0_changed(Timer0 *t, const std::string &name, const std::vector<BYTE> &data);
 	void timer1_changed(Timer1 *t, const std::string &name, const std::vector<BYTE> &data);
+	void timer2_changed(Timer2 *t, const std::string &name, const std::vector<BYTE> &data);
+	void ccp1_changed(CCP1 *c, const std::string &name, const std::vector<BYTE> &data);
+	void usart_changed(USART *u, const std::string &name, const std::vector<BYTE> &data);
 	void portB_changed(PORTB *p, const std::string &name, const std::vector<BYTE> &data);
 
 	WORD pop() {
+		SP = SP & (CoreState::STACK - 1);
 		WORD value = stack[SP];
-		SP = SP % params.stack_size;
 		++SP;
 		return value;
 	}
@@ -216,16 +222,12 @@ class CPU_DATA {
 	}
 
 	void model(const std::string &a_model) {
-		auto PIC16f627a = Params{"PIC16f627a", 1024, 128, 4, 0x80, 18, 8};
-		auto PIC16f628a = Params{"PIC16f628a", 2048, 128, 4, 0x80, 18, 8};
-		auto PIC16f648a = Params{"PIC16f648a", 4096, 256, 4, 0x80, 18, 8};
-
 		if (a_model.find("16f627") != std::string::npos) {
-			set_params(PIC16f627a);
+			set_params(PIC16f627a::params("PIC16f627a"));
 		} else  if (a_model.find("16f628") != std::string::npos) {
-			set_params(PIC16f628a);
+			set_params(PIC16f628a::params("PIC16f628a"));
 		} else  if (a_model.find("16f648") != std::string::npos) {
-			set_params(PIC16f648a);
+			set_params(PIC16f648a::params("PIC16f648a"));
 		} else {
 			throw(std::string("Invalid processor choice: "+a_model));
 		}
@@ -233,9 +235,14 @@ class CPU_DATA {
 
 	void set_params(const Params &a_params) {
 		std::cout << "setting parameters ...\n";
+		// refuse a model before any of it is applied
+		if (a_params.stack_size != CoreState::STACK)
+			throw std::string("The CPU core has a stack of ") + std::to_string(CoreState::STACK) + " levels";
+		if (a_params.flash_size <= 0 || (a_params.flash_size & (a_params.flash_size - 1)))
+			throw(std::string("Flash memory size must be a power of two"));
+		if (a_params.ram_banks > 4 || a_params.bank_size != SRAM::BANK_SIZE)
+			throw std::string("SRAM has at most 4 banks of ") + std::to_string(SRAM::BANK_SIZE) + " bytes";
 		params = a_params;
-		stack = (WORD *)realloc(stack, (params.stack_size+1) * sizeof(WORD));
-		std::cout << "stack allocated ...\n";
 
 		flash.size(params.flash_size);
 		std::cout << "flash memory initialised ...\n";
@@ -248,6 +255,10 @@ class CPU_DATA {
 		std::cout << "parameters are set\n";
 	}
 
+	bool cycle_driven() {    // a device needs to see every instruction cycle, so we may not skip any
+		return !tmr0.use_RA4() || (tmr1.tmr1on().signal() && !tmr1.tmr1cs().signal());
+	}
+
 	CPU_DATA();
 	~CPU_DATA();
 };
@@ -1,7 +1,52 @@
 #pragma once
+#include <map>
+#include <mutex>
+#include <atomic>
 #include "device_base.h"
 
+//___________________________________________________________________________________
+//  The clock divides the oscillator into four phases per instruction cycle, and also
+// counts instruction cycles since it was created.  The cycle count is our simulated
+// time base.
+//  Devices which only need to act at some known point in the future, such as a timer
+// reaching its period register, need not count every cycle.  They schedule a named
+// deadline instead, and the clock queues a DeviceEvent<Clock> of that name once the
+// cycle count reaches it.  A name holds at most one deadline, so scheduling the same
+// name again simply moves it.
+//  SLEEP stops the oscillator, so while asleep the cycle count stands still, and so
+// does anything driven from it.  Time carries on regardless, and a device with its own
+// oscillator, such as the watchdog, sets an alarm against time() rather than cycles().
+// Alarms are the only deadlines that fire while asleep, and since nothing else can
+// happen in between, a sleeping clock may advance() directly to the next one.
+//  Similarly, when the CPU is known to be doing nothing useful, and no device needs to
+// see every cycle, a running clock may skip() most of the way to its next deadline.
 class Clock: public Device {
+  public:
+	typedef unsigned long long Cycle;
+
+  private:
+	class Timeline {
+		std::map<std::string, Cycle> m_deadlines;        // name -> deadline
+		std::multimap<Cycle, std::string> m_order;       // deadlines in order
+
+	  public:
+		void add(const std::string &a_name, Cycle a_when);
+		bool remove(const std::string &a_name);
+		bool contains(const std::string &a_name) const { return m_deadlines.find(a_name) != m_deadlines.end(); }
+		bool next(Cycle &a_when) const;
+		void fire(Clock &a_clock, Cycle a_now);
+	};
+
+	std::mutex m_mtx;
+	std::atomic<Cycle> m_cycles;
+	std::atomic<Cycle> m_slept;                      // cycles of time spent asleep
+	std::atomic<bool>  m_asleep;
+	Timeline m_deadlines;                            // against cycles()
+	Timeline m_alarms;                               // against time()
+
+	void unschedule(const std::string &a_name);
+	void fire_deadlines();
+
   public:
 	bool stopped;
 	bool high;
@@ -11,11 +56,25 @@ class Clock: public Device {
 	BYTE Q3;
 	BYTE Q4;
 
-	Clock(): stopped(true), high(false), phase(0), Q1(1), Q2(0), Q3(0), Q4(0) {}
+	Clock(): m_cycles(0), m_slept(0), m_asleep(false), stopped(true), high(false), phase(0), Q1(1), Q2(0), Q3(0), Q4(0) {}
 
 	void toggle();
 	void stop();
 	void start();
-};
 
+	Cycle cycles() const { return m_cycles; }
+	Cycle time() const { return m_cycles + m_slept; }
+	void schedule(const std::string &a_name, Cycle a_when);
+	void alarm(const std::string &a_name, Cycle a_time);
+	void cancel(const std::string &a_name);
+	bool scheduled(const std::string &a_name);
 
+	void sleep();                      // stop the oscillator
+	void wake();                       // and start it again
+	bool asleep() const { return m_asleep; }
+	bool next_alarm(Cycle &a_time);    // false if there is no alarm set
+	void advance(Cycle a_time);        // while asleep, move time forward
+	bool next_deadline(Cycle &a_cycle);   // the next deadline or alarm, in cycles
+	Cycle skip(Cycle a_cycle);         // jump to the cycle before a_cycle; returns cycles skipped
+	bool jump(Cycle a_from, Cycle a_to);  // from exactly a_from to a_to, if no cycle has been counted since
+};
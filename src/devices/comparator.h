@@ -4,10 +4,13 @@
 #include "sram.h"
 #include "flags.h"
 #include "register.h"
+#include <vector>
 
 //___________________________________________________________________________________
 class Comparator: public Device {   // the comparator module
 	float inputs[4] = {0,0,0,0};    // Inputs from RA0 -> RA3
+	Connection *pins[4] = {0,0,0,0};   // where they came from
+	std::vector<std::pair<Connection *, double> > watched;   // crossings the analog domain stops at
 	float vref = 0;                 // the last value of VREF
 	BYTE  cmcon = 0;                // the last value of CMCON
 	DeviceEventQueue eq;            // fires Comparator change events
@@ -15,6 +18,7 @@ class Comparator: public Device {   // the comparator module
 
 	void queue_change(BYTE old_cmcon);
 	void recalc();                  // recalculate c1, c2 and CMCON
+	void watch();                   // have Transient stop where an output would change
 
 	// look for CMCON changes and recalculate
 	void on_register_change(Register *r, const std::string &name, const std::vector<BYTE> &data);
@@ -4,7 +4,14 @@
  *  Created on: 30 Oct 2022
  *      Author: paul
  */
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include "connection_node.h"
+#include "../utils/thread_pool.h"
+
+std::atomic<unsigned long> Connection_Node::m_solved(0);
+thread_local int Connection_Node::m_deferred = 0;
 
 const std::string MeshItem::id() { return as_text(this); }
 double MeshItem::R() { return dev->R(); }
@@ -59,6 +66,62 @@ void Mesh::add(Device *d, bool r) {
 	items.push_back(MeshItem(d, r));
 }
 
+//___________________________________________________________
+//  A net is digital if it has a single source, and everything else is a connection
+// without the time dependent behaviour of a capacitor or inductor.  When such a
+// source is also a logic output, having an effectively infinite resistance, no
+// current flows and every connection in the net simply takes the source voltage.
+void Connection_Data::classify() {
+	rail = NULL;
+	for (auto dev: devicelist) {
+		if (MeshItem(dev).is_voltage()) {
+			if (rail) { rail = NULL; return; }
+			rail = dev;
+		} else if (!dynamic_cast<Connection *>(dev) || dynamic_cast<Capacitor *>(dev) || dynamic_cast<Inductor *>(dev)) {
+			rail = NULL;
+			return;
+		}
+	}
+}
+
+//___________________________________________________________
+// Everything a solution depends upon, and a hash of it.
+size_t Connection_Data::fingerprint(std::vector<double> &state) {
+	state.clear();
+	size_t key = 0;
+	for (auto dev: devicelist) {
+		MeshItem item(dev);
+		for (double value: {item.R(), item.V()}) {
+			state.push_back(value);
+			key = key * 1000003 ^ std::hash<double>()(value);
+		}
+	}
+	return key;
+}
+
+void Connection_Data::remember(size_t key, const std::vector<double> &state) {
+	if (solutions.size() >= max_solutions && solutions.find(key) == solutions.end()) {
+		solutions.erase(recent.front());
+		recent.pop_front();
+	}
+	solutions[key] = Solution{state, amps};
+	used(key);
+}
+
+void Connection_Data::used(size_t key) {
+	auto at = std::find(recent.begin(), recent.end(), key);
+	if (at != recent.end()) recent.erase(at);
+	recent.push_back(key);
+}
+
+void Connection_Data::reset() {
+	amps.clear();
+	for (auto &mesh: meshes) {
+		mesh->amps = 0;
+		for (auto &item: mesh->items) item.Itotal = 0;
+	}
+}
+
 
 std::set<Device *>Connection_Node::target_set() const {
 	const auto &t = targets();
@@ -116,6 +179,10 @@ Connection_Node::Connection_Node(Device *current, Node *parent):
 
 };
 
+Connection_Node::Connection_Node(SmartPtr<Connection_Data> a_cdata):
+		m_current(NULL), m_parent(NULL), m_cdata(a_cdata) {
+}
+
 Connection_Node::Connection_Node(Device *current, SmartPtr<Connection_Data>cdata, bool getting_targets):
 		m_current(current), m_parent(NULL) {
 	m_cdata = cdata;
@@ -274,23 +341,12 @@ void Connection_Node::build_matrices(Matrix &m, Matrix &v) {
 
 //___________________________________________________
 // Calculate current flowing through each mesh.
-void Connection_Node::calculate_I(Matrix &m, Matrix &v, double D) {
+void Connection_Node::calculate_I(const LUSolver &lu, Matrix &v) {
+	std::vector<double> I = lu.solve(v);
 	for (size_t i=0; i< m_cdata->meshes.size(); ++i) {
-		auto &i_mesh = *m_cdata->meshes[i];
-		Matrix n(m);
-		for (size_t j=0; j< m_cdata->meshes.size(); ++j) n(i,j) = v(0,j);
-		if (m_debug > 2) {
-			std::cout << "matrix " << i << ": \n";
-			n.view();
-		}
-		double Di = n.determinant();
-		i_mesh.I(Di / D);
-		if (m_debug > 2) {
-			std::cout << "D" << i << " is " << Di;
-			std::cout << ", I" << i << " is D" << i << "/D";
-			std::cout << " = " << Di << "/" << D << " = " << i_mesh.amps;
-			std::cout << std::endl;
-		}
+		m_cdata->meshes[i]->I(I[i]);
+		if (m_debug > 2)
+			std::cout << "I" << i << " = " << I[i] << std::endl;
 	}
 }
 
@@ -310,32 +366,12 @@ void Connection_Node::add_mesh_totals() {
 }
 
 //_______________________________________________________________________________
-// Create a matrix M, using the available meshes. Then find it's determinant, D.
-// We also find a matrix V having the voltages sources for each mesh.
-// Replacing V in M by column in turn, we can calculate D0..Dn.  We can then
-// calculate I[n] = D[n] / D, where I[n] is the current through mesh n.
-void Connection_Node::solve_meshes() {
-	if (m_debug > 0) show_meshes();
-
-	Matrix m(m_cdata->meshes.size());
-	Matrix v(1, m_cdata->meshes.size());
-	build_matrices(m, v);
-
-	double D = m.determinant();
-	if (m_debug > 2) {
-		std::cout << "M is \n";
-		m.view();
-		std::cout << "V is \n";
-		v.view();
-		std::cout << "D is " << D << std::endl;
-	}
-	if (D == 0) return;   //nothing to be done
-	calculate_I(m, v, D);
-	add_mesh_totals();
-
-	std::map<Device *, double> values;  // save existing values
+// Set the current through each device, and cascade voltage updates from
+// each source.
+bool Connection_Node::publish() {
+	std::map<Device *, std::pair<double, double> > values;  // save existing voltage and current
 	for (auto dev: m_cdata->devicelist) {
-		values[dev] = dev->I();
+		values[dev] = {dev->rd(false), dev->I()};
 		if (m_debug > 2)
 			std::cout << dev->name() << ": vdrop=" << m_cdata->amps[dev] * dev->R() << std::endl;
 		dev->I(m_cdata->amps[dev]);
@@ -347,10 +383,90 @@ void Connection_Node::solve_meshes() {
 				item.dev->update_voltage(item.V());  // cascade updates
 		}
 	}
+	bool changed = false;
 	for (auto dev: m_cdata->devicelist) {
-		if (not float_equiv(values[dev], dev->I()))
+		auto &was = values[dev];
+		if (not float_equiv(was.second, dev->I())) {
 			dev->refresh();   // generate update events for changed devices
+			changed = true;
+		} else if (not float_equiv(was.first, dev->rd(false))) {
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+//_______________________________________________________________________________
+// Set a digital net to its source's logic level.  No current flows.
+bool Connection_Node::propagate() {
+	std::map<Device *, std::pair<double, double> > values;  // save existing voltage and current
+	for (auto dev: m_cdata->devicelist) {
+		values[dev] = {dev->rd(false), dev->I()};
+		dev->I(0);
+	}
+	m_cdata->rail->update_voltage(m_cdata->rail->rd(false));   // cascade updates
+	bool changed = false;
+	for (auto dev: m_cdata->devicelist) {
+		auto &was = values[dev];
+		if (not float_equiv(was.first, dev->rd(false)) or not float_equiv(was.second, 0)) {
+			dev->refresh();
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+//_______________________________________________________________________________
+// Create a matrix M, using the available meshes, and a matrix V having the
+// voltage sources for each mesh.  The mesh currents I satisfy M.I = V, so we
+// factor M once and solve for all of them together.  A singular M means there
+// is no unique solution, so nothing to be done.
+//  If the net has been in this state before, we already know the answer, and if
+// it is driven by a logic output, there is nothing to solve.
+//  compute() reads the devices in the net, but changes nothing outside of it, so
+// nets may be computed side by side.  apply() then publishes the result.
+bool Connection_Node::compute() {
+	if (m_debug > 0) show_meshes();
+	if (m_cdata->rail && m_cdata->rail->R() >= max_R) return true;
+
+	std::vector<double> state;
+	size_t key = m_cdata->fingerprint(state);
+	auto known = m_cdata->solutions.find(key);
+	if (known != m_cdata->solutions.end() && known->second.state == state) {
+		m_cdata->amps = known->second.amps;
+		m_cdata->used(key);
+		return true;
+	}
+
+	Matrix m(m_cdata->meshes.size());
+	Matrix v(1, m_cdata->meshes.size());
+	build_matrices(m, v);
+
+	LUSolver lu;
+	bool solvable = lu.factor(m);
+	++m_solved;
+	if (m_debug > 2) {
+		std::cout << "M is \n";
+		m.view();
+		std::cout << "V is \n";
+		v.view();
+		std::cout << "D is " << (solvable ? lu.determinant() : 0) << std::endl;
 	}
+	if (!solvable) return false;   //nothing to be done
+	calculate_I(lu, v);
+	add_mesh_totals();
+	m_cdata->remember(key, state);
+	return true;
+}
+
+bool Connection_Node::apply() {
+	if (m_cdata->rail && m_cdata->rail->R() >= max_R)
+		return propagate();
+	return publish();
+}
+
+void Connection_Node::solve_meshes() {
+	if (compute()) apply();
 }
 
 //__________________________________________________________________________________
@@ -387,7 +503,7 @@ bool Connection_Node::add_shared(Mesh &prev, Mesh &mesh, Connection_Node *start,
 //______________________________________________________________________
 //  only uses the first node, produces m_meshes which represents the
 // set of interconnections.
-void Connection_Node::process_model() {
+void Connection_Node::build() {
 	m_cdata->meshes.clear();
 	if (m_debug > 0) {
 		std::cout << "DeviceList=";
@@ -427,5 +543,96 @@ void Connection_Node::process_model() {
 			add_shared(*prev, *mesh, start, finish);
 		}
 	}
+	m_cdata->classify();
+}
+
+void Connection_Node::process_model() {
+	build();
 	solve_meshes();
 }
+
+std::map<Device *, SmartPtr<Connection_Data> > &Connection_Node::nets() {
+	static NeverDestroyed<std::map<Device *, SmartPtr<Connection_Data> > > l_nets;
+	return *l_nets;
+}
+
+std::vector<Device *> &Connection_Node::dirty() {
+	static thread_local std::vector<Device *> l_dirty;
+	return l_dirty;
+}
+
+//______________________________________________________________________
+// The net containing a_device, walking it only if we have not already
+// done so since the last change to any connection.
+SmartPtr<Connection_Data> Connection_Node::net(Device *a_device) {
+	Simulation::Lock lock;
+	static unsigned long l_topology = Simulation::topology();
+	if (l_topology != Simulation::topology()) {
+		nets().clear();
+		l_topology = Simulation::topology();
+	}
+	auto found = nets().find(a_device);
+	if (found != nets().end())
+		return found->second;
+
+	Connection_Node node(a_device);
+	node.build();
+	SmartPtr<Connection_Data> cdata = node.m_cdata;
+	cdata->all_nodes.clear();     // the meshes are all we need from here on
+	for (auto dev: cdata->devicelist)
+		nets()[dev] = cdata;
+	nets()[a_device] = cdata;
+	return cdata;
+}
+
+void Connection_Node::query(Device *a_device) {
+	if (m_deferred) {
+		dirty().push_back(a_device);
+		return;
+	}
+	Simulation::Lock lock;
+	SmartPtr<Connection_Data> cdata = net(a_device);
+	cdata->reset();
+	Connection_Node node(cdata);
+	node.solve_meshes();
+}
+
+//______________________________________________________________________
+// Solve every net queried while deferred.  Nets share no devices, so
+// when there are several, they are computed on the thread pool, and the
+// results are published here, one net at a time, in the order queried.
+// Returns whether publishing changed any voltage or current.
+bool Connection_Node::settle() {
+	if (dirty().empty()) return false;
+	Simulation::Lock lock;          // held by this thread alone, while the pool computes
+	std::vector<Device *> queried;
+	queried.swap(dirty());
+	std::set<Connection_Data *> seen;
+	std::vector<std::unique_ptr<Connection_Node> > nodes;
+	for (auto dev: queried) {
+		SmartPtr<Connection_Data> cdata = net(dev);
+		if (!seen.insert(cdata.operator->()).second) continue;
+		cdata->reset();
+		nodes.push_back(std::unique_ptr<Connection_Node>(new Connection_Node(cdata)));
+	}
+	std::vector<char> solved(nodes.size(), false);
+	if (nodes.size() > 1 && ThreadPool::shared().size()) {
+		std::vector<std::function<void()> > tasks;
+		for (size_t n = 0; n < nodes.size(); ++n)
+			tasks.push_back([&nodes, &solved, n]{ solved[n] = nodes[n]->compute(); });
+		ThreadPool::shared().run(tasks);
+	} else {
+		for (size_t n = 0; n < nodes.size(); ++n)
+			solved[n] = nodes[n]->compute();
+	}
+	bool changed = false;
+	for (size_t n = 0; n < nodes.size(); ++n)
+		if (solved[n] && nodes[n]->apply()) changed = true;
+	return changed;
+}
+
+Connection_Node::Defer::Defer() { ++m_deferred; }
+
+Connection_Node::Defer::~Defer() {
+	if (--m_deferred == 0) settle();
+}
@@ -5,6 +5,7 @@
  *      Author: paul
  */
 #pragma once
+#include <atomic>
 #include "device_base.h"
 #include "../utils/matrix.h"
 
@@ -31,7 +32,18 @@ struct Mesh {
 	bool reversed(Device *d);
 };
 
+//  The solution for a net depends only on the resistance of each device and the
+// voltage of each source.  Most nets move between a handful of such states, such
+// as a port pin driven high, driven low, or impeded and pulled up, so the currents
+// for the last few states are kept, keyed by a hash of the state.  When there is no
+// room for another, the state used least recently is forgotten.
 struct Connection_Data {
+	struct Solution {
+		std::vector<double> state;
+		std::map<Device *, double> amps;
+	};
+	static const size_t max_solutions = 8;
+
 	std::map<Device *, SmartPtr<Node>> targets;
 	std::map<Device *, SmartPtr<Node>> all_nodes;
 	std::set<Device *> loop_start;
@@ -39,6 +51,16 @@ struct Connection_Data {
 	std::deque<Device *> devicelist;
 	std::map<Device *, double> amps;
 	std::vector<SmartPtr<Mesh>> meshes;
+
+	std::map<size_t, Solution> solutions;
+	std::deque<size_t> recent;     // keys of the solutions, least recently used first
+	Device *rail = NULL;           // the only source, if everything else is a plain connection
+
+	void classify();
+	void reset();                  // forget the currents of the last solution
+	size_t fingerprint(std::vector<double> &state);
+	void remember(size_t key, const std::vector<double> &state);
+	void used(size_t key);         // now the most recently used
 };
 
 class Connection_Node: public Node {
@@ -58,6 +80,8 @@ class Connection_Node: public Node {
 //  the source components.
 
 	int m_debug = 0;
+	static std::atomic<unsigned long> m_solved;
+	static thread_local int m_deferred;
 
 	Device *m_current;
 	SmartPtr<Connection_Node> m_parent;
@@ -66,6 +90,11 @@ class Connection_Node: public Node {
 	std::vector<Device *> m_sources;
 	std::vector<Device *> m_targets;
 
+	static std::map<Device *, SmartPtr<Connection_Data> > &nets();   // by member device
+	static std::vector<Device *> &dirty();                           // queried while deferred, by this thread
+	static SmartPtr<Connection_Data> net(Device *a_device);          // walked if need be
+	Connection_Node(SmartPtr<Connection_Data> a_cdata);              // adopt a solved net
+
 protected:
 	std::vector<Device *> sources() const { return m_sources; }
 	std::vector<Device *> targets() const { return m_targets; }
@@ -90,9 +119,14 @@ protected:
 
 	void show_meshes();
 	void build_matrices(Matrix &m, Matrix &v);
-	void calculate_I(Matrix &m, Matrix &v, double D);
+	void calculate_I(const LUSolver &lu, Matrix &v);
 	void add_mesh_totals();
+	bool publish();         // each returns whether anything changed
+	bool propagate();
+	bool compute();         // only the net itself is changed
+	bool apply();           // publish what compute() found
 	void solve_meshes();
+	void build();
 
 public:
 	Connection_Node(Device *d, SmartPtr<Connection_Data>cdata, bool getting_targets=true);
@@ -101,5 +135,23 @@ public:
 
 	// produces m_meshes, combines and solves.   Then updates voltage drops.
 	void process_model();
+
+	//  Walking a net and finding its meshes depends only on how devices are connected,
+	// so the meshes are kept, and later queries for any device in the net solve them
+	// again with present values.  A net is walked again after Simulation::rewired().
+	static void query(Device *a_device);
+	static unsigned long solved() { return m_solved; }   // mesh matrices factored so far
+
+	//  While a Defer is in scope, queries only note which nets need solving.  They are
+	// solved when settle() is called, or the outermost Defer goes out of scope, with
+	// independent nets computed side by side on ThreadPool::shared().  Deferral belongs
+	// to the thread which asked for it, so a query made by the UI or the clock while
+	// the machine thread is deferring is solved straight away, as it always was.
+	struct Defer {
+		Defer();
+		~Defer();
+		bool settle() { return Connection_Node::settle(); }
+	};
+	static bool settle();   // false if solving changed nothing
 };
 
@@ -14,3 +14,24 @@ struct Params {
 
 };
 
+//___________________________________________________________________________________
+//  A model of the 16F6xx family, described at compile time.  The core wraps the program
+// counter, stack pointer and bank offsets with masks rather than by division, so each
+// size must be a power of two, and a model which breaks that does not compile.  Bank
+// size and stack depth are the same across the family, and the core takes them as
+// constants; set_params() refuses a model which differs.
+template <short FLASH, short EEPROM, short BANKS, short BANK_SIZE, short PINS, short STACK>
+struct Model {
+	static constexpr bool power_of_two(short n) { return n > 0 && (n & (n - 1)) == 0; }
+	static_assert(power_of_two(FLASH), "flash size must be a power of two");
+	static_assert(power_of_two(BANK_SIZE), "bank size must be a power of two");
+	static_assert(power_of_two(STACK), "stack depth must be a power of two");
+
+	static constexpr Params params(const char *a_name) {
+		return Params{a_name, FLASH, EEPROM, BANKS, BANK_SIZE, PINS, STACK};
+	}
+};
+
+typedef Model<1024, 128, 4, 0x80, 18, 8> PIC16f627a;
+typedef Model<2048, 128, 4, 0x80, 18, 8> PIC16f628a;
+typedef Model<4096, 256, 4, 0x80, 18, 8> PIC16f648a;
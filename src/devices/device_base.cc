@@ -2,6 +2,8 @@
 #include <deque>
 #include "device_base.h"
 #include "connection_node.h"
+#include "nodal.h"
+#include "transient.h"
 #include "../utils/utility.h"
 //_______________________________________________________________________________________________
 //  Event queue static definitions
@@ -10,6 +12,13 @@ std::mutex DeviceEventQueue::mtx;
 std::queue< SmartPtr<QueueableEvent> >DeviceEventQueue::events;
 Connection Simulation::m_clock;
 double Simulation::m_speed = 1.0;
+bool Simulation::m_nodal = false;
+std::atomic<unsigned long> Simulation::m_topology(0);
+
+std::recursive_mutex &Simulation::mutex() {
+	static NeverDestroyed<std::recursive_mutex> l_mutex;
+	return *l_mutex;
+}
 
 LockUI DeviceEventQueue::m_ui_lock(false);
 
@@ -39,6 +48,7 @@ template <class T> class
 				return slot;
 		Slot *l_slot = new Slot(d, this);
 		m_slots.insert(l_slot);
+		Simulation::rewired();
 		query_voltage();
 		return l_slot;
 	}
@@ -46,8 +56,11 @@ template <class T> class
 	// use a Connection_Node to determine I & voltage drops
 	void Connection::query_voltage() {
 //		if (debug()) std::cout << name() << ": Top of chain\n";
-		Connection_Node node(this);            // @suppress("Type cannot be resolved")
-		node.process_model();                  // @suppress("Method cannot be resolved")
+		if (Simulation::nodal()) {
+			NodalAnalysis::query(this);
+			return;
+		}
+		Connection_Node::query(this);
 	}
 
 	void Connection::refresh() {
@@ -65,9 +78,11 @@ template <class T> class
 	}
 
 	bool Connection::unslot(Device *dev){
-		for (auto &slot: m_slots)
+		for (auto slot: m_slots)
 			if (slot->dev == dev) {
 				m_slots.erase(slot);
+				delete slot;
+				Simulation::rewired();
 				return true;
 			}
 		return false;
@@ -118,9 +133,33 @@ template <class T> class
 		Device(a_name), m_V(V), m_conductance(1.0e+4), m_impeded(impeded), m_determinate(true) {
 	};
 
+	// a copy has no slots of its own; the originals belong to c
+	Connection::Connection(const Connection &c):
+		Device(c), m_V(c.m_V), m_conductance(c.m_conductance), m_impeded(c.m_impeded), m_determinate(c.m_determinate) {
+		I(c.I());
+	}
+
+	Connection &Connection::operator=(const Connection &c) {
+		Device::operator=(c);
+		m_V = c.m_V;
+		m_conductance = c.m_conductance;
+		m_impeded = c.m_impeded;
+		m_determinate = c.m_determinate;
+		I(c.I());
+		return *this;
+	}
+
+	//  Terminals and wires keep the slots they hold in a connection, so they are told to
+	// let go of it first, while it is still whole.
 	Connection::~Connection() {
+		std::vector<Device *> holders;
+		for (auto slot: m_slots)
+			if (slot->dev && slot->held) holders.push_back(slot->dev);
+		for (auto dev: holders) dev->released(*this);
 		unslot_all_slots();
+		Simulation::rewired();
 		eq.remove_events_for(this);
+		Transient::unwatch(*this);
 	}
 
 	double Connection::rd(bool include_vdrop) const {
@@ -247,15 +286,6 @@ template <class T> class
 		input_changed();
 	}
 
-	void Terminal::calc_conductance_precedents(double &Gin, double &Iin, double &Idrop) {
-		Gin = 0;  Iin = 0; Idrop = 0;
-		for (auto &c : m_connects ) {
-			Gin += c.first->conductance();
-			Iin += c.first->rd(false) * c.first->conductance();
-			Idrop += c.first->vDrop() * c.first->conductance();
-		}
-	}
-
 	void Terminal::input_changed() {
 		query_voltage();
 	}
@@ -271,14 +301,18 @@ template <class T> class
 	Terminal::~Terminal() {
 		for (auto &c : m_connects ) {
 			DeviceEvent<Connection>::unsubscribe<Terminal>(this, &Terminal::on_change, c.first);
-			c.second->unslot();
+			c.first->unslot(this);
 		}
+		Simulation::rewired();
 	}
 
 	bool Terminal::connect(Connection &c) {
 		if (m_connects.find(&c) == m_connects.end()) {
-			m_connects[&c] = c.slot(this);
+			Slot *slot = c.slot(this);
+			slot->held = true;
+			m_connects[&c] = slot;
 			DeviceEvent<Connection>::subscribe<Terminal>(this, &Terminal::on_change, &c);
+			Simulation::rewired();
 			query_voltage();
 			return true;
 		} else {
@@ -292,6 +326,7 @@ template <class T> class
 			DeviceEvent<Connection>::unsubscribe<Terminal>(this, &Terminal::on_change, &c);
 			if (c.unslot(this))
 				m_connects.erase(&c);
+			Simulation::rewired();
 			query_voltage();
 		}
 	}
@@ -303,49 +338,32 @@ template <class T> class
 	}
 
 	//___________________________________________________________________________________
-	// A capacitor.  A time frequency driven analog component.
-	// Changes in voltage are recalculated periodically, as determined by a signal
-	// from Simulation::clock().
-
-	// Vc is sum(V/R).  Ci is total conductance.
-
-//	double Capacitor::calculate_voltage(double Ic, double IdropC, double Ci) {
-	void Capacitor::input_changed() {
-		auto ts = current_time_us();
-		auto dT = ((ts - m_T).count() / 1000000.0) * Simulation::speed();   // dT in seconds
-		if (dT > 0.01)  { // 10 ms steps.  We don't want to flood the message queue!
-			double Gin, Iin, Idrop;
-			calc_conductance_precedents(Gin, Iin, Idrop);
-
-			double R = 1/Gin;          // Resistance into Cap
-			double tau = R * m_F;      // Time constant  RC
-			double dI = Idrop * (1 - exp(-dT / tau));     //  Current in over time period
-
-			if (not float_equiv(dI, 0, 1e-5)) {
-				double Vc = Iin * R;       // Voltage at input when fully charged
-				double Vr = rd(false);     // voltage drop
-				double dV = -dI * R;       // IR = V - qR / RC:  V = IR + qR/RC
-				m_T = ts;
-				double V = dV + Vr;
-				m_R = V / (dI - Idrop);
-
-				if (true or debug()) {
-					std::cout << "R=" << R+Connection::R();
-					std::cout << "; dT=" << dT;
-					std::cout << "; tau=" << tau;
-					std::cout << "; I=" << m_I;
-					std::cout << "; Idrop=" << Idrop;
-					std::cout << "; Vc=" << Vc << "; Cap dV=" << dV << "[" << rd(false) + dV << "]" << std::endl;
-				}
-				query_voltage();
-			}
-		}
+	// A capacitor.  Over a step of h seconds, a current i changes its voltage by i.h/C,
+	// taken at the end of the step for backward Euler, or as the average of its start
+	// and end for the trapezoidal rule.
+
+	void Capacitor::companion(double h, Method m, double &R, double &E) const {
+		double k = m == TRAPEZOIDAL ? h / (2 * m_F) : h / m_F;
+		R = 1/Connection::conductance() + k;
+		E = -(m_Vc + (m == TRAPEZOIDAL ? k * m_I : 0));
+	}
+
+	double Capacitor::state(double h, Method m, double i) const {
+		if (m == TRAPEZOIDAL) return m_Vc + h / (2 * m_F) * (i + m_I);
+		return m_Vc + h / m_F * i;
+	}
+
+	void Capacitor::accept(double h, Method m, double i) {
+		m_Vc = state(h, m, i);
+		m_I = i;
+		m_R = std::fabs(m_Vc) < std::fabs(i) * max_R ? std::max(0.0, m_Vc / i) : max_R;
+		if (debug())
+			std::cout << name() << ": dT=" << h << "; I=" << m_I << "; Vc=" << m_Vc << std::endl;
 	}
 
 	void Capacitor::reset() {
 		set_value(0, false);
-		m_T = current_time_us();
-		m_I = m_R = 0;
+		m_Vc = m_I = m_R = 0;
 	}
 
 	bool Capacitor::connect(Connection &c) {
@@ -353,73 +371,46 @@ template <class T> class
 		return Terminal::connect(c);
 	}
 
-	void Capacitor::on_clock(Connection *c, const std::string &a_name, const std::vector<BYTE>&a_data) {
-		input_changed();
-	}
 	double Capacitor::F() { return m_F; }
 	void Capacitor::F(double a_F) { m_F = a_F; }
 
 	Capacitor::Capacitor(double V, const std::string &a_name): Terminal(V, a_name) {
 		m_F = 1e-6;
 		reset();
-		DeviceEvent<Connection>::subscribe<Capacitor>(this, &Capacitor::on_clock, &Simulation::clock());
+		Transient::add(this);
 	};
 	Capacitor::Capacitor(const std::string name): Terminal(name) {
 		m_F = 1e-6;
 		reset();
-		DeviceEvent<Connection>::subscribe<Capacitor>(this, &Capacitor::on_clock, &Simulation::clock());
+		Transient::add(this);
 	};
 	Capacitor::~Capacitor() {
-		DeviceEvent<Connection>::unsubscribe<Capacitor>(this, &Capacitor::on_clock, &Simulation::clock());
+		Transient::remove(this);
 	}
 
 	//___________________________________________________________________________________
-	// An Inductor.  A time frequency driven analog component.
-
-	// Vc is sum(V/R).  Ci is total conductivity.
-//	double Inductor::calculate_voltage(double Ic, double IdropC, double Ci) {
-	void Inductor::input_changed() {
-		auto ts = current_time_us();
-		auto dT = ((ts - m_T).count() / 1000000.0) * Simulation::speed();   // dT in seconds
-		if (dT > 0.01)  { // 10 ms steps.  We don't want to flood the message queue!
-			double Gin, Iin, Idrop;
-			calc_conductance_precedents(Gin, Iin, Idrop);
-
-			double R = 1/Gin;
-			double tau =  m_H / R;                  // time constant L/R
-			double Vc = Iin * R;                     // Voltage at input of R
-			double Vr = (Iin+Idrop) * R;            // Current Voltage
-
-			double V = Vr * exp(-dT / tau);
-			double dV = Vr - V;
-
-			if (not float_equiv(dV, 0, Vc / 10000)) {
-				double dI = dV * R;
-				m_I = m_I - Idrop + dI;
-				m_R = V / m_I - 1/Connection::conductance();
-				m_T = ts;
-				if (debug()) {
-					std::cout << "tau=" << tau;
-					std::cout << "; Vc=" << Vc;
-					std::cout << "; Vr=" << Vr;
-					std::cout << "; R=" << R;
-					std::cout << "; Rout=" << Connection::R();
-					std::cout << "; dT=" << dT;
-					std::cout << "; dV=" << dV;
-					std::cout << "; dI=" << dI;
-					std::cout << "; V=" << V;
-					std::cout << "; I=" << m_I << std::endl;
-				}
-				query_voltage();
-			}
-		}
+	// An Inductor.  Over a step of h seconds, the voltage across it changes its current
+	// by V.h/L, taking the voltage as for a capacitor's current.
+
+	void Inductor::companion(double h, Method m, double &R, double &E) const {
+		double k = m == TRAPEZOIDAL ? 2 * m_H / h : m_H / h;
+		R = 1/Connection::conductance() + k;
+		E = k * m_I + (m == TRAPEZOIDAL ? m_VL : 0);
 	}
 
+	double Inductor::state(double h, Method m, double i) const { return i; }
+
+	void Inductor::accept(double h, Method m, double i) {
+		m_VL = m == TRAPEZOIDAL ? 2 * m_H / h * (i - m_I) - m_VL : m_H / h * (i - m_I);
+		m_I = i;
+		m_R = std::fabs(m_VL) < std::fabs(i) * max_R ? std::max(0.0, m_VL / i) : max_R;
+		if (debug())
+			std::cout << name() << ": dT=" << h << "; VL=" << m_VL << "; I=" << m_I << std::endl;
+	}
 
 	void Inductor::reset() {
 		m_R = 1e+6;
-		m_I = -1e-6;
-		m_T = current_time_us();
+		m_I = m_VL = 0;
 	}
 
 	bool Inductor::connect(Connection &c) {
@@ -427,25 +418,22 @@ template <class T> class
 		return Terminal::connect(c);
 	}
 
-	void Inductor::on_clock(Connection *c, const std::string &a_name, const std::vector<BYTE>&a_data) {
-		input_changed();
-	}
 	double Inductor::H() { return m_H; }
 	void Inductor::H(double a_H) { m_H = a_H; }
 
 	Inductor::Inductor(double V, const std::string &a_name): Terminal(V, a_name) {
 		m_H = 1e-2;
 		reset();
-		DeviceEvent<Connection>::subscribe<Inductor>(this, &Inductor::on_clock, &Simulation::clock());
+		Transient::add(this);
 	};
 	Inductor::Inductor(const std::string name): Terminal(name) {
 //		debug(true);
 		m_H = 1e-2;
 		reset();
-		DeviceEvent<Connection>::subscribe<Inductor>(this, &Inductor::on_clock, &Simulation::clock());
+		Transient::add(this);
 	};
 	Inductor::~Inductor() {
-		DeviceEvent<Connection>::unsubscribe<Inductor>(this, &Inductor::on_clock, &Simulation::clock());
+		Transient::remove(this);
 	}
 
 
@@ -564,6 +552,7 @@ template <class T> class
 	}
 
 	void Gate::on_change(Connection *D, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		if (debug()) {
 			std::cout << "Gate " << this->name() << " received event " << name << std::endl;
 		}
@@ -706,22 +695,80 @@ template <class T> class
 //   If a wire has no unimpeded connections, the voltage on the wire is indeterminate.
 
 
+	bool Wire::m_split = false;
+
+	DisjointSets<Wire *> &Wire::sets() {
+		static NeverDestroyed<DisjointSets<Wire *> > l_sets;
+		return *l_sets;
+	}
+
+	std::map<Wire *, Wire::Net> &Wire::nets() {
+		static NeverDestroyed<std::map<Wire *, Net> > l_nets;
+		return *l_nets;
+	}
+
+	std::map<Connection *, std::set<Wire *> > &Wire::joins() {
+		static NeverDestroyed<std::map<Connection *, std::set<Wire *> > > l_joins;
+		return *l_joins;
+	}
+
+	// Merge the nets of two wires, the smaller into the larger.
+	void Wire::join(Wire *a, Wire *b) {
+		Wire *ra = sets().find(a), *rb = sets().find(b);
+		if (ra == rb) return;
+		a->net(); b->net();
+		Wire *root = sets().unite(ra, rb);
+		Wire *other = root == ra ? rb : ra;
+		auto &into = nets()[root];
+		auto &from = nets()[other];
+		into.wires.insert(into.wires.end(), from.wires.begin(), from.wires.end());
+		into.connections.insert(from.connections.begin(), from.connections.end());
+		nets().erase(other);
+	}
+
+	// Union-find cannot split a set, so after a disconnect, every net is found again.
+	void Wire::rejoin() {
+		m_split = false;
+		sets().clear();
+		nets().clear();
+		for (auto &joined: joins())
+			for (auto wire: joined.second)
+				for (auto &conn: wire->connections)
+					nets()[wire].connections.insert(conn.first);
+		for (auto &n: nets()) {
+			sets().add(n.first);
+			n.second.wires.push_back(n.first);
+		}
+		for (auto &joined: joins())
+			for (auto wire: joined.second)
+				join(*joined.second.begin(), wire);
+	}
+
+	Wire::Net &Wire::net() {
+		Simulation::Lock lock;
+		if (m_split) rejoin();
+		auto &n = nets()[sets().find(this)];
+		if (n.wires.empty()) n.wires.push_back(this);    // a wire on its own
+		return n;
+	}
+
 	double Wire::recalc() {
 		indeterminate = true;
 		if (debug()) std::cout << "read wire " << name() << ": [";
 		double sum_conductance = 0;
 		double sum_v_over_R = 0;
-		for (auto conn = connections.begin(); conn != connections.end(); ++conn) {
+		auto &conns = net().connections;
+		for (auto conn = conns.begin(); conn != conns.end(); ++conn) {
 			if (debug()) {
-				std::cout << (conn == connections.begin()?"":", ");
-				std::cout << conn->first->name();
+				std::cout << (conn == conns.begin()?"":", ");
+				std::cout << (*conn)->name();
 			}
-			double v = conn->first->rd(false);
-			if (conn->first->impeded())  {
+			double v = (*conn)->rd(false);
+			if ((*conn)->impeded())  {
 				if (debug()) std::cout << "[o]: ";
 			} else {
 				indeterminate = false;
-				double iR = conn->first->conductance();
+				double iR = (*conn)->conductance();
 				if (debug()) std::cout << "[i]: ";
 				sum_conductance += iR;
 				sum_v_over_R += v * iR;
@@ -743,9 +790,8 @@ template <class T> class
 		return V;
 	}
 
-	bool Wire::assert_voltage() {  // fires signals to any impeded connections
+	std::vector<Wire *> Wire::assert_voltage() {  // fires signals to any impeded connections
 		double V = recalc();
-		bool changed = Voltage != V;
 		if (debug()) {
 			if (!indeterminate) {
 				std::cout << "Wire: " << name() << " is at " << (indeterminate?"unknown":"");
@@ -754,27 +800,37 @@ template <class T> class
 			}
 			std::cout << name() << ": changing Voltage from " << Voltage << " to " << V << std::endl;
 		}
-		Voltage = V;
-		for (auto conn = connections.begin(); conn != connections.end(); ++conn) {
-			if (conn->first->impeded()) {
+		auto &n = net();
+		std::vector<Wire *> changed;
+		for (auto wire: n.wires) {
+			if (wire->Voltage != V) changed.push_back(wire);
+			wire->Voltage = V;
+			wire->indeterminate = indeterminate;
+			wire->m_sum_conductance = m_sum_conductance;
+			wire->m_sum_v_over_R = m_sum_v_over_R;
+		}
+		for (auto conn: n.connections) {
+			if (conn->impeded()) {
 				if (indeterminate)
-					conn->first->determinate(false);
+					conn->determinate(false);
 				else {
-					conn->first->set_value(V, true);
+					conn->set_value(V, true);
 				}
-			} else if (not indeterminate) {
-//				conn->second->set_vdrop(V);
-//				conn->second->calculate_vdrop(V);
 			}
 		}
 		return changed;
 	}
 
-	void Wire::queue_change(){  // Add a voltage change event to the queue
-		if (assert_voltage()) {        // determine wire voltage and update impeded connections
-			eq.queue_event(new DeviceEvent<Wire>(*this, "Wire Voltage Change"));
-			eq.process_events();
+	void Wire::queue_change(){  // Add a voltage change event to the queue for each wire that changed
+		std::vector<Wire *> changed;
+		{
+			Simulation::Lock lock;
+			changed = assert_voltage();    // determine net voltage and update impeded connections
 		}
+		for (auto wire: changed)
+			eq.queue_event(new DeviceEvent<Wire>(*wire, "Wire Voltage Change"));
+		if (changed.size())
+			eq.process_events();
 	}
 
 	void Wire::on_connection_change(Connection *conn, const std::string &name, const std::vector<BYTE> &data) {
@@ -784,6 +840,7 @@ template <class T> class
 			std::cout << "Wire " << this->name() << direction << "Event " << conn->name() << " changed to " << conn->rd() << "V [";
 			std::cout << (conn->impeded()?"o":"i") << "]" << std::endl;
 		}
+		if (compiled()) return;
 		queue_change();
 	}
 
@@ -794,16 +851,33 @@ template <class T> class
 	}
 
 	Wire::~Wire() {
+		Simulation::Lock lock;
 		eq.remove_events_for(this);
 		for (auto &conn: connections) {
 			DeviceEvent<Connection>::unsubscribe<Wire>(this, &Wire::on_connection_change, conn.first);
+			conn.first->unslot(this);
+			auto joined = joins().find(conn.first);
+			joined->second.erase(this);
+			if (joined->second.empty()) joins().erase(joined);
 		}
+		m_split = true;
 	}
 
 	bool Wire::connect(Connection &connection, const std::string &a_name) {
-		connections[&connection] = connection.slot(this);
+		Slot *slot = connection.slot(this);
+		slot->held = true;
+		connections[&connection] = slot;
 		if (a_name.length()) connection.name(a_name);
 		DeviceEvent<Connection>::subscribe<Wire>(this, &Wire::on_connection_change, &connection);
+		{
+			Simulation::Lock lock;
+			auto &joined = joins()[&connection];
+			joined.insert(this);
+			if (!m_split) {
+				net().connections.insert(&connection);
+				for (auto wire: joined) join(this, wire);
+			}
+		}
 		queue_change();
 		return true;
 	}
@@ -812,14 +886,30 @@ template <class T> class
 			if (conn->first == &connection) {
 				DeviceEvent<Connection>::unsubscribe<Wire>(this, &Wire::on_connection_change,
 						const_cast<Connection *>(&connection));
-				if (conn->first->unslot(this))
+				if (conn->first->unslot(this)) {
+					Simulation::Lock lock;
+					auto joined = joins().find(conn->first);
+					joined->second.erase(this);
+					if (joined->second.empty()) joins().erase(joined);
 					connections.erase(conn);
+					m_split = true;
+				}
 				break;
 			}
 		}
 		queue_change();
 	}
 
+	size_t Wire::net_size() {
+		Simulation::Lock lock;
+		return net().wires.size();
+	}
+
+	std::set<Connection *> Wire::terminals() {
+		Simulation::Lock lock;
+		return net().connections;
+	}
+
 	double Wire::rd(bool include_vdrop) {
 		if (debug()) std::cout << name() << ": rd() = " << Voltage << std::endl;
 		return Voltage;
@@ -852,11 +942,13 @@ template <class T> class
 	}
 
 	void Tristate::on_change(Connection *D, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		recalc_output();
 		if (debug()) pr_debug_info("input change");
 	}
 
 	void Tristate::on_gate_change(Connection *D, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		recalc_output();
 		if (debug()) pr_debug_info("gate change");
 	}
@@ -1045,6 +1137,7 @@ template <class T> class
 
 	bool ToggleSwitch::closed() { return m_closed; }
 	void ToggleSwitch::closed(bool a_closed) {
+		if (m_closed != a_closed) Simulation::rewired();
 		m_closed = a_closed;
 		recalc_output();
 	}
@@ -1056,6 +1149,7 @@ template <class T> class
 // A generalised D flip flop or a latch, depending on how we use it
 
 	void Latch::on_clock_change(Connection *Ck, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		if (!m_D) return;
 		if (debug()) std::cout << this->name() << ": Ck is " << Ck->signal() << std::endl;
 		if ((m_positive ^ (!Ck->signal()))) {
@@ -1065,6 +1159,7 @@ template <class T> class
 	}
 
 	void Latch::on_data_change(Connection *D, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		if (!m_Ck) return;
 		if (m_positive ^ (!m_Ck->signal())) {
 			if (debug()) std::cout << this->name() << ": D is " << D->signal() << std::endl;
@@ -1108,6 +1203,7 @@ template <class T> class
 			DeviceEvent<Connection>::subscribe<Latch>(this, &Latch::on_data_change, m_D);
 	}
 
+	bool Latch::positive() { return m_positive; }
 	bool Latch::clocked() { return m_clocked; }
 	void Latch::set_name(const std::string &a_name) {
 		name(a_name);
@@ -1140,11 +1236,13 @@ template <class T> class
 	}
 
 	void Mux::on_change(Connection *D, const std::string &name) {
+		if (compiled()) return;
 		if (D == m_in[m_idx])     // only pays attention to the selected input
 			set_output();
 	}
 
 	void Mux::on_select(Connection *D, const std::string &name) {
+		if (compiled()) return;
 		calculate_select();
 		set_output();
 	}
@@ -1231,6 +1329,7 @@ template <class T> class
 	}
 
 	void FET::on_change(Connection *D, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		recalc();
 	}
 
@@ -1291,6 +1390,7 @@ template <class T> class
 	}
 
 	void Schmitt::on_change(Connection *D, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		recalc();
 	}
 
@@ -1302,6 +1402,7 @@ template <class T> class
 		m_in(&in), m_enable(&en), m_out(Vss, impeded), m_gate_invert(gate_invert), m_out_invert(out_invert) {
 		DeviceEvent<Connection>::subscribe<Schmitt>(this, &Schmitt::on_change, m_in);
 		DeviceEvent<Connection>::subscribe<Schmitt>(this, &Schmitt::on_change, m_enable);
+		watch(true);
 		recalc();
 	}
 	Schmitt::Schmitt(Connection &in, bool impeded, bool out_invert):
@@ -1309,9 +1410,11 @@ template <class T> class
 		DeviceEvent<Connection>::subscribe<Schmitt>(this, &Schmitt::on_change, m_in);
 		DeviceEvent<Connection>::subscribe<Schmitt>(this, &Schmitt::on_change, m_enable);
 		m_enable->set_value(Vdd, true);     // No enable signal, so always true
+		watch(true);
 		recalc();
 	}
 	Schmitt::~Schmitt() {
+		watch(false);
 		DeviceEvent<Connection>::unsubscribe<Schmitt>(this, &Schmitt::on_change, m_in);
 		DeviceEvent<Connection>::unsubscribe<Schmitt>(this, &Schmitt::on_change, m_enable);
 	}
@@ -1320,11 +1423,20 @@ template <class T> class
 	void Schmitt::out_invert(bool invert) { m_out_invert = invert; recalc(); }
 
 	void Schmitt::set_input(Connection *in) {
+		watch(false);
 		if (m_in) DeviceEvent<Connection>::unsubscribe<Schmitt>(this, &Schmitt::on_change, m_in);
 		m_in = in;
 		if (m_in) DeviceEvent<Connection>::subscribe<Schmitt>(this, &Schmitt::on_change, m_in);
+		watch(true);
 	};
 
+	// Our input is a synchronisation point between the analog and digital domains.
+	void Schmitt::watch(bool on) {
+		if (!m_in) return;
+		for (double level: {m_lo, m_hi})
+			if (on) Transient::watch(*m_in, level); else Transient::unwatch(*m_in, level);
+	}
+
 	void Schmitt::set_gate(Connection *en) {
 		if (m_enable) DeviceEvent<Connection>::unsubscribe<Schmitt>(this, &Schmitt::on_change, m_enable);
 		m_enable = en;
@@ -1481,19 +1593,24 @@ template <class T> class
 
 //___________________________________________________________________________________
 // A binary counter.  If clock is set, it is synchronous, otherwise a ripple.
+	void Counter::count(unsigned long a_by) {
+		m_overflow = false;
+		unsigned long value = m_value + a_by;
+		if (value >> m_nbits) {          // carried out of the top bit
+			value = 0;
+			m_overflow = true;
+		}
+		set_value(value);
+	}
+
 	void Counter::on_signal(Connection *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		if (not m_clock) {            // enabled
-			m_overflow = false;
 			if (m_ripple) {
-				m_value = m_value + 1;     // asynchronous ripple counter
-			} else if (c->signal() ^ (not m_rising)) {
-				m_value = m_value + 1;     // synchronous ripple counter
-			}
-			if (m_value & (1 << m_bits.size())) {
-				m_value = 0;
-				m_overflow = true;
+				count(1);                  // asynchronous ripple counter
+			} else {
+				count((c->signal() ^ (not m_rising))?1:0);   // synchronous ripple counter
 			}
-			set_value(m_value);
 		} else {
 			m_signal = c->signal();
 		}
@@ -1501,16 +1618,12 @@ template <class T> class
 
 	// synchronous counter on clock signal
 	void Counter::on_clock(Connection *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (compiled()) return;
 		eq.process_events();
 		if (c->signal() ^ (not m_rising)) {   // rising clock
-			m_overflow = false;
-			m_value = m_value + (m_signal?1:0);   // clock current input signal into the bus
-			if (m_value & (1 << m_bits.size())) {
-				m_value = 0;
-				m_overflow = true;
-			}
+			bool in = m_signal;
 			m_signal = false;       // triggered
-			set_value(m_value);
+			count(in?1:0);          // clock current input signal into the bus
 		}
 	}
 
@@ -1518,6 +1631,7 @@ template <class T> class
 			m_in(NULL), m_clock(NULL), m_rising(true), m_ripple(true), m_signal(true) {
 		if (m_rising) m_ripple = false;
 		assert(nbits < sizeof(a_value) * 8);
+		m_nbits = nbits;
 		m_bits.resize(nbits);
 		set_value(a_value);
 	}
@@ -1526,6 +1640,7 @@ template <class T> class
 		Device(), m_in(&a_in), m_clock(a_clock), m_rising(rising), m_ripple(true), m_signal(true) {
 		if (m_rising) m_ripple = false;
 		assert(nbits < sizeof(a_value) * 8);
+		m_nbits = nbits;
 		m_bits.resize(nbits);
 		set_value(a_value);
 
@@ -1558,28 +1673,31 @@ template <class T> class
 
 	void Counter::set_name(const std::string &a_name) {
 		name(a_name);
-		for (size_t n = 0; n < m_bits.size(); ++n) {
-			m_bits[n].name(a_name + int_to_hex(n, "."));
+		for (size_t n = 0; n < m_nbits; ++n) {
+			if (m_bits[n]) m_bits[n]->name(a_name + int_to_hex(n, "."));
 		}
 	}
 
 	void Counter::set_value(unsigned long a_value) {
 		m_value = a_value;
-		for (size_t n = 0; n < m_bits.size(); ++n) {
-			m_bits[n].set_value(((a_value & 1) != 0) * Vdd, false);
-			a_value >>= 1;
+		for (size_t n = 0; n < m_nbits; ++n) {
+			if (m_bits[n]) m_bits[n]->set_value(((a_value >> n) & 1) * Vdd, false);
 		}
 	}
 
 	Connection & Counter::bit(size_t n) {
-		assert(n < m_bits.size());
-		return m_bits[n];
+		assert(n < m_nbits);
+		if (!m_bits[n]) {
+			m_bits[n] = new Connection(((m_value >> n) & 1) * Vdd, false);
+			if (name().size()) m_bits[n]->name(name() + int_to_hex(n, "."));
+		}
+		return *m_bits[n];
 	}
 
 	std::vector<Connection *> Counter::databits() {
 		std::vector<Connection *> l_bits;  // we use "pointer to connection" so we can easily plug into other components
-		for (auto &bit: m_bits) {
-			l_bits.push_back(&bit);
+		for (size_t n = 0; n < m_nbits; ++n) {
+			l_bits.push_back(&bit(n));
 		}
 		return l_bits;
 	}
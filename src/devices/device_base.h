@@ -24,9 +24,11 @@
 #include <cassert>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include "../utils/smart_ptr.h"
+#include "../utils/disjoint_sets.h"
 #include "../utils/utility.h"
 #include "constants.h"
 #include <cmath>
@@ -51,6 +53,8 @@ class Node {
 	virtual void process_model() = 0;
 };
 
+class Connection;
+
 #define min_R (1.0e-12)
 #define max_R (1.0e+12)
 
@@ -59,6 +63,7 @@ class Node {
 class Device {
 	std::string m_name;
 	bool m_debug;
+	bool m_compiled = false;
 	double amps = 0;
   public:
 	static constexpr double Vss = 0.0;
@@ -89,9 +94,12 @@ class Device {
 	virtual void I(double a_amps) { amps = a_amps; }
 	void debug(bool flag) { m_debug = flag; }
 	bool debug() const { return m_debug; }
+	void compiled(bool flag) { m_compiled = flag; }
+	bool compiled() const { return m_compiled; }    // evaluated by a Netlist, not by its own events
 	virtual const std::string &name() const { return m_name; }
 	virtual int slot_id(int a_id) { return a_id; }
 	virtual bool unslot(Device *dev){ return true; }
+	virtual void released(Connection &c) {}     // c, in which this holds a slot, is going
 	virtual void name(const std::string &a_name) { m_name = a_name; }
 };
 
@@ -110,6 +118,11 @@ class QueueableEvent {
 //___________________________________________________________________________________
 // We can have a single event queue for all devices, and process events
 // in sequence.  Events themselves are derived from a base class.
+//  The queue is not split into electrical islands.  Devices are coupled through their
+// subscriptions as much as through their connections, and a handler may subscribe,
+// unsubscribe, copy a SmartPtr or write an SFR, none of which is safe from more than one
+// thread.  What runs in parallel is the solving of the nets that a round of events has
+// changed (see Connection_Node::Defer).
 class DeviceEventQueue {
 	static std::queue< SmartPtr<QueueableEvent> >events;
 	static std::mutex mtx;
@@ -329,6 +342,7 @@ struct Slot {
 	double total_R = 0;           // total resistance after this connection
 	double precedents_G = 0;      // conductance for precedents, this slot.
 	double resistance_ratio = 0;  // calculated resistance ratio
+	bool held = false;            // dev keeps this slot, and is released() before it goes
 
 	Slot(Device *a_dev, Device *a_connection);
 	~Slot() {
@@ -369,6 +383,8 @@ class Connection: public Device {
 
 	Connection(const std::string &a_name="");
 	Connection(double V, bool impeded=true, const std::string &a_name="");
+	Connection(const Connection &c);                 // copies the state, but not the slots
+	Connection &operator=(const Connection &c);
 	virtual	~Connection();
 
 	virtual void refresh();
@@ -398,14 +414,34 @@ class Connection: public Device {
 //  This singleton provides a clock signal to other components which may need
 //  periodic updates or refresh cycles.
 //  Simulation::speed() is a multiplier which controls how quickly
+//  Simulation::nodal() selects nodal analysis (see nodal.h) rather than mesh analysis
+//  to solve for voltages and currents.
+//  Simulation::rewired() is called whenever a connection is made or broken.  Solvers
+//  which keep a circuit's structure between queries compare topology() against the
+//  value they built at, and walk the circuit again if it has moved on.
+//  The machine, the clock and the UI each run on a thread of their own, and any of them
+//  may query a connection or wire one up.  The caches and registries which solvers and
+//  wires share are only read or changed while holding Simulation::mutex(), most simply
+//  by declaring a Simulation::Lock.  Events are queued, but never processed, while it
+//  is held, so a handler is free to take any other lock.
 //
 class Simulation {
 	static Connection m_clock;
 	static double m_speed;
+	static bool m_nodal;
+	static std::atomic<unsigned long> m_topology;
   public:
+	struct Lock: std::lock_guard<std::recursive_mutex> {
+		Lock(): std::lock_guard<std::recursive_mutex>(mutex()) {}
+	};
+	static std::recursive_mutex &mutex();
 	static Connection &clock() { return m_clock; }
 	static double speed() { return m_speed; }   // a simulation speed multiplier
 	static void speed(double a_speed) { m_speed = a_speed; }
+	static bool nodal() { return m_nodal; }
+	static void nodal(bool a_nodal) { m_nodal = a_nodal; }
+	static unsigned long topology() { return m_topology; }
+	static void rewired() { ++m_topology; }
 	Simulation() {}
 };
 
@@ -436,10 +472,10 @@ class Terminal: public Connection {
 	virtual void input_changed();
 	virtual void query_voltage();
 	void update_voltage(double v);
-	void calc_conductance_precedents(double &Gin, double &Iin, double &Idrop);
 
 	virtual bool connect(Connection &c);
 	virtual void disconnect(Connection &c);
+	virtual void released(Connection &c) { disconnect(c); }
 	virtual int slot_id(int a_id) { return m_nslots++; }
 
 	void impeded(bool a_impeded);
@@ -451,26 +487,43 @@ class Terminal: public Connection {
 //  A resistor is just a terminal.
 
 //___________________________________________________________________________________
-// A [very basic] capacitor.
-// This is a time frequency driven analog component.
-// Changes in voltage are recalculated periodically, as determined by a signal
-//   from Simulation::clock().
-class Capacitor: public Terminal {
+//  Capacitors and inductors store energy, so what they do next depends upon what they
+// have already done.  Over a step of h seconds, each is replaced by a companion model:
+// a resistance R in series with an EMF E which carries its history, so that the solver
+// may treat it like any other branch.  The trapezoidal rule is the more accurate, and
+// backward Euler the more stable.  Between steps, for solvers which know nothing of
+// time, each presents the resistance which passes the current it last carried.
+class Reactive {
+  public:
+	enum Method { EULER, TRAPEZOIDAL };
+
+	virtual void companion(double h, Method m, double &R, double &E) const = 0;
+	virtual double state(double h, Method m, double i) const = 0;   // after carrying i for h seconds
+	virtual void accept(double h, Method m, double i) = 0;          // and make it so
+	virtual ~Reactive() {}
+};
+
+//___________________________________________________________________________________
+// A capacitor.  Its voltage is advanced in simulated time by the transient engine
+//  (see transient.h).
+class Capacitor: public Terminal, public Reactive {
 	double m_F;       // Capacitance in Farads
+	double m_Vc = 0;  // voltage across the capacitance
 	double m_I = 0;   // current flowing
 	double m_R = 0;   // Resistance factor
-	time_stamp m_T;   // last time stamp
-
-  protected:
-	virtual void input_changed();
-	void on_clock(Connection *c, const std::string &a_name, const std::vector<BYTE>&a_data);
 
   public:
 	double F();
 	void F(double a_F);
+	double Vc() const { return m_Vc; }
 	void reset();
 	double conductance() const { return 1/(1/Connection::conductance() + m_R); }
 	virtual bool connect(Connection &c);
+
+	virtual void companion(double h, Method m, double &R, double &E) const;
+	virtual double state(double h, Method m, double i) const;
+	virtual void accept(double h, Method m, double i);
+
 	Capacitor(const std::string name="");
 	Capacitor(double V, const std::string &a_name);
 	~Capacitor();
@@ -478,25 +531,26 @@ class Capacitor: public Terminal {
 
 
 //___________________________________________________________________________________
-// A [very basic] capacitor.
-// This is a time frequency driven analog component.
-class Inductor: public Terminal {
+// An inductor.  Its current is advanced in simulated time by the transient engine.
+class Inductor: public Terminal, public Reactive {
 	double m_H;        // Inductance in Henry's
-	time_stamp m_T;    // last time stamp
 	double m_I = 0;    // Current
+	double m_VL = 0;   // voltage across the inductance
 	double m_R = 0;
 
-  protected:
-	virtual void input_changed();
-	void on_clock(Connection *c, const std::string &a_name, const std::vector<BYTE>&a_data);
-
   public:
 
 	double H();
 	void H(double a_H);
+	double IL() const { return m_I; }
 	void reset();
 	double conductance() const { return 1/(1/Connection::conductance() + m_R); }
 	virtual bool connect(Connection &c);
+
+	virtual void companion(double h, Method m, double &R, double &E) const;
+	virtual double state(double h, Method m, double i) const;
+	virtual void accept(double h, Method m, double i);
+
 	Inductor(const std::string name="");
 	Inductor(double V, const std::string &a_name);
 	~Inductor();
@@ -553,6 +607,7 @@ class Inverse: public Connection {
 
 	Inverse(Connection &a_c);
 	virtual  ~Inverse();
+	Connection &source() { return c; }
 
 	virtual void set_value(double V, bool a_impeded);
 	void impeded(bool a_impeded);
@@ -717,8 +772,19 @@ class XOrGate: public Gate {
 //  impeded (output) connections.
 //
 //   If a wire has no unimpeded connections, the voltage on the wire is indeterminate.
+//
+//   Wires which share a connection are the same electrical net.  Such wires are
+//  joined as they are connected, and a change to any connection on the net updates
+//  every wire on it together, and each wire that changes queues a single event.
+//  Disconnecting or destroying a wire may split a net, so nets are then found again
+//  from scratch, when next needed.
 
 class Wire: public Device {
+	struct Net {
+		std::vector<Wire *> wires;
+		std::set<Connection *> connections;     // of every wire, each once
+	};
+
 	std::map< Connection *, Slot * > connections;
 	bool indeterminate;
 	DeviceEventQueue eq;
@@ -726,9 +792,16 @@ class Wire: public Device {
 	double m_sum_conductance;
 	double m_sum_v_over_R;
 
+	static bool m_split;                                             // nets need finding again
+	static DisjointSets<Wire *> &sets();
+	static std::map<Wire *, Net> &nets();                            // by the wire naming each
+	static std::map<Connection *, std::set<Wire *> > &joins();       // the wires on each connection
+	static void rejoin();
+	static void join(Wire *a, Wire *b);
+	Net &net();
 
 	double recalc();
-	bool assert_voltage();
+	std::vector<Wire *> assert_voltage();   // the wires which changed
 	void queue_change();
 	void on_connection_change(Connection *conn, const std::string &name, const std::vector<BYTE> &data);
 
@@ -739,10 +812,13 @@ class Wire: public Device {
 
 	virtual bool connect(Connection &connection, const std::string &a_name="");
 	virtual void disconnect(const Connection &connection);
+	virtual void released(Connection &c) { disconnect(c); }
 
 	double rd(bool include_vdrop=false);
 	bool determinate();
 	bool signal();
+	size_t net_size();                                  // wires on the same net
+	std::set<Connection *> terminals();                 // the connections of every wire on the net
 };
 
 //___________________________________________________________________________________
@@ -945,7 +1021,10 @@ public:
 	virtual ~FET();
 	const Connection& in() const;
 	const Connection& gate() const;
+	Connection &in() { return m_in; }
+	Connection &gate() { return m_gate; }
 	Connection &rd();
+	bool nType() const { return m_is_nType; }
 };
 
 //___________________________________________________________________________________
@@ -962,6 +1041,7 @@ class Schmitt: public Device {
 	const double m_hi = Vdd / 10.0 * 6;
 
 	void recalc();
+	void watch(bool on);
 	void on_change(Connection *D, const std::string &name, const std::vector<BYTE> &data);
 
   public:
@@ -1033,6 +1113,9 @@ class SignalTrace: public Device {
 
 //___________________________________________________________________________________
 // A binary counter.  If clock is set, it is synchronous, otherwise asynch ripple.
+//  The count is kept as a number.  A connection for a bit is only made once something
+// asks for it through bit() or databits(), and only bits which have been asked for
+// are updated as the count changes.
 class Counter: public Device {
 	Connection *m_in;
 	Connection *m_clock;   // Synchronous counter
@@ -1040,11 +1123,13 @@ class Counter: public Device {
 	bool m_ripple;
 	bool m_signal;
 	bool m_overflow;
-	std::vector<Connection> m_bits;
+	size_t m_nbits;
+	std::vector<SmartPtr<Connection> > m_bits;   // NULL until asked for
 	unsigned long m_value;
 	Connection m_dummy;
 	DeviceEventQueue eq;
 
+	void count(unsigned long a_by);
 	void on_signal(Connection *c, const std::string &name, const std::vector<BYTE> &data);
 
 	// synchronous counter on clock signal
@@ -1065,9 +1150,12 @@ class Counter: public Device {
 	Connection *get_input() { return m_in; }
 	Connection *get_clock() { return m_clock; }
 	void asynch(bool a_ripple) { m_ripple = a_ripple; }  // first bit follows input
+	bool asynch() const { return m_ripple; }
+	bool rising() const { return m_rising; }
 	bool is_sync() const { return (m_clock != NULL); }
 	bool overflow() const { return m_overflow; }
-	size_t nbits() const { return m_bits.size(); }
+	void overflow(bool a_overflow) { m_overflow = a_overflow; }
+	size_t nbits() const { return m_nbits; }
 	unsigned long get() const { return m_value; }
 
 };
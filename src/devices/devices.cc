@@ -3,6 +3,7 @@
 #include <iostream>
 #include <cassert>
 #include "devices.h"
+#include "transient.h"
 #include "../utils/smart_ptr.cc"
 
 template <class T> class
@@ -86,6 +87,15 @@ template <class T> class
 		DeviceEvent<Register>::unsubscribe<Timer0>(this, &Timer0::register_changed);
 		DeviceEvent<Clock>::unsubscribe<Timer0>(this, &Timer0::on_clock);
 	}
+	void Timer0::reset() {
+		clock_source_select(true);
+		clock_transition(true);
+		assign_prescaler(true);
+		prescaler_rate_select(7);
+		m_counter = 0;
+		m_timer = 0;
+		m_sync = false;
+	}
 	void Timer0::clock_source_select(bool a_use_RA4){
 		m_use_RA4 = a_use_RA4;
 	};
@@ -121,10 +131,12 @@ template <class T> class
 			m_t1ckps1.set_value((d & Flags::T1CON::T1CKPS1)?Vdd:Vss, false);
 		} else if (name == "TMR1L") {
 			m_prescaler.set_value(0);
-			m_tmr1.set_value((m_tmr1.get() & ~0xff) | data[0]);
+			m_tmr1.set_value((m_tmr1.get() & ~0xff) | data[Register::DVALUE::NEW]);
+			m_chain.reload();
 		} else if (name == "TMR1H") {
 			m_prescaler.set_value(0);
-			m_tmr1.set_value((m_tmr1.get() & ~0xff00) | ((int)data[0] << 8));
+			m_tmr1.set_value((m_tmr1.get() & ~0xff00) | ((int)data[Register::DVALUE::NEW] << 8));
+			m_chain.reload();
 		}
 	}
 
@@ -155,7 +167,8 @@ template <class T> class
 		m_synch(m_scale.rd(), true, 1, 0, &m_fosc),
 		m_syn_asyn({&m_synch.bit(0), &m_scale.rd()}, {&m_t1sync}, "T1Sync"),
 		m_signal({&m_syn_asyn.rd(), &m_tmr1on}, false, "Timer ON"),
-		m_tmr1(m_signal.rd(), false, 16)
+		m_tmr1(m_signal.rd(), false, 16),
+		m_chain({&m_t1csmux, &m_prescaler, &m_scale, &m_synch, &m_syn_asyn, &m_signal, &m_tmr1}, "Timer1")
 	{
 		DeviceEvent<Register>::subscribe<Timer1>(this, &Timer1::register_changed);
 		DeviceEvent<Clock>::subscribe<Timer1>(this, &Timer1::on_clock);
@@ -165,6 +178,7 @@ template <class T> class
 		m_fosc.name("Fosc/4");
 		m_scale.rd().name("Scale");
 		m_synch.bit(0).name("Sync");
+		m_chain.observe(m_tmr1.bit(0));
 
 		m_t1oscen.set_value(Vss, false);
 		m_tmr1cs.set_value(Vss, false);
@@ -181,6 +195,466 @@ template <class T> class
 		DeviceEvent<Connection>::unsubscribe<Timer1>(this, &Timer1::on_tmr1, &m_tmr1.bit(0));
 	}
 
+	//_______________________________________________________________________________________________
+	// Timer2
+	BYTE Timer2::value() const {
+		if (!m_on) return m_held;
+		Clock::Cycle count = (m_clock.cycles() - m_start) / m_prescale;
+		if (count < m_wrap) return (BYTE)count;
+		return (BYTE)((count - m_wrap) % ((WORD)m_pr2 + 1));   // a match is due, but not yet processed
+	}
+
+	void Timer2::restart(BYTE a_value, Clock::Cycle a_phase) {   // TMR2 = a_value, a_phase cycles into the prescaler
+		m_held = a_value;
+		m_start = m_clock.cycles() - (Clock::Cycle)a_value * m_prescale - a_phase;
+		m_wrap = (a_value > m_pr2) ? 256 : (WORD)m_pr2 + 1;    // past PR2, we count all the way to overflow
+		schedule();
+	}
+
+	void Timer2::schedule() {
+		if (m_on)
+			m_clock.schedule("TMR2", m_start + (Clock::Cycle)m_wrap * m_prescale);
+		else
+			m_clock.cancel("TMR2");
+	}
+
+	void Timer2::register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data) {
+		if (name=="T2CON") {          // any write clears the prescaler and postscaler
+			BYTE v = value();
+			BYTE new_value = data[Register::DVALUE::NEW];
+			m_on = new_value & Flags::T2CON::TMR2ON;
+			if      (new_value & Flags::T2CON::T2CKPS1) m_prescale = 16;
+			else if (new_value & Flags::T2CON::T2CKPS0) m_prescale = 4;
+			else                                        m_prescale = 1;
+			m_postscale = ((new_value >> 3) & 0x0f) + 1;
+			m_matches = 0;
+			restart(v);
+		} else if (name=="TMR2") {    // so does a write to TMR2
+			m_matches = 0;
+			restart(data[Register::DVALUE::NEW]);
+		} else if (name=="PR2") {     // keep counting from where we are, but toward a new period
+			BYTE v = value();
+			Clock::Cycle phase = m_on ? (m_clock.cycles() - m_start) % m_prescale : 0;
+			m_pr2 = data[Register::DVALUE::NEW];
+			restart(v, phase);
+		}
+	}
+
+	void Timer2::on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "TMR2" && m_on) {
+			bool match = (m_wrap == (WORD)m_pr2 + 1);   // otherwise we overflowed past PR2
+			m_start += (Clock::Cycle)m_wrap * m_prescale;
+			m_wrap = (WORD)m_pr2 + 1;
+			schedule();
+			if (match) {
+				eq.queue_event(new DeviceEvent<Timer2>(*this, "Match", {}));
+				if (++m_matches >= m_postscale) {
+					m_matches = 0;
+					eq.queue_event(new DeviceEvent<Timer2>(*this, "Interrupt", {}));
+				}
+			}
+		}
+	}
+
+	void Timer2::reset() {
+		m_on = false;
+		m_pr2 = 0xff;
+		m_prescale = 1;
+		m_postscale = 1;
+		m_matches = 0;
+		m_held = 0;
+		m_wrap = 256;
+		m_start = m_clock.cycles();
+		m_clock.cancel("TMR2");
+	}
+
+	Timer2::Timer2(Clock &a_clock): Device("TMR2"), m_clock(a_clock) {
+		reset();
+		DeviceEvent<Register>::subscribe<Timer2>(this, &Timer2::register_changed);
+		DeviceEvent<Clock>::subscribe<Timer2>(this, &Timer2::on_clock, &m_clock);
+	}
+
+	Timer2::~Timer2() {
+		DeviceEvent<Register>::unsubscribe<Timer2>(this, &Timer2::register_changed);
+		DeviceEvent<Clock>::unsubscribe<Timer2>(this, &Timer2::on_clock, &m_clock);
+	}
+
+//_______________________________________________________________________________________________
+// CCP1
+	WORD CCP1::timer1() {
+		return (WORD)m_tmr1.tmr1().get();
+	}
+
+	WORD CCP1::timer1_prescale() const {
+		return 1 << ((m_t1con & (Flags::T1CON::T1CKPS0 | Flags::T1CON::T1CKPS1)) >> 4);
+	}
+
+	void CCP1::drive(bool a_level) {   // RB3 only hears about transitions
+		if (a_level != m_output) {
+			m_output = a_level;
+			eq.queue_event(new DeviceEvent<CCP1>(*this, "Output", {(BYTE)a_level}));
+		}
+	}
+
+	void CCP1::compare_match() {
+		if      (mode() == 0b1000) drive(true);
+		else if (mode() == 0b1001) drive(false);
+		else if (mode() == 0b1011) eq.queue_event(new DeviceEvent<CCP1>(*this, "Special Event", {}));
+		eq.queue_event(new DeviceEvent<CCP1>(*this, "Interrupt", {}));
+	}
+
+	//  Compare against TMR1, and if Timer1 is running from the instruction clock, work out
+	// when it will reach CCPR1 and schedule that.  If we are a little early because Timer1
+	// had not yet counted, we simply come back later.  An external Timer1 clock cannot be
+	// predicted, so then we compare as Timer1 reports each new value.
+	void CCP1::compare_check() {
+		if (!compare()) {
+			m_clock.cancel("CCP1");
+			return;
+		}
+		WORD tmr1 = timer1();
+		if (tmr1 == m_ccpr1) {
+			if (!m_matched) compare_match();
+			m_matched = true;
+		} else {
+			m_matched = false;
+		}
+		if ((m_t1con & Flags::T1CON::TMR1ON) && !(m_t1con & Flags::T1CON::TMR1CS)) {
+			unsigned long ahead = (WORD)(m_ccpr1 - tmr1);
+			if (!ahead) ahead = 0x10000;
+			m_clock.schedule("CCP1", m_clock.cycles() + ahead * timer1_prescale());
+		} else {
+			m_clock.cancel("CCP1");
+		}
+	}
+
+	//  At the start of each Timer2 period, latch the duty cycle and raise the output.  The
+	// duty cycle counts oscillator periods through the Timer2 prescaler, so the falling edge
+	// is duty * prescale / 4 instruction cycles into the period.
+	void CCP1::period_start() {
+		m_duty = pwm_duty();
+		Clock::Cycle high_for = ((Clock::Cycle)m_duty * m_tmr2.prescale()) / 4;
+		if (m_duty == 0) {
+			drive(false);
+			m_clock.cancel("CCP1");
+		} else if (high_for >= m_tmr2.period_cycles()) {   // 100% duty
+			drive(true);
+			m_clock.cancel("CCP1");
+		} else {
+			drive(true);
+			m_clock.schedule("CCP1", m_tmr2.period_start() + high_for);
+		}
+	}
+
+	void CCP1::capture_edge(bool a_level) {
+		bool rising = a_level && !m_input;
+		bool falling = !a_level && m_input;
+		m_input = a_level;
+
+		bool take = false;
+		switch (mode()) {
+		case 0b0100: take = falling; break;
+		case 0b0101: take = rising; break;
+		case 0b0110: take = rising && (++m_edges % 4) == 0; break;
+		case 0b0111: take = rising && (++m_edges % 16) == 0; break;
+		}
+		if (take) {
+			m_ccpr1 = timer1();
+			eq.queue_event(new DeviceEvent<CCP1>(*this, "Capture", {(BYTE)(m_ccpr1 & 0xff), (BYTE)(m_ccpr1 >> 8)}));
+			eq.queue_event(new DeviceEvent<CCP1>(*this, "Interrupt", {}));
+		}
+	}
+
+	void CCP1::register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "CCP1CON") {
+			BYTE old_mode = mode();
+			m_ccp1con = data[Register::DVALUE::NEW];
+			if (mode() != old_mode) {
+				m_edges = 0;
+				m_matched = false;
+				m_clock.cancel("CCP1");
+				if      (mode() == 0b1000) drive(false);   // compare mode sets the pin on match
+				else if (mode() == 0b1001) drive(true);    // ... or clears it
+				else if (!pwm()) drive(false);
+				compare_check();
+			}
+		} else if (name == "CCPR1L") {
+			m_ccpr1 = (m_ccpr1 & 0xff00) | data[Register::DVALUE::NEW];
+			compare_check();
+		} else if (name == "CCPR1H") {
+			m_ccpr1 = (m_ccpr1 & 0x00ff) | ((WORD)data[Register::DVALUE::NEW] << 8);
+			compare_check();
+		} else if (name == "T1CON") {
+			m_t1con = data[Register::DVALUE::NEW];
+			compare_check();
+		} else if (name == "TMR1L" || name == "TMR1H") {   // Timer1 sees this write too; look again next cycle
+			if (compare()) m_clock.schedule("CCP1", m_clock.cycles());
+		}
+	}
+
+	void CCP1::on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "CCP1") {
+			if (pwm())
+				drive(false);      // end of the duty cycle
+			else
+				compare_check();
+		}
+	}
+
+	void CCP1::timer1_changed(Timer1 *t, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "Value" && compare() && (m_t1con & Flags::T1CON::TMR1CS))
+			compare_check();
+	}
+
+	void CCP1::timer2_changed(Timer2 *t, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "Match" && pwm())
+			period_start();
+	}
+
+	void CCP1::portB_changed(PORTB *p, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "PORTB::CCP1")
+			capture_edge(data[0]);
+	}
+
+	void CCP1::reset() {
+		m_ccp1con = 0;
+		m_ccpr1 = 0;
+		m_t1con = 0;
+		m_duty = 0;
+		m_edges = 0;
+		m_input = false;
+		m_matched = false;
+		m_clock.cancel("CCP1");
+		drive(false);
+	}
+
+	CCP1::CCP1(Clock &a_clock, Timer1 &a_tmr1, Timer2 &a_tmr2):
+		Device("CCP1"), m_clock(a_clock), m_tmr1(a_tmr1), m_tmr2(a_tmr2), m_output(false)
+	{
+		reset();
+		DeviceEvent<Register>::subscribe<CCP1>(this, &CCP1::register_changed);
+		DeviceEvent<Clock>::subscribe<CCP1>(this, &CCP1::on_clock, &m_clock);
+		DeviceEvent<Timer1>::subscribe<CCP1>(this, &CCP1::timer1_changed, &m_tmr1);
+		DeviceEvent<Timer2>::subscribe<CCP1>(this, &CCP1::timer2_changed, &m_tmr2);
+		DeviceEvent<PORTB>::subscribe<CCP1>(this, &CCP1::portB_changed);
+	}
+
+	CCP1::~CCP1() {
+		DeviceEvent<Register>::unsubscribe<CCP1>(this, &CCP1::register_changed);
+		DeviceEvent<Clock>::unsubscribe<CCP1>(this, &CCP1::on_clock, &m_clock);
+		DeviceEvent<Timer1>::unsubscribe<CCP1>(this, &CCP1::timer1_changed, &m_tmr1);
+		DeviceEvent<Timer2>::unsubscribe<CCP1>(this, &CCP1::timer2_changed, &m_tmr2);
+		DeviceEvent<PORTB>::unsubscribe<CCP1>(this, &CCP1::portB_changed);
+	}
+
+//_______________________________________________________________________________________________
+// USART
+	bool USART::transmitting() const {
+		return (m_rcsta & Flags::RCSTA::SPEN) && (m_txsta & Flags::TXSTA::TXEN) && !(m_txsta & Flags::TXSTA::SYNC);
+	}
+
+	bool USART::receiving() const {
+		return (m_rcsta & Flags::RCSTA::SPEN) && (m_rcsta & Flags::RCSTA::CREN) && !(m_txsta & Flags::TXSTA::SYNC)
+			&& !(m_rcsta & Flags::RCSTA::OERR);
+	}
+
+	void USART::signal(const std::string &a_name, bool a_value) {
+		eq.queue_event(new DeviceEvent<USART>(*this, a_name, {(BYTE)a_value}));
+	}
+
+	void USART::load_tsr() {     // TXREG -> TSR, and the byte is on its way
+		if (!m_shifting) signal("TRMT", false);
+		m_tsr = m_txreg;
+		m_txreg_full = false;
+		m_shifting = true;
+		signal("TXIF", true);
+		m_tx_due += frame_cycles(m_txsta & Flags::TXSTA::TX9);
+		m_clock.schedule("USART::TX", m_tx_due);
+	}
+
+	void USART::start_receive(Clock::Cycle a_from) {
+		if (m_receiving || !receiving() || !m_host || !m_host->available()) return;
+		m_receiving = true;
+		m_rx_due = a_from + frame_cycles(m_rcsta & Flags::RCSTA::RX9);
+		m_clock.schedule("USART::RX", m_rx_due);
+	}
+
+	BYTE USART::receive() {
+		if (m_fifo.size()) {
+			WORD data = m_fifo.front(); m_fifo.pop_front();
+			BYTE status = m_rcsta & ~Flags::RCSTA::RX9D;
+			if (data & 0x100) status |= Flags::RCSTA::RX9D;
+			if (status != m_rcsta) {
+				m_rcsta = status;
+				eq.queue_event(new DeviceEvent<USART>(*this, "Receive Status", {m_rcsta}));
+			}
+			m_rcreg = data & 0xff;
+			if (m_fifo.empty()) signal("RCIF", false);
+		}
+		return m_rcreg;
+	}
+
+	void USART::register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "TXSTA") {
+			bool was_transmitting = transmitting();
+			m_txsta = (data[Register::DVALUE::NEW] & ~Flags::TXSTA::TRMT) | (m_txsta & Flags::TXSTA::TRMT);
+			if (transmitting() && !was_transmitting) {
+				if (m_txreg_full) {
+					m_tx_due = m_clock.cycles();
+					load_tsr();
+				} else {
+					signal("TXIF", true);
+				}
+			} else if (!transmitting() && was_transmitting) {
+				m_clock.cancel("USART::TX");
+				if (m_shifting) signal("TRMT", true);
+				m_shifting = false;
+			}
+		} else if (name == "RCSTA") {
+			static const BYTE status = Flags::RCSTA::OERR | Flags::RCSTA::FERR | Flags::RCSTA::RX9D;
+			bool was_transmitting = transmitting();
+			BYTE old = m_rcsta;
+			m_rcsta = (data[Register::DVALUE::NEW] & ~status) | (m_rcsta & status);
+			if (!(m_rcsta & Flags::RCSTA::CREN)) {          // clearing CREN clears an overrun
+				m_rcsta &= ~Flags::RCSTA::OERR;
+				m_receiving = false;
+				m_clock.cancel("USART::RX");
+			}
+			if ((old ^ m_rcsta) & status)
+				eq.queue_event(new DeviceEvent<USART>(*this, "Receive Status", {m_rcsta}));
+			if (transmitting() && !was_transmitting)
+				signal("TXIF", !m_txreg_full);
+			start_receive(m_clock.cycles());
+		} else if (name == "SPBRG") {
+			m_spbrg = data[Register::DVALUE::NEW];
+		} else if (name == "TXREG") {
+			m_txreg = data[Register::DVALUE::NEW] | ((m_txsta & Flags::TXSTA::TX9D)?0x100:0);
+			m_txreg_full = true;
+			signal("TXIF", false);
+			if (transmitting() && !m_shifting) {
+				m_tx_due = m_clock.cycles();
+				load_tsr();
+			}
+		}
+	}
+
+	void USART::on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "USART::TX") {           // the stop bit has gone
+			if (m_host) m_host->write(m_tsr & 0xff);
+			m_shifting = false;
+			if (m_txreg_full && transmitting())
+				load_tsr();
+			else
+				signal("TRMT", true);
+		} else if (name == "USART::RX") {    // and a byte has arrived
+			BYTE b;
+			m_receiving = false;
+			if (receiving() && m_host && m_host->read(b)) {
+				if (m_fifo.size() < 2) {
+					m_fifo.push_back(b);
+					signal("RCIF", true);
+				} else {                     // lost it; the receiver stops until CREN is cleared
+					m_rcsta |= Flags::RCSTA::OERR;
+					eq.queue_event(new DeviceEvent<USART>(*this, "Receive Status", {m_rcsta}));
+				}
+				start_receive(m_rx_due);
+			}
+		}
+	}
+
+	void USART::usart_changed(USART *u, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "Host Data") start_receive(m_clock.cycles());
+	}
+
+	void USART::attach(HostStream *a_host) {
+		m_host = a_host;
+		if (m_host) m_host->on_input([this]() {      // called from the host I/O thread
+			eq.queue_event(new DeviceEvent<USART>(*this, "Host Data"));
+		});
+	}
+
+	void USART::reset() {
+		m_txsta = Flags::TXSTA::TRMT;
+		m_rcsta = 0;
+		m_spbrg = 0;
+		m_txreg_full = false;
+		m_txreg = 0;
+		m_shifting = false;
+		m_tsr = 0;
+		m_tx_due = 0;
+		m_fifo.clear();
+		m_rcreg = 0;
+		m_receiving = false;
+		m_rx_due = 0;
+		m_clock.cancel("USART::TX");
+		m_clock.cancel("USART::RX");
+	}
+
+	USART::USART(Clock &a_clock): Device("USART"), m_clock(a_clock) {
+		reset();
+		DeviceEvent<Register>::subscribe<USART>(this, &USART::register_changed);
+		DeviceEvent<Clock>::subscribe<USART>(this, &USART::on_clock, &m_clock);
+		DeviceEvent<USART>::subscribe<USART>(this, &USART::usart_changed, this);
+	}
+
+	USART::~USART() {
+		if (m_host) m_host->on_input(NULL);
+		DeviceEvent<Register>::unsubscribe<USART>(this, &USART::register_changed);
+		DeviceEvent<Clock>::unsubscribe<USART>(this, &USART::on_clock, &m_clock);
+		DeviceEvent<USART>::unsubscribe<USART>(this, &USART::usart_changed, this);
+	}
+
+//_______________________________________________________________________________________________
+// WDT
+	void WDT::schedule() {
+		if (m_enabled)
+			m_clock.alarm("WDT", due());
+		else
+			m_clock.cancel("WDT");
+	}
+
+	void WDT::register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "CONFIG1") {
+			m_enabled = data[Register::DVALUE::NEW] & Flags::CONFIG::WDTE;
+			clear();
+		} else if (name == "OPTION") {    // a new prescaler applies from the last clear
+			m_option = data[Register::DVALUE::NEW];
+			schedule();
+		}
+	}
+
+	void WDT::on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "WDT") {
+			m_start = m_clock.time();
+			schedule();
+			eq.queue_event(new DeviceEvent<WDT>(*this, "Timeout"));
+		}
+	}
+
+	void WDT::reset() {
+		m_option = 0xff;
+		clear();
+	}
+
+	void WDT::clear() {
+		m_start = m_clock.time();
+		schedule();
+	}
+
+	void WDT::sleep() {
+		clear();
+	}
+
+	WDT::WDT(Clock &a_clock): Device("WDT"), m_clock(a_clock), m_enabled(false), m_option(0xff), m_start(0) {
+		DeviceEvent<Register>::subscribe<WDT>(this, &WDT::register_changed);
+		DeviceEvent<Clock>::subscribe<WDT>(this, &WDT::on_clock, &m_clock);
+	}
+
+	WDT::~WDT() {
+		DeviceEvent<Register>::unsubscribe<WDT>(this, &WDT::register_changed);
+		DeviceEvent<Clock>::unsubscribe<WDT>(this, &WDT::on_clock, &m_clock);
+	}
+
 //_______________________________________________________________________________________________
 // Comparator
 	void Comparator::queue_change(BYTE old_cmcon) {
@@ -243,10 +717,46 @@ template <class T> class
 
 		if (c1_vin == c1_ref) c1.set_value(0, true); else c1.set_value(c1_compare*Vdd, mode()==6);
 		if (c2_vin == c2_ref) c2.set_value(0, true); else c2.set_value(c2_compare*Vdd, mode()==6);
+		watch();
 
 //		std::cout << (c1_compare?"c1=true":"c1=false") << "  " << (c2_compare?"c2=true":"c2=false") << std::endl;
 	}
 
+	//  Analog inputs are only exchanged with the digital domain every Transient::period()
+	// cycles, unless a watched voltage is heading for a crossing.  Each pin in use is
+	// watched at the voltage on the other side of its comparator, so that an output changes
+	// when the input crosses, and not up to a period later.  The levels follow every change
+	// in CMCON, in VREF (from VRCON), and in the inputs themselves.
+	void Comparator::watch() {
+		const int VREF = 4, OFF = -1;
+		int c1_ref = 0, c1_vin = 3, c2_ref = 1, c2_vin = 2;
+		bool cis = cmcon & Flags::CMCON::CIS;
+
+		switch (mode()) {
+		case 1:  c1_ref = cis ? 3 : 0; c1_vin = 2; break;
+		case 2:  c1_ref = cis ? 3 : 0; c2_ref = cis ? 2 : 1; c1_vin = c2_vin = VREF; break;
+		case 3:
+		case 6:  c1_vin = 2; break;
+		case 4:  break;
+		case 5:  c1_vin = c1_ref = OFF; break;
+		default: c1_vin = c1_ref = c2_vin = c2_ref = OFF;   // reset or off
+		}
+		auto level = [this, VREF](int n) { return n == VREF ? vref : inputs[n]; };
+
+		std::vector<std::pair<Connection *, double> > wanted;
+		for (auto pair: {std::make_pair(c1_vin, c1_ref), std::make_pair(c2_vin, c2_ref)}) {
+			if (pair.first == OFF) continue;
+			if (pair.first != VREF && pins[pair.first])
+				wanted.push_back({pins[pair.first], level(pair.second)});
+			if (pair.second != VREF && pins[pair.second])
+				wanted.push_back({pins[pair.second], level(pair.first)});
+		}
+		if (wanted == watched) return;
+		for (auto &w: watched) Transient::unwatch(*w.first, w.second);
+		watched = wanted;
+		for (auto &w: watched) Transient::watch(*w.first, w.second);
+	}
+
 	void Comparator::on_register_change(Register *r, const std::string &name, const std::vector<BYTE> &data) {
 		if (name=="CMCON"){   // We will be changing CMCON::C1OUT and CMCON::C2OUT in recalc()
 			BYTE old_cmcon = cmcon;
@@ -258,13 +768,13 @@ template <class T> class
 
 	void Comparator::on_connection_change(Connection *c, const std::string &name, const std::vector<BYTE> &data) {
 		if        (c->name() == "RA0::Comparator") {
-			inputs[0] = c->rd(); recalc();
+			pins[0] = c; inputs[0] = c->rd(); recalc();
 		} else if (c->name() == "RA1::Comparator") {
-			inputs[1] = c->rd(); recalc();
+			pins[1] = c; inputs[1] = c->rd(); recalc();
 		} else if (c->name() == "RA2::Comparator") {
-			inputs[2] = c->rd(); recalc();
+			pins[2] = c; inputs[2] = c->rd(); recalc();
 		} else if (c->name() == "RA3::Comparator") {
-			inputs[3] = c->rd(); recalc();
+			pins[3] = c; inputs[3] = c->rd(); recalc();
 		} else if (c->name() == "VREF") {
 			vref = c->rd(); recalc();
 		} else if (std::string(":Comparator1:Comparator2:").find(c->name()) != std::string::npos){
@@ -295,6 +805,7 @@ template <class T> class
 	}
 
 	Comparator::~Comparator()  {
+		for (auto &w: watched) Transient::unwatch(*w.first, w.second);
 		DeviceEvent<Connection>::unsubscribe<Comparator>(this, &Comparator::on_connection_change);
 		DeviceEvent<Register>::unsubscribe<Comparator>(this, &Comparator::on_register_change);
 	}
@@ -315,7 +826,7 @@ void EEPROM::load(const std::string &a_file) {
 void Clock::stop() { stopped=true; phase=0; high=false;}
 void Clock::start() { stopped=false; }
 void Clock::toggle() {
-	if (stopped) return;
+	if (stopped || m_asleep) return;
 	high = !high;
 	if (high) {
 		phase = phase % 4; ++phase;
@@ -336,7 +847,116 @@ void Clock::toggle() {
 
 	if (high && Q1) {
 		eq.queue_event(new DeviceEvent<Clock>(*this, "cycle"));
+		++m_cycles;
+		fire_deadlines();
+	}
+}
+
+void Clock::Timeline::add(const std::string &a_name, Cycle a_when) {
+	m_deadlines[a_name] = a_when;
+	m_order.insert({a_when, a_name});
+}
+
+bool Clock::Timeline::remove(const std::string &a_name) {
+	auto d = m_deadlines.find(a_name);
+	if (d == m_deadlines.end()) return false;
+	auto range = m_order.equal_range(d->second);
+	for (auto t = range.first; t != range.second; ++t) {
+		if (t->second == a_name) {
+			m_order.erase(t);
+			break;
+		}
 	}
+	m_deadlines.erase(d);
+	return true;
+}
+
+bool Clock::Timeline::next(Cycle &a_when) const {
+	if (m_order.empty()) return false;
+	a_when = m_order.begin()->first;
+	return true;
+}
+
+void Clock::Timeline::fire(Clock &a_clock, Cycle a_now) {    // queue an event for every deadline we have reached
+	DeviceEventQueue eq;
+	while (m_order.size() && m_order.begin()->first <= a_now) {
+		std::string name = m_order.begin()->second;
+		m_order.erase(m_order.begin());
+		m_deadlines.erase(name);
+		eq.queue_event(new DeviceEvent<Clock>(a_clock, name));
+	}
+}
+
+void Clock::fire_deadlines() {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_deadlines.fire(*this, m_cycles);
+	m_alarms.fire(*this, time());
+}
+
+void Clock::unschedule(const std::string &a_name) {   // caller holds the lock
+	if (!m_deadlines.remove(a_name))
+		m_alarms.remove(a_name);
+}
+
+void Clock::schedule(const std::string &a_name, Cycle a_when) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	unschedule(a_name);
+	m_deadlines.add(a_name, a_when);
+}
+
+void Clock::alarm(const std::string &a_name, Cycle a_time) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	unschedule(a_name);
+	m_alarms.add(a_name, a_time);
+}
+
+void Clock::cancel(const std::string &a_name) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	unschedule(a_name);
+}
+
+bool Clock::scheduled(const std::string &a_name) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_deadlines.contains(a_name) || m_alarms.contains(a_name);
+}
+
+void Clock::sleep() { m_asleep = true; }
+void Clock::wake() { m_asleep = false; }
+
+bool Clock::next_alarm(Cycle &a_time) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_alarms.next(a_time);
+}
+
+bool Clock::next_deadline(Cycle &a_cycle) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	Cycle when;
+	bool found = m_deadlines.next(a_cycle);
+	if (m_alarms.next(when) && (!found || when - m_slept < a_cycle)) {
+		a_cycle = when - m_slept;
+		found = true;
+	}
+	return found;
+}
+
+Clock::Cycle Clock::skip(Cycle a_cycle) {    // the clock thread may count a cycle while we do this
+	Cycle now = m_cycles;
+	while (now + 1 < a_cycle) {
+		if (m_cycles.compare_exchange_weak(now, a_cycle - 1))
+			return a_cycle - 1 - now;
+	}
+	return 0;
+}
+
+bool Clock::jump(Cycle a_from, Cycle a_to) {     // all or nothing, unlike skip()
+	return m_cycles.compare_exchange_strong(a_from, a_to);
+}
+
+void Clock::advance(Cycle a_time) {     // the oscillator is stopped, so only alarms can fire
+	if (!m_asleep || a_time <= time()) return;
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_slept += a_time - time();
+	m_alarms.fire(*this, time());
 }
 
 
@@ -346,6 +966,7 @@ void Flash::load(const std::string &a_file) {
 	clear();
 	int fd = open(a_file.c_str(), O_RDONLY);
 	int c = read(fd, data, sizeof(data));
+	++m_version;
 	if (c < 0)
 		throw(std::string("Cannot read flash data from file: ") + a_file);
 }
@@ -4,6 +4,7 @@
 #include "sram.h"
 #include "flags.h"
 #include "../utils/utility.h"
+#include "../utils/host_stream.h"
 #include "register.h"
 #include "clock.h"
 #include "comparator.h"
@@ -14,26 +15,138 @@ class VREF: public Device {
 
 };
 
+class PORTB;
+
+//___________________________________________________________________________________
+//  The Capture/Compare/PWM module.
+//   Capture latches TMR1 into CCPR1 on edges seen on RB3.  Compare and PWM work out the
+// cycle at which their next output edge falls due, and schedule it on the clock, so
+// that RB3 hears from us only when the output level actually changes.
 class CCP1: public Device {
+	Clock  &m_clock;
+	Timer1 &m_tmr1;
+	Timer2 &m_tmr2;
+	DeviceEventQueue eq;
 
+	BYTE m_ccp1con;
+	WORD m_ccpr1;        // CCPR1H:CCPR1L
+	BYTE m_t1con;
+	WORD m_duty;         // PWM duty cycle latched at the start of the current period
+	BYTE m_edges;        // capture prescaler count
+	bool m_input;        // last level seen on RB3
+	bool m_matched;      // compare match already signalled for this TMR1 value
+	bool m_output;       // level we are driving onto RB3
+
+	WORD timer1();
+	WORD timer1_prescale() const;
+	void drive(bool a_level);
+	void compare_match();
+	void compare_check();
+	void period_start();
+	void capture_edge(bool a_level);
+
+	void register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data);
+	void on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data);
+	void timer1_changed(Timer1 *t, const std::string &name, const std::vector<BYTE> &data);
+	void timer2_changed(Timer2 *t, const std::string &name, const std::vector<BYTE> &data);
+	void portB_changed(PORTB *p, const std::string &name, const std::vector<BYTE> &data);
+
+  public:
+	CCP1(Clock &a_clock, Timer1 &a_tmr1, Timer2 &a_tmr2);
+	~CCP1();
+
+	void reset();
+	BYTE mode() const { return m_ccp1con & 0x0f; }
+	bool capture() const { return mode() >= 0b0100 && mode() < 0b1000; }
+	bool compare() const { return mode() >= 0b1000 && mode() < 0b1100; }
+	bool pwm() const { return mode() >= 0b1100; }
+	bool drives_pin() const { return mode() == 0b1000 || mode() == 0b1001 || pwm(); }
+	WORD pwm_duty() const { return ((m_ccpr1 & 0xff) << 2) | ((m_ccp1con >> 4) & 0x03); }
+	bool output() const { return m_output; }
 };
 
+//___________________________________________________________________________________
+//  The USART in asynchronous mode.
+//   We never shift individual bits.  A byte written to TXREG moves into the transmit
+// shift register, and a deadline is scheduled one frame time later, when the byte is
+// handed to the host and the next one may follow.  Bytes from the host likewise arrive
+// one frame time apart, into a two byte receive FIFO.  A frame is 10 bits, or 11 with
+// the 9th data bit, and a bit takes 16 (BRGH=0) or 4 (BRGH=1) times SPBRG+1 cycles.
+//   Synchronous mode is not modelled.
 class USART: public Device {
+	Clock &m_clock;
+	DeviceEventQueue eq;
+	SmartPtr<HostStream> m_host;
+
+	BYTE m_txsta;
+	BYTE m_rcsta;
+	BYTE m_spbrg;
+
+	bool m_txreg_full;        // TXREG holds a byte waiting for the shift register
+	WORD m_txreg;
+	bool m_shifting;          // a byte is in the transmit shift register
+	WORD m_tsr;
+	Clock::Cycle m_tx_due;    // when the byte in the shift register is gone
 
+	std::deque<WORD> m_fifo;  // received bytes, with RX9D in bit 8
+	BYTE m_rcreg;
+	bool m_receiving;         // a byte is arriving from the host
+	Clock::Cycle m_rx_due;
+
+	bool transmitting() const;
+	bool receiving() const;
+	void load_tsr();
+	void start_receive(Clock::Cycle a_from);
+	void signal(const std::string &a_name, bool a_value);
+
+	void register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data);
+	void on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data);
+	void usart_changed(USART *u, const std::string &name, const std::vector<BYTE> &data);
+
+  public:
+	USART(Clock &a_clock);
+	~USART();
+
+	void reset();
+	void attach(HostStream *a_host);
+	HostStream *host() { return m_host.operator ->(); }
+	Clock::Cycle bit_cycles() const { return (Clock::Cycle)((m_txsta & Flags::TXSTA::BRGH)?4:16) * ((WORD)m_spbrg + 1); }
+	Clock::Cycle frame_cycles(bool a_ninth) const { return bit_cycles() * (a_ninth?11:10); }
+	BYTE receive();           // read RCREG
 };
 
+//___________________________________________________________________________________
+//  The watchdog timer runs from its own RC oscillator, so unlike everything else it
+// keeps running through SLEEP.  Its nominal period is 18ms, which we count as 18000
+// instruction cycles at 4MHz, stretched by the 1:1 to 1:128 prescaler when OPTION.PSA
+// assigns that to the watchdog rather than to Timer0.
+//   The timeout is a single alarm on the clock, which CLRWDT and SLEEP push further
+// out.  When it fires, we signal "Timeout", and the CPU either resets or wakes up.
 class WDT: public Device {
+	Clock &m_clock;
 	DeviceEventQueue eq;
-  public:
-	void wdt_changed(WDT *r, const std::string &name, const std::vector<BYTE> &data) {
-	}
 
-	WDT() {
-		DeviceEvent<WDT>::subscribe<WDT>(this, &WDT::wdt_changed);
-	}
+	bool m_enabled;            // CONFIG WDTE
+	BYTE m_option;
+	Clock::Cycle m_start;      // time at which the watchdog was last cleared
 
-	void clear() { eq.queue_event(new DeviceEvent<WDT>(*this, "clear")); }
-	void sleep() { eq.queue_event(new DeviceEvent<WDT>(*this, "sleep")); }
+	void schedule();
+	void register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data);
+	void on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data);
+
+  public:
+	static const Clock::Cycle period = 18000;
+
+	WDT(Clock &a_clock);
+	~WDT();
+
+	void reset();
+	void clear();             // CLRWDT
+	void sleep();             // SLEEP clears the watchdog too
+	bool enabled() const { return m_enabled; }
+	WORD postscale() const { return (m_option & Flags::OPTION::PSA) ? (1 << (m_option & 0x07)) : 1; }
+	Clock::Cycle timeout() const { return period * postscale(); }
+	Clock::Cycle due() const { return m_start + timeout(); }
 };
 
 
@@ -228,6 +341,17 @@ class PORTB: public Device {
 		}
 	}
 
+	void CCP_in_changed(Connection *c, const std::string &name, const std::vector<BYTE> &data) {
+		eq.queue_event(new DeviceEvent<PORTB>(*this, "PORTB::CCP1", {(BYTE)c->signal()}));
+	}
+
+	void CCP1_changed(CCP1 *c, const std::string &name, const std::vector<BYTE> &data) {
+		if (name == "Output") {
+			PortB_RB3 *rb3 = dynamic_cast<PortB_RB3 *>(RB[3].operator ->());
+			rb3->CCP_Out().set_value(data[0]?Vdd:Vss, false);
+		}
+	}
+
 	void register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data) {
 		if (name=="OPTION"){
 			BYTE changed = data[Register::DVALUE::CHANGED];
@@ -261,9 +385,16 @@ class PORTB: public Device {
 
 		Connection &INT =  dynamic_cast< PortB_RB0 *>(RB[0].operator ->()) -> INT();
 		DeviceEvent<Connection>::subscribe<PORTB>(this, &PORTB::INT_changed, &INT);
+		Connection &CCP_in =  dynamic_cast< PortB_RB3 *>(RB[3].operator ->()) -> CCP_in();
+		DeviceEvent<Connection>::subscribe<PORTB>(this, &PORTB::CCP_in_changed, &CCP_in);
+		DeviceEvent<CCP1>::subscribe<PORTB>(this, &PORTB::CCP1_changed);
 	}
 	~PORTB() {
-
+		Connection &INT =  dynamic_cast< PortB_RB0 *>(RB[0].operator ->()) -> INT();
+		DeviceEvent<Connection>::unsubscribe<PORTB>(this, &PORTB::INT_changed, &INT);
+		Connection &CCP_in =  dynamic_cast< PortB_RB3 *>(RB[3].operator ->()) -> CCP_in();
+		DeviceEvent<Connection>::unsubscribe<PORTB>(this, &PORTB::CCP_in_changed, &CCP_in);
+		DeviceEvent<CCP1>::unsubscribe<PORTB>(this, &PORTB::CCP1_changed);
 	}
 
 	std::vector<BYTE> pin_numbers = {
@@ -286,23 +417,39 @@ class Flash: public Device {
 //	std::vector<WORD>data;
 	DeviceEventQueue eq;
 	WORD m_size = 0;
+	WORD m_mask = 0;      // m_size is a power of two, so addresses wrap by masking
+	unsigned long m_version = 0;
   public:
 	Flash() : Device("FLASH") {}
-	WORD *data = NULL;
+	WORD *data = NULL;    // read freely, but write() it, or reset() once done
 
 	void load(const std::string &a_file);
 
 	WORD fetch(WORD PC) {
-		return data[PC % size()];
+		return data[PC & m_mask];
+	}
+
+	void write(WORD PC, WORD a_opcode) {
+		data[PC & m_mask] = a_opcode;
+		++m_version;
+	}
+
+	// changes each time the flash does, so that what was decoded from it can be dropped
+	unsigned long version() const { return m_version; }
+
+	WORD wrap(WORD PC) const {
+		return PC & m_mask;
 	}
 
 	void clear() {
 		memset(data, 0, m_size * sizeof(WORD));
+		++m_version;
 		eq.queue_event(new DeviceEvent<Flash>(*this, "clear", {}));
 		eq.process_events();
 	}
 
 	void reset() {  // tell everything to reread flash data
+		++m_version;
 		eq.queue_event(new DeviceEvent<Flash>(*this, "reset", {}));
 		eq.process_events();
 	}
@@ -312,14 +459,19 @@ class Flash: public Device {
 	}
 
 	void size(size_t a_size) {
+		if (!a_size || (a_size & (a_size - 1)))
+			throw(std::string("Flash memory size must be a power of two"));
 		m_size = a_size;
+		m_mask = a_size - 1;
 		data = (WORD *)realloc(data, (a_size+1) * sizeof(WORD));
 		if (!data) throw(std::string("An error occured while allocating flash memory"));
+		++m_version;
 	}
 
 	void set_data(WORD address, const std::string &ds) {
 		for(WORD n=0; n<ds.length() && n+address<size(); n += 2)
 			data[(n+address)/2] = (((WORD)ds[n+1]) << 8) | (BYTE)ds[n];
+		++m_version;
 		eq.queue_event(new DeviceEvent<Flash>(*this, "init", {}));
 		eq.process_events();
 	}
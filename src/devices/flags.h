@@ -190,6 +190,17 @@ class Flags {
 		static const BYTE T2CKPS0 = 0b00000001;
 		static const std::vector<std::string> bits;
 	};
+	struct CCP1CON {
+		static const BYTE na1    = 0b10000000;
+		static const BYTE na0    = 0b01000000;
+		static const BYTE CCP1X  = 0b00100000;
+		static const BYTE CCP1Y  = 0b00010000;
+		static const BYTE CCP1M3 = 0b00001000;
+		static const BYTE CCP1M2 = 0b00000100;
+		static const BYTE CCP1M1 = 0b00000010;
+		static const BYTE CCP1M0 = 0b00000001;
+		static const std::vector<std::string> bits;
+	};
 	struct PORTA {
 		static const BYTE RA7 = 0b10000000;
 		static const BYTE RA6 = 0b01000000;
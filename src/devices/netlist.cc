@@ -0,0 +1,628 @@
+/*
+ * netlist.cc
+ *
+ *  A compiled evaluator for a connected group of logic components.
+ */
+#include <deque>
+#include "netlist.h"
+
+//___________________________________________________________________________________
+// The connections each kind of component drives.
+std::vector<Connection *> Netlist::outputs(Device *dev) {
+	if (auto g = dynamic_cast<Gate *>(dev)) return {&g->rd()};
+	if (auto t = dynamic_cast<Tristate *>(dev)) return {&t->rd()};
+	if (auto l = dynamic_cast<Latch *>(dev)) return {&l->Q(), &l->Qc()};
+	if (auto m = dynamic_cast<Mux *>(dev)) return {&m->rd()};
+	if (auto s = dynamic_cast<Schmitt *>(dev)) return {&s->rd()};
+	if (auto c = dynamic_cast<Counter *>(dev)) {
+		std::vector<Connection *> bits;
+		for (size_t n = 0; n < c->nbits(); ++n) bits.push_back(&c->bit(n));
+		return bits;
+	}
+	if (auto i = dynamic_cast<Inverse *>(dev)) return {i};
+	if (auto f = dynamic_cast<FET *>(dev)) return {&f->rd()};
+	if (dynamic_cast<Wire *>(dev) || dynamic_cast<Clamp *>(dev) || dynamic_cast<PullUp *>(dev)) return {};
+	throw(name() + std::string(": cannot compile ") + dev->name());
+}
+
+//___________________________________________________________________________________
+// The signal number for a connection read by a component.  A terminal with only one
+// source is a wire, and carries the same signal as the source, so a chain of them
+// leading back to a component's output is that output.  Anything else is an input.
+size_t Netlist::signal(Connection *c) {
+	if (!c) return npos;
+	auto found = m_number.find(c);
+	if (found != m_number.end()) return found->second;
+
+	Connection *source = c;
+	for (size_t hops = 0; hops < m_signals.size(); ++hops) {
+		auto t = dynamic_cast<Terminal *>(source);
+		if (!t || dynamic_cast<Voltage *>(t) || dynamic_cast<Capacitor *>(t) || dynamic_cast<Inductor *>(t)) break;
+		auto sources = t->sources();
+		if (sources.size() != 1 || !dynamic_cast<Connection *>(sources[0])) break;
+		source = dynamic_cast<Connection *>(sources[0]);
+		found = m_number.find(source);
+		if (found != m_number.end() && found->second < m_outputs)
+			return m_number[c] = found->second;
+	}
+
+	size_t n = m_signals.size();
+	m_signals.push_back(c);
+	m_number[c] = n;
+	m_inputs.push_back(n);
+	return n;
+}
+
+//___________________________________________________________________________________
+// A connection on a wire reads the wire, but what it drives the wire with is an input
+// of its own, such as a pin driven from outside, or the data bus during a write.
+size_t Netlist::source(Connection *c) {
+	auto found = m_source.find(c);
+	if (found != m_source.end()) return found->second;
+	size_t n = m_signals.size();
+	m_signals.push_back(c);
+	m_source[c] = n;
+	m_inputs.push_back(n);
+	return n;
+}
+
+//___________________________________________________________________________________
+// A net is numbered along with the outputs, and everything on it which is not itself
+// an output reads the net.  Wires joined on a net are compiled once, by the first.
+void Netlist::wire(Wire *w) {
+	auto conns = w->terminals();
+	for (auto &net: m_nets)
+		if (net.first->terminals() == conns) return;
+
+	size_t n = m_signals.size();
+	for (auto c: conns) {
+		if (m_number.find(c) != m_number.end()) continue;
+		if (n == m_signals.size()) m_signals.push_back(c);
+		m_number[c] = n;
+	}
+	if (n < m_signals.size()) m_nets[w] = n;
+}
+
+//___________________________________________________________________________________
+// Outputs are already numbered, so here we need only describe the operation.
+void Netlist::add(Device *dev) {
+	Operation op;
+	op.dev = dev;
+	for (auto c: outputs(dev)) op.out.push_back(m_number[c]);
+
+	if (auto g = dynamic_cast<Gate *>(dev)) {
+		op.code = dynamic_cast<AndGate *>(dev) ? AND : dynamic_cast<OrGate *>(dev) ? OR : dynamic_cast<XOrGate *>(dev) ? XOR : BUF;
+		op.invert = g->inverted();
+		for (auto c: g->inputs()) op.in.push_back(signal(c));
+		if (op.in.empty()) return;              // a gate without inputs never changes
+	} else if (auto t = dynamic_cast<Tristate *>(dev)) {
+		op.code = TRI;
+		op.invert = t->inverted();
+		op.invert_enable = t->gate_invert();
+		op.in.push_back(signal(&t->input()));
+		op.enable = signal(&t->gate());
+	} else if (auto l = dynamic_cast<Latch *>(dev)) {
+		op.code = LATCH;
+		op.edge = l->clocked();
+		op.rising = l->positive();
+		op.in.push_back(signal(&l->D()));
+		op.enable = signal(&l->Ck());
+	} else if (auto m = dynamic_cast<Mux *>(dev)) {
+		op.code = MUX;
+		for (size_t n = 0; n < m->no_inputs(); ++n) op.in.push_back(signal(&m->in(n)));
+		for (size_t n = 0; n < m->no_selects(); ++n) op.in.push_back(signal(&m->select(n)));
+		op.selects = m->no_selects();
+	} else if (auto s = dynamic_cast<Schmitt *>(dev)) {
+		op.code = SCHMITT;
+		op.invert = s->out_invert();
+		op.invert_enable = s->gate_invert();
+		op.in.push_back(signal(&s->in()));
+		op.enable = signal(&s->en());
+	} else if (auto c = dynamic_cast<Counter *>(dev)) {
+		op.code = COUNT;
+		op.edge = c->asynch();
+		op.rising = c->rising();
+		op.value = c->get();
+		op.in.push_back(signal(c->get_input()));
+		op.enable = signal(c->get_clock());
+	} else if (auto i = dynamic_cast<Inverse *>(dev)) {
+		op.code = BUF;
+		op.invert = true;
+		op.in.push_back(signal(&i->source()));
+	} else if (auto f = dynamic_cast<FET *>(dev)) {
+		op.code = SWITCH;
+		op.invert_enable = !f->nType();       // a p-type FET conducts with its gate low
+		op.in.push_back(signal(&f->in()));
+		op.enable = signal(&f->gate());
+	} else if (auto w = dynamic_cast<Wire *>(dev)) {
+		auto net = m_nets.find(w);
+		if (net == m_nets.end()) return;
+		op.code = WIRE;
+		op.out.push_back(net->second);
+		for (auto c: w->terminals()) {
+			auto n = m_number.find(c);
+			if (n != m_number.end() && n->second != net->second) {
+				op.in.push_back(n->second);     // a component drives the wire
+			} else {
+				op.in.push_back(source(c));
+				op.readers.push_back(c);
+			}
+		}
+	} else {
+		return;                                 // clamps and pull-ups
+	}
+	m_ops.push_back(op);
+}
+
+//___________________________________________________________________________________
+// Order operations so that each follows everything which feeds it.  Whatever is
+// left over is part of a loop, and goes last, in the order given.
+void Netlist::levelise() {
+	std::map<size_t, size_t> producer;
+	for (size_t i = 0; i < m_ops.size(); ++i)
+		for (auto n: m_ops[i].out) producer[n] = i;
+
+	std::vector<std::vector<size_t> > feeds(m_ops.size());
+	std::vector<size_t> waiting(m_ops.size(), 0);
+	for (size_t i = 0; i < m_ops.size(); ++i) {
+		auto reads = m_ops[i].in;
+		reads.push_back(m_ops[i].enable);
+		for (auto n: reads) {
+			auto p = producer.find(n);
+			if (p == producer.end() || p->second == i) continue;
+			feeds[p->second].push_back(i);
+			++waiting[i];
+		}
+	}
+
+	std::deque<size_t> ready;
+	for (size_t i = 0; i < m_ops.size(); ++i)
+		if (!waiting[i]) ready.push_back(i);
+	std::vector<Operation> ordered;
+	std::vector<bool> placed(m_ops.size(), false);
+	while (ready.size()) {
+		size_t i = ready.front(); ready.pop_front();
+		ordered.push_back(m_ops[i]);
+		placed[i] = true;
+		for (auto j: feeds[i])
+			if (--waiting[j] == 0) ready.push_back(j);
+	}
+	m_feedback = ordered.size() < m_ops.size();
+	for (size_t i = 0; i < m_ops.size(); ++i)
+		if (!placed[i]) ordered.push_back(m_ops[i]);
+	m_ops = ordered;
+}
+
+void Netlist::release() {
+	if (!m_live) return;
+	for (auto n: m_inputs)
+		DeviceEvent<Connection>::unsubscribe<Netlist>(this, &Netlist::on_input, m_signals[n]);
+	for (auto dev: m_devices) dev->compiled(false);
+}
+
+//___________________________________________________________________________________
+void Netlist::compile() {
+	release();
+	m_ops.clear();
+	m_signals.clear();
+	m_number.clear();
+	m_source.clear();
+	m_nets.clear();
+	m_inputs.clear();
+
+	for (auto dev: m_devices)
+		for (auto c: outputs(dev)) {
+			m_number[c] = m_signals.size();
+			m_signals.push_back(c);
+		}
+	for (auto dev: m_devices)
+		if (auto w = dynamic_cast<Wire *>(dev)) wire(w);
+	m_outputs = m_signals.size();
+	for (auto dev: m_devices) add(dev);     // numbers inputs as it finds them
+	for (Bits *b: {&m_level, &m_impeded, &m_observed, &m_changed, &m_outside, &m_derived, &m_weak}) b->resize(m_signals.size());
+	levelise();
+
+	for (auto dev: m_devices) {
+		if (auto l = dynamic_cast<Latch *>(dev))
+			for (auto n: {m_number[&l->Q()], m_number[&l->Qc()]}) m_derived.set(n, dynamic_cast<Inverse *>(m_signals[n]));
+		if (auto c = dynamic_cast<Counter *>(dev))
+			for (size_t n = 0; n < c->nbits(); ++n) m_derived.set(m_number[&c->bit(n)], true);
+		if (auto i = dynamic_cast<Inverse *>(dev))   // follows its source by itself
+			m_derived.set(m_number[i], true);
+	}
+	for (size_t n = 0; n < m_signals.size(); ++n) {
+		m_level.set(n, m_signals[n]->signal());
+		m_impeded.set(n, m_signals[n]->impeded());
+	}
+	for (auto n: m_inputs) {
+		m_outside.set(n, true);
+		m_weak.set(n, dynamic_cast<PullUp *>(m_signals[n]));
+	}
+	for (auto &op: m_ops) {
+		if (op.code == SWITCH) m_weak.set(op.out[0], m_weak[op.in[0]]);
+		if (op.code == WIRE) m_derived.set(op.out[0], true);   // written to the readers
+	}
+	for (auto &op: m_ops) {
+		if (op.enable != npos) op.last_ck = m_level[op.enable];
+		if (op.in.size() && op.in[0] != npos) op.last_in = m_level[op.in[0]];
+		if (op.code == COUNT && op.enable != npos) op.pending = op.last_in;   // what the clock would take now
+	}
+	for (auto c: m_probes) {
+		auto found = m_number.find(c);
+		if (found != m_number.end()) m_observed.set(found->second, true);
+	}
+
+	if (!m_live) return;
+	for (auto n: m_inputs)
+		DeviceEvent<Connection>::subscribe<Netlist>(this, &Netlist::on_input, m_signals[n]);
+	for (auto dev: m_devices) dev->compiled(true);
+}
+
+//___________________________________________________________________________________
+void Netlist::set(size_t n, bool level, bool impeded) {
+	if (m_level[n] == level && m_impeded[n] == impeded) return;
+	m_level.set(n, level);
+	m_impeded.set(n, impeded);
+	m_changed.set(n, true);
+}
+
+//___________________________________________________________________________________
+// Evaluate one operation, as its component would on an input event.
+bool Netlist::step(Operation &op) {
+	auto bit = [&](size_t n) { return n != npos && m_level[n]; };
+	size_t out = op.out[0];
+	bool was = m_level[out], was_impeded = m_impeded[out];
+
+	switch (op.code) {
+	case BUF:
+		set(out, op.invert ^ bit(op.in[0]));
+		break;
+	case AND: case OR: case XOR: {
+		bool sig = bit(op.in[0]);
+		for (size_t i = 1; i < op.in.size(); ++i) {
+			if (op.in[i] == npos) continue;
+			if (op.code == AND) sig = sig && m_level[op.in[i]];
+			else if (op.code == OR) sig = sig || m_level[op.in[i]];
+			else sig = sig ^ m_level[op.in[i]];
+		}
+		set(out, op.invert ^ sig);
+		break;
+	}
+	case TRI: {
+		bool impeded = op.enable != npos ? !m_level[op.enable] : false;
+		if (op.invert_enable) impeded = !impeded;
+		set(out, !impeded && (op.invert ^ bit(op.in[0])), impeded);
+		break;
+	}
+	case LATCH: {
+		bool ck = bit(op.enable), clocked = ck != op.last_ck;
+		op.last_ck = ck;
+		if (ck == op.rising && (clocked || !op.edge)) {
+			set(out, bit(op.in[0]));
+			set(op.out[1], !bit(op.in[0]));
+		}
+		break;
+	}
+	case MUX: {
+		size_t idx = 0, inputs = op.in.size() - op.selects;
+		for (size_t n = op.selects; n > 0; --n) idx = (idx << 1) | bit(op.in[inputs + n - 1]);
+		if (idx >= inputs) throw(op.dev->name() + std::string(": Multiplexer index beyond input bounds"));
+		set(out, bit(op.in[idx]));
+		break;
+	}
+	case SCHMITT: {
+		bool enabled = op.enable != npos && (op.invert_enable ^ m_level[op.enable]);
+		if (!enabled) {
+			set(out, false, true);
+			break;
+		}
+		size_t in = op.in[0];
+		if (in == npos) break;
+		double Vin = m_outside[in] ? m_signals[in]->rd() : m_level[in] * Vdd;   // hysteresis needs the voltage
+		if (Vin > Vdd / 10.0 * 6 || Vin < Vdd / 10.0 * 4)
+			set(out, op.invert ^ (Vin > Vdd / 2.0));
+		break;
+	}
+	case COUNT: {
+		bool in = bit(op.in[0]), ck = bit(op.enable);
+		bool changed = in != op.last_in, clocked = ck != op.last_ck;
+		op.last_in = in;
+		op.last_ck = ck;
+		unsigned long value = op.value;
+		if (op.enable == npos) {
+			if (changed && (op.edge || in == op.rising)) ++value;
+		} else {
+			if (changed) op.pending = in;
+			if (clocked && ck == op.rising) {
+				value += op.pending;
+				op.pending = false;
+			}
+		}
+		op.overflow = value & (1UL << op.out.size());
+		if (op.overflow) value = 0;
+		if (value == op.value) return false;
+		op.value = value;
+		for (size_t n = 0; n < op.out.size(); ++n) set(op.out[n], (value >> n) & 1);
+		return true;
+	}
+	case SWITCH:
+		set(out, bit(op.in[0]), !(op.invert_enable ^ bit(op.enable)));
+		break;
+	case WIRE: {
+		bool high = false, low = false, weak_high = false, weak_low = false;
+		for (auto n: op.in) {
+			if (m_impeded[n]) continue;
+			if (m_weak[n]) (m_level[n] ? weak_high : weak_low) = true;
+			else (m_level[n] ? high : low) = true;
+		}
+		bool driven = high || low, pulled = weak_high || weak_low;
+		set(out, driven ? high && !low : weak_high && !weak_low, !driven && !pulled);
+		break;
+	}
+	}
+	return m_level[out] != was || m_impeded[out] != was_impeded;
+}
+
+//___________________________________________________________________________________
+// The same, for each lane of a batch.  A counter's bits ripple their carry, so a lane
+// which overflows wraps to zero.
+bool Netlist::step(size_t a_op, Batch &b) const {
+	const Operation &op = m_ops[a_op];
+	const Lanes all = ~Lanes(0), invert = op.invert ? all : 0;
+	auto word = [&](size_t n) { return n == npos ? Lanes(0) : b.level[n]; };
+	size_t out = op.out[0];
+	Lanes was = b.level[out], was_impeded = b.impeded[out];
+
+	switch (op.code) {
+	case BUF:
+		b.level[out] = invert ^ word(op.in[0]);
+		break;
+	case AND: case OR: case XOR: {
+		Lanes sig = word(op.in[0]);
+		for (size_t i = 1; i < op.in.size(); ++i) {
+			if (op.in[i] == npos) continue;
+			if (op.code == AND) sig &= b.level[op.in[i]];
+			else if (op.code == OR) sig |= b.level[op.in[i]];
+			else sig ^= b.level[op.in[i]];
+		}
+		b.level[out] = invert ^ sig;
+		break;
+	}
+	case TRI: {
+		Lanes impeded = op.enable != npos ? ~b.level[op.enable] : 0;
+		if (op.invert_enable) impeded = ~impeded;
+		b.level[out] = ~impeded & (invert ^ word(op.in[0]));
+		b.impeded[out] = impeded;
+		break;
+	}
+	case LATCH: {
+		Lanes ck = word(op.enable), clocked = ck ^ b.last_ck[a_op];
+		b.last_ck[a_op] = ck;
+		Lanes load = (op.rising ? ck : ~ck) & (op.edge ? clocked : all);
+		Lanes d = word(op.in[0]);
+		b.level[out] = (b.level[out] & ~load) | (d & load);
+		b.level[op.out[1]] = (b.level[op.out[1]] & ~load) | (~d & load);
+		break;
+	}
+	case MUX: {
+		size_t inputs = op.in.size() - op.selects;
+		Lanes value = 0, covered = 0;
+		for (size_t idx = 0; idx < inputs; ++idx) {
+			Lanes chosen = all;
+			for (size_t n = 0; n < op.selects; ++n)
+				chosen &= (idx >> n) & 1 ? word(op.in[inputs + n]) : ~word(op.in[inputs + n]);
+			value |= chosen & word(op.in[idx]);
+			covered |= chosen;
+		}
+		if (~covered) throw(op.dev->name() + std::string(": Multiplexer index beyond input bounds"));
+		b.level[out] = value;
+		break;
+	}
+	case SCHMITT: {                 // levels in a batch are never between the thresholds
+		Lanes enabled = op.enable == npos ? 0 : op.invert_enable ? ~b.level[op.enable] : b.level[op.enable];
+		if (op.in[0] == npos) {
+			b.level[out] &= enabled;
+			b.impeded[out] |= ~enabled;
+		} else {
+			b.level[out] = enabled & (invert ^ b.level[op.in[0]]);
+			b.impeded[out] = ~enabled;
+		}
+		break;
+	}
+	case COUNT: {
+		Lanes in = word(op.in[0]), ck = word(op.enable);
+		Lanes changed = in ^ b.last_in[a_op], clocked = ck ^ b.last_ck[a_op];
+		b.last_in[a_op] = in;
+		b.last_ck[a_op] = ck;
+		Lanes carry;
+		if (op.enable == npos) {
+			carry = changed & (op.edge ? all : op.rising ? in : ~in);
+		} else {
+			b.pending[a_op] = (b.pending[a_op] & ~changed) | (in & changed);
+			Lanes fire = clocked & (op.rising ? ck : ~ck);
+			carry = fire & b.pending[a_op];
+			b.pending[a_op] &= ~fire;
+		}
+		if (!carry) return false;
+		for (auto n: op.out) {
+			Lanes q = b.level[n];
+			b.level[n] = q ^ carry;
+			carry &= q;
+		}
+		return true;
+	}
+	case SWITCH:
+		b.level[out] = word(op.in[0]);
+		b.impeded[out] = ~((op.invert_enable ? all : 0) ^ word(op.enable));
+		break;
+	case WIRE: {
+		Lanes high = 0, low = 0, weak_high = 0, weak_low = 0;
+		for (auto n: op.in) {
+			Lanes driving = ~b.impeded[n];
+			(m_weak[n] ? weak_high : high) |= driving & b.level[n];
+			(m_weak[n] ? weak_low : low) |= driving & ~b.level[n];
+		}
+		Lanes driven = high | low, pulled = weak_high | weak_low;
+		b.level[out] = (driven & high & ~low) | (~driven & weak_high & ~weak_low);
+		b.impeded[out] = ~(driven | pulled);
+		break;
+	}
+	}
+	return b.level[out] != was || b.impeded[out] != was_impeded;
+}
+
+size_t Netlist::number(Connection *c, bool input) const {
+	auto driven = m_source.find(c);
+	if (input && driven != m_source.end()) return driven->second;
+	auto found = m_number.find(c);
+	if (found == m_number.end() || (input && !m_outside[found->second]))
+		throw(name() + ": " + c->name() + (input ? " is not an input" : " is not a signal"));
+	return found->second;
+}
+
+std::vector<std::vector<Netlist::Sample> > Netlist::batch(const std::vector<Connection *> &a_inputs,
+		const std::vector<std::vector<Lanes> > &a_steps, const std::vector<Connection *> &a_outputs) const {
+	std::vector<std::vector<Sample> > steps;
+	for (auto &levels: a_steps) {
+		steps.push_back({});
+		for (auto level: levels) steps.back().push_back(Sample{level, 0});
+	}
+	return batch(a_inputs, steps, a_outputs);
+}
+
+std::vector<std::vector<Netlist::Sample> > Netlist::batch(const std::vector<Connection *> &a_inputs,
+		const std::vector<std::vector<Sample> > &a_steps, const std::vector<Connection *> &a_outputs) const {
+	const Lanes all = ~Lanes(0);
+	std::vector<size_t> inputs, outputs;
+	for (auto c: a_inputs) inputs.push_back(number(c, true));
+	for (auto c: a_outputs) outputs.push_back(number(c, false));
+
+	Batch b;
+	for (size_t n = 0; n < m_signals.size(); ++n) {
+		b.level.push_back(m_level[n] ? all : 0);
+		b.impeded.push_back(m_impeded[n] ? all : 0);
+	}
+	for (auto &op: m_ops) {
+		b.last_in.push_back(op.last_in ? all : 0);
+		b.last_ck.push_back(op.last_ck ? all : 0);
+		b.pending.push_back(op.pending ? all : 0);
+	}
+
+	std::vector<std::vector<Sample> > result;
+	for (auto &levels: a_steps) {
+		for (size_t i = 0; i < inputs.size() && i < levels.size(); ++i) {
+			b.level[inputs[i]] = levels[i].level;
+			b.impeded[inputs[i]] = levels[i].impeded;
+		}
+		size_t passes = 0;
+		bool changed;
+		do {
+			changed = false;
+			for (size_t i = 0; i < m_ops.size(); ++i) changed = step(i, b) || changed;
+		} while (m_feedback && changed && ++passes <= m_ops.size());
+
+		result.push_back({});
+		for (auto n: outputs) result.back().push_back(Sample{b.level[n], b.impeded[n]});
+	}
+	return result;
+}
+
+std::vector<Netlist::Trace> Netlist::simulate(const std::vector<Connection *> &a_inputs,
+		const std::vector<Stimulus> &a_scenarios, const std::vector<Connection *> &a_outputs) const {
+	std::vector<Trace> traces;
+	if (a_scenarios.empty()) return traces;
+	size_t steps = a_scenarios[0].size();
+	for (auto &scenario: a_scenarios)
+		if (scenario.size() != steps) throw(name() + std::string(": scenarios differ in length"));
+
+	for (size_t first = 0; first < a_scenarios.size(); first += lanes) {
+		size_t count = std::min(lanes, a_scenarios.size() - first);
+		std::vector<std::vector<Lanes> > words(steps, std::vector<Lanes>(a_inputs.size(), 0));
+		for (size_t lane = 0; lane < count; ++lane)
+			for (size_t n = 0; n < steps; ++n)
+				for (size_t i = 0; i < a_inputs.size() && i < a_scenarios[first + lane][n].size(); ++i)
+					words[n][i] |= Lanes(a_scenarios[first + lane][n][i]) << lane;
+
+		auto samples = batch(a_inputs, words, a_outputs);
+		for (size_t lane = 0; lane < count; ++lane) {
+			Trace trace(steps, std::vector<bool>(a_outputs.size()));
+			for (size_t n = 0; n < steps; ++n)
+				for (size_t o = 0; o < a_outputs.size(); ++o)
+					trace[n][o] = (samples[n][o].level >> lane) & 1;
+			traces.push_back(trace);
+		}
+	}
+	return traces;
+}
+
+//___________________________________________________________________________________
+// Only observed signals go back to their connections.  A counter sets its own bits,
+// and the complement of a latch follows its output.
+void Netlist::write_back() {
+	for (size_t n = 0; n < m_signals.size(); ++n) {
+		if (!m_changed[n] || !m_observed[n] || m_derived[n] || m_outside[n]) continue;
+		m_signals[n]->set_value(m_level[n] * Vdd, m_impeded[n]);
+	}
+	for (auto &op: m_ops) {
+		if (op.code != COUNT) continue;
+		auto counter = dynamic_cast<Counter *>(op.dev);
+		if (counter->get() == op.value) continue;
+		counter->overflow(op.overflow);
+		counter->set_value(op.value);
+	}
+	for (auto &op: m_ops) {                      // a wire sets those of its connections not driving it
+		if (op.code != WIRE || !m_changed[op.out[0]] || !m_observed[op.out[0]]) continue;
+		for (auto c: op.readers)
+			if (c->impeded()) c->set_value(m_level[op.out[0]] * Vdd, true);
+	}
+	m_changed.clear();
+}
+
+void Netlist::on_input(Connection *c, const std::string &name, const std::vector<BYTE> &data) {
+	evaluate();
+}
+
+//___________________________________________________________________________________
+void Netlist::evaluate() {
+	for (auto n: m_inputs) set(n, m_signals[n]->signal(), m_signals[n]->impeded());
+	size_t passes = 0;
+	bool changed;
+	do {
+		changed = false;
+		for (auto &op: m_ops) changed = step(op) || changed;
+	} while (m_feedback && changed && ++passes <= m_ops.size());
+	write_back();
+}
+
+void Netlist::reload() {
+	for (auto &op: m_ops) {
+		if (op.code != COUNT) continue;
+		op.value = dynamic_cast<Counter *>(op.dev)->get();
+		for (size_t n = 0; n < op.out.size(); ++n) m_level.set(op.out[n], (op.value >> n) & 1);
+	}
+}
+
+void Netlist::observe(Connection &c) {
+	m_probes.push_back(&c);
+	auto found = m_number.find(&c);
+	if (found == m_number.end()) return;
+	m_observed.set(found->second, true);
+	for (auto dev: m_devices)                    // the complement of a latch is written through its output
+		if (auto l = dynamic_cast<Latch *>(dev))
+			if (&c == &l->Qc()) observe(l->Q());
+}
+
+bool Netlist::signal(Connection &c) {
+	auto found = m_number.find(&c);
+	if (found == m_number.end()) return c.signal();
+	return m_level[found->second];
+}
+
+Netlist::Netlist(const std::vector<Device *> &a_devices, const std::string &a_name, bool a_live):
+	Device(a_name), m_devices(a_devices), m_live(a_live) {
+	compile();
+}
+
+Netlist::~Netlist() {
+	release();
+}
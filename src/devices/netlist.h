@@ -0,0 +1,156 @@
+/*
+ * netlist.h
+ *
+ *  A compiled evaluator for a connected group of logic components.
+ */
+#pragma once
+#include <map>
+#include <vector>
+#include <cstdint>
+#include "device_base.h"
+
+//___________________________________________________________________________________
+//  Gates, tristate buffers, latches, multiplexers, Schmitt triggers and counters each
+// react to their own input events, and each change to an output queues more events
+// for whatever it feeds.  A Netlist takes a connected group of such components, and
+// compiles them into a flat list of operations over numbered signals, ordered so that
+// each operation comes after everything which feeds it.  The level of each signal,
+// and whether it is impeded, are kept as packed bits.
+//  The analog edge of a port pin has stand-ins of its own.  A wire becomes one signal,
+// resolved from whatever drives it: any driver overrides a weak one, drivers which
+// disagree read low, as their average would, and a wire nobody drives is impeded.  A
+// pull-up is a weak high, and so is a FET switching one.  An Inverse follows its source,
+// and a clamp changes nothing at logic levels.  Relays, comparators and other analog
+// components are not compiled, and compile() throws when given one.  So the PORTB pin
+// models compile, which lets BasicPortB::sweep() run them, but the analog PORTA pins
+// behind CMCON do not.
+//  Connections which feed the group from outside are its inputs, and the netlist
+// subscribes to those instead of the components themselves, which it marks compiled()
+// so that they ignore their own events.  One change to an input evaluates the whole
+// group in a single pass, or if the group has feedback, in as many passes as it takes
+// to settle.
+//  Only signals which are observed, such as pins, SFR bits or probes, are written back
+// to their connections.  Other outputs hold whatever they held when compiled, except
+// that counters set their own bits, and reload() reads counters again after they are
+// set from outside, as Timer1 does when TMR1 is written.  A wire
+// between components, being a terminal with a single source, is the same signal as
+// that source.  A group is compiled once, and must be compiled again if any of its
+// components are rewired.  A netlist which is not live neither subscribes to its
+// inputs nor marks its components compiled, and serves only for batches.
+//  The same operations may also be applied bitwise to whole words, with each bit of a
+// word a separate lane, so that a batch() runs 64 independent scenarios at once.  Each
+// lane starts from the present state of the group, and the group itself is unchanged.
+class Netlist: public Device {
+  public:
+	typedef uint64_t Lanes;                     // one bit for each scenario
+	static const size_t lanes = 64;
+
+	struct Sample {
+		Lanes level;
+		Lanes impeded;
+	};
+	typedef std::vector<std::vector<bool> > Stimulus;  // by step, a level for each input
+	typedef std::vector<std::vector<bool> > Trace;     // by step, the level of each output
+
+  private:
+	enum Code { BUF, AND, OR, XOR, TRI, LATCH, MUX, SCHMITT, COUNT, SWITCH, WIRE };
+
+	struct Operation {
+		Code code;
+		Device *dev;
+		bool invert = false;            // the output
+		bool invert_enable = false;
+		std::vector<size_t> in;         // data inputs; MUX selects follow its inputs, WIRE drivers
+		size_t selects = 0;
+		size_t enable = npos;           // TRI, SCHMITT and SWITCH enable, LATCH clock, COUNT clock
+		std::vector<size_t> out;        // one output, or for COUNT, each bit
+		bool edge = false;              // LATCH edge triggered, COUNT ripples on every change
+		bool rising = true;             // the active level of a LATCH or COUNT clock
+		bool last_in = false;           // COUNT
+		bool last_ck = false;           // LATCH and COUNT
+		bool pending = true;            // COUNT, an input waiting for the clock
+		unsigned long value = 0;        // COUNT
+		bool overflow = false;          // COUNT, carried out of the top bit
+		std::vector<Connection *> readers;   // WIRE, the connections it sets
+	};
+
+	class Bits {
+		std::vector<uint64_t> m_words;
+	  public:
+		void resize(size_t n) { m_words.assign((n + 63) / 64, 0); }
+		bool operator[](size_t n) const { return (m_words[n >> 6] >> (n & 63)) & 1; }
+		void set(size_t n, bool v) {
+			uint64_t bit = uint64_t(1) << (n & 63);
+			m_words[n >> 6] = v ? m_words[n >> 6] | bit : m_words[n >> 6] & ~bit;
+		}
+		void clear() { for (auto &w: m_words) w = 0; }
+	};
+
+	std::vector<Device *> m_devices;
+	std::vector<Operation> m_ops;              // in order of evaluation
+	std::vector<Connection *> m_signals;       // by signal number
+	std::map<Connection *, size_t> m_number;
+	std::map<Connection *, size_t> m_source;   // what a connection on a wire drives it with
+	std::map<Wire *, size_t> m_nets;           // the signal of each net, by its first wire
+	size_t m_outputs = 0;                      // outputs are numbered first
+	std::vector<size_t> m_inputs;              // signals from outside the group
+	std::vector<Connection *> m_probes;        // as observed, before compiling
+	Bits m_level;
+	Bits m_impeded;
+	Bits m_observed;
+	Bits m_changed;
+	Bits m_outside;                            // inputs
+	Bits m_derived;                            // written back by other means
+	Bits m_weak;                               // a pull-up, or switched from one
+	bool m_feedback = false;
+	bool m_live;
+
+	struct Batch {
+		std::vector<Lanes> level;
+		std::vector<Lanes> impeded;
+		std::vector<Lanes> last_in;                 // by operation
+		std::vector<Lanes> last_ck;
+		std::vector<Lanes> pending;
+	};
+
+	std::vector<Connection *> outputs(Device *dev);
+	size_t signal(Connection *c);
+	size_t source(Connection *c);
+	void wire(Wire *w);
+	void add(Device *dev);
+	void levelise();
+	void release();
+
+	void set(size_t n, bool level, bool impeded=false);
+	bool step(Operation &op);
+	bool step(size_t a_op, Batch &b) const;
+	size_t number(Connection *c, bool input) const;
+	void write_back();
+	void on_input(Connection *c, const std::string &name, const std::vector<BYTE> &data);
+
+  public:
+	static const size_t npos = (size_t)-1;
+
+	Netlist(const std::vector<Device *> &a_devices, const std::string &a_name="netlist", bool a_live=true);
+	virtual ~Netlist();
+
+	void compile();
+	void observe(Connection &c);        // write this connection back when it changes
+	void evaluate();                    // read the inputs, and settle the group
+	void reload();                      // read counters again, after they are set from outside
+	bool signal(Connection &c);         // the compiled level of c
+
+	// steps[n][i] holds the level of a_inputs[i] at step n in each lane, and the
+	// result holds each of a_outputs after each step.
+	std::vector<std::vector<Sample> > batch(const std::vector<Connection *> &a_inputs,
+			const std::vector<std::vector<Lanes> > &a_steps, const std::vector<Connection *> &a_outputs) const;
+	// the same, where an input may also be left undriven, as a pin may
+	std::vector<std::vector<Sample> > batch(const std::vector<Connection *> &a_inputs,
+			const std::vector<std::vector<Sample> > &a_steps, const std::vector<Connection *> &a_outputs) const;
+	// any number of scenarios, of equal length, run a batch at a time
+	std::vector<Trace> simulate(const std::vector<Connection *> &a_inputs,
+			const std::vector<Stimulus> &a_scenarios, const std::vector<Connection *> &a_outputs) const;
+	bool feedback() const { return m_feedback; }
+	size_t operations() const { return m_ops.size(); }
+	size_t signals() const { return m_signals.size(); }
+};
@@ -0,0 +1,188 @@
+/*
+ * nodal.cc
+ *
+ *  Modified nodal analysis, an alternative to the mesh analysis of Connection_Node.
+ */
+#include <deque>
+#include <cmath>
+#include <set>
+#include "nodal.h"
+#include "transient.h"
+
+std::map<Device *, SmartPtr<NodalAnalysis> > &NodalAnalysis::circuits() {
+	static NeverDestroyed<std::map<Device *, SmartPtr<NodalAnalysis> > > l_circuits;
+	return *l_circuits;
+}
+
+//___________________________________________________________________________________
+// Collect every device reachable from a_start through sources and targets.
+void NodalAnalysis::walk(Device *a_start) {
+	std::set<Device *> seen({a_start});
+	std::deque<Device *> pending({a_start});
+	while (pending.size()) {
+		Device *dev = pending.front(); pending.pop_front();
+		m_branches.push_back(Branch{dev, 0, 0});
+		for (auto d: dev->sources()) if (d && seen.insert(d).second) pending.push_back(d);
+		for (auto d: dev->targets()) if (d && seen.insert(d).second) pending.push_back(d);
+	}
+}
+
+//___________________________________________________________________________________
+// Each branch has an input and an output port.  Ports which meet are the same node,
+// so we merge them, and number what remains.
+void NodalAnalysis::number_nodes() {
+	size_t reference = 2 * m_branches.size();
+	std::vector<size_t> parent(reference + 1);
+	for (size_t n = 0; n < parent.size(); ++n) parent[n] = n;
+	auto root = [&](size_t n) {
+		while (parent[n] != n) n = parent[n] = parent[parent[n]];
+		return n;
+	};
+	auto merge = [&](size_t a, size_t b) {
+		a = root(a); b = root(b);
+		if (a == b) return;
+		if (a == root(reference)) std::swap(a, b);     // the reference stays a root
+		parent[a] = b;
+	};
+
+	std::map<Device *, size_t> index;
+	for (size_t b = 0; b < m_branches.size(); ++b) index[m_branches[b].dev] = b;
+	for (size_t b = 0; b < m_branches.size(); ++b) {
+		Device *dev = m_branches[b].dev;
+		auto sources = dev->sources();
+		if (sources.empty()) merge(2*b, reference);
+		if (dev->targets().empty()) merge(2*b + 1, reference);
+		for (auto s: sources) merge(2*b, 2*index[s] + 1);
+	}
+
+	std::map<size_t, size_t> number({{root(reference), 0}});
+	for (auto &branch: m_branches) {
+		size_t b = &branch - m_branches.data();
+		for (size_t *port: {&branch.in, &branch.out}) {
+			size_t r = root(port == &branch.in ? 2*b : 2*b + 1);
+			auto found = number.find(r);
+			if (found == number.end()) found = number.insert({r, number.size()}).first;
+			*port = found->second;
+		}
+	}
+	m_nodes = number.size() - 1;
+}
+
+//___________________________________________________________________________________
+//  The branch current leaves its input node and enters its output node, and across
+// the branch, V(in) + E - R.I = V(out).  A branch which is impeded carries no current.
+void NodalAnalysis::stamp(double h, Reactive::Method m) {
+	for (size_t b = 0; b < m_branches.size(); ++b) {
+		auto &branch = m_branches[b];
+		double R = branch.dev->R(), E = 0;
+		bool source = dynamic_cast<Voltage *>(branch.dev) || branch.dev->sources().empty();
+		if (source) E = branch.dev->rd(false);
+		auto reactive = dynamic_cast<Reactive *>(branch.dev);
+		if (h > 0 && reactive) reactive->companion(h, m, R, E);
+		bool open = R >= max_R;
+
+		if (branch.in) {                          // m_A(column, row)
+			m_A(I(b), V(branch.in)) = open ? 0 : 1;
+			m_A(V(branch.in), I(b)) = open ? 0 : 1;
+		}
+		if (branch.out) {
+			m_A(I(b), V(branch.out)) = open ? 0 : -1;
+			m_A(V(branch.out), I(b)) = open ? 0 : -1;
+		}
+		m_A(I(b), I(b)) = open ? 1 : -R;
+		m_b[I(b)] = open ? 0 : -E;
+	}
+}
+
+//___________________________________________________________________________________
+//  As with mesh analysis, a device's current is negative when flowing from its input
+// to its output, and setting the voltage of each source cascades through the slots
+// of everything it feeds.
+void NodalAnalysis::publish(const std::vector<double> &x) {
+	std::map<Device *, double> values;  // save existing values
+	for (size_t b = 0; b < m_branches.size(); ++b) {
+		Device *dev = m_branches[b].dev;
+		values[dev] = dev->I();
+		dev->I(-x[I(b)]);
+	}
+	for (auto &branch: m_branches)
+		if (branch.dev->sources().empty())
+			branch.dev->update_voltage(branch.dev->rd(false));  // cascade updates
+	for (auto &branch: m_branches)
+		if (not float_equiv(values[branch.dev], branch.dev->I()))
+			branch.dev->refresh();   // generate update events for changed devices
+}
+
+bool NodalAnalysis::solve() {
+	stamp();
+	if (!m_lu.refactor(m_A)) return false;
+	std::vector<double> x(m_b);
+	m_lu.solve(x);
+	publish(x);
+	return true;
+}
+
+//___________________________________________________________________________________
+//  A transient step solves with each capacitor and inductor replaced by its companion
+// model, but changes nothing until the step is accepted.  The difference between two
+// solutions, such as by the trapezoidal rule and by backward Euler, estimates the error
+// in the stored quantities over the step, as a fraction of what is tolerated.
+bool NodalAnalysis::solve(double h, Reactive::Method m, std::vector<double> &x) {
+	stamp(h, m);
+	if (!m_lu.refactor(m_A)) return false;
+	x = m_b;
+	m_lu.solve(x);
+	return true;
+}
+
+double NodalAnalysis::error(double h, const std::vector<double> &x, const std::vector<double> &y) const {
+	double worst = 0;
+	for (size_t b = 0; b < m_branches.size(); ++b) {
+		auto reactive = dynamic_cast<Reactive *>(m_branches[b].dev);
+		if (!reactive) continue;
+		double sx = reactive->state(h, Reactive::TRAPEZOIDAL, x[I(b)]);
+		double sy = reactive->state(h, Reactive::EULER, y[I(b)]);
+		worst = std::max(worst, std::fabs(sx - sy) / (Transient::abstol + Transient::tolerance() * std::fabs(sx)));
+	}
+	return worst;
+}
+
+void NodalAnalysis::accept(double h, Reactive::Method m, const std::vector<double> &x) {
+	for (size_t b = 0; b < m_branches.size(); ++b)
+		if (auto reactive = dynamic_cast<Reactive *>(m_branches[b].dev))
+			reactive->accept(h, m, x[I(b)]);
+}
+
+NodalAnalysis::NodalAnalysis(Device *a_start) {
+	walk(a_start);
+	number_nodes();
+	for (auto &branch: m_branches)
+		if (dynamic_cast<Reactive *>(branch.dev)) m_reactive = true;
+	size_t n = m_nodes + m_branches.size();
+	m_A = Matrix(n);
+	m_b.assign(n, 0);
+	for (size_t node = 1; node <= m_nodes; ++node)
+		m_A(V(node), V(node)) = gmin;
+}
+
+//___________________________________________________________________________________
+SmartPtr<NodalAnalysis> NodalAnalysis::circuit(Device *a_device) {
+	Simulation::Lock lock;
+	static unsigned long l_topology = Simulation::topology();
+	if (l_topology != Simulation::topology()) {
+		circuits().clear();
+		l_topology = Simulation::topology();
+	}
+	auto found = circuits().find(a_device);
+	if (found != circuits().end())
+		return found->second;
+	SmartPtr<NodalAnalysis> circuit = new NodalAnalysis(a_device);
+	for (auto &branch: circuit->m_branches)
+		circuits()[branch.dev] = circuit;
+	return circuit;
+}
+
+void NodalAnalysis::query(Device *a_device) {
+	Simulation::Lock lock;
+	circuit(a_device)->solve();
+}
@@ -0,0 +1,69 @@
+/*
+ * nodal.h
+ *
+ *  Modified nodal analysis, an alternative to the mesh analysis of Connection_Node.
+ */
+#pragma once
+#include <map>
+#include <vector>
+#include "device_base.h"
+#include "../utils/matrix.h"
+
+//___________________________________________________________________________________
+//  Every device in a circuit is a branch from its input node to its output node,
+// holding an EMF in series with its resistance, just as a mesh item does.  A device's
+// input node is the output node of each of its sources.  A device without sources
+// starts from the reference node, and one without targets returns to it.
+//  The unknowns are the voltage at each node and the current in each branch, so a
+// voltage source or a connection of no resistance needs no special treatment, and an
+// impeded branch simply carries no current.  A small conductance from every node to
+// the reference keeps a node with nothing driving it from making the system singular.
+//  A circuit is walked once, and the system it produces stays resident.  When element
+// values change, only the branch rows and the source vector are restamped, and the
+// factorisation reuses the row order and fill pattern of the last one.  Circuits are
+// walked again only after a connection is made or broken (see Simulation::rewired()).
+//  A capacitor or inductor is stamped as its companion model over a time step, which
+// the transient engine (see transient.h) uses to advance a circuit in simulated time.
+class NodalAnalysis {
+	struct Branch {
+		Device *dev;
+		size_t in;          // node numbers; 0 is the reference
+		size_t out;
+	};
+
+	std::vector<Branch> m_branches;
+	size_t m_nodes = 0;                   // not counting the reference
+	Matrix m_A;
+	std::vector<double> m_b;
+	LUSolver m_lu;
+	bool m_reactive = false;              // has a capacitor or inductor
+	double m_step = 0;                    // the last transient step which kept its error bounded
+
+	static std::map<Device *, SmartPtr<NodalAnalysis> > &circuits();   // by member device
+
+	void walk(Device *a_start);
+	void number_nodes();
+	size_t V(size_t a_node) const { return a_node - 1; }              // unknowns, by column
+	size_t I(size_t a_branch) const { return m_nodes + a_branch; }
+	void stamp(double h=0, Reactive::Method m=Reactive::TRAPEZOIDAL);  // over a step of h seconds
+
+  public:
+	static constexpr double gmin = 1.0e-12;
+
+	NodalAnalysis(Device *a_start);
+
+	size_t nodes() const { return m_nodes; }
+	size_t branches() const { return m_branches.size(); }
+	bool solve();                         // false if the circuit has no unique solution
+
+	bool reactive() const { return m_reactive; }
+	double step() const { return m_step; }
+	void step(double h) { m_step = h; }
+	bool solve(double h, Reactive::Method m, std::vector<double> &x);   // without publishing
+	double error(double h, const std::vector<double> &x, const std::vector<double> &y) const;
+	void accept(double h, Reactive::Method m, const std::vector<double> &x);
+	void publish(const std::vector<double> &x);
+
+	static SmartPtr<NodalAnalysis> circuit(Device *a_device);   // the circuit containing a_device
+	static void query(Device *a_device);  // solve the circuit containing a_device
+};
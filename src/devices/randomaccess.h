@@ -33,7 +33,7 @@ class DeviceRandomAccessAdapter: public RandomAccess {
 			m_flash(a_flash) {}
 		virtual unsigned int size() { return m_flash.size(); }
 		virtual int get_data(size_t idx) { return m_flash.data[idx]; }
-		virtual void set_data(size_t idx, int value) { m_flash.data[idx] = value; }
+		virtual void set_data(size_t idx, int value) { m_flash.write(idx, value); }
 	};
 
 	RandomAccess *m_adapted;
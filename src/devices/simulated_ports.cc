@@ -1,4 +1,5 @@
 #include "simulated_ports.h"
+#include "netlist.h"
 #include <bitset>
 
 //___________________________________________________________________________________
@@ -865,6 +866,75 @@ BasicPortB::~BasicPortB() {
 
 }
 
+//___________________________________________________________________________________
+//  Each step of a sweep is four steps of a netlist batch.  The first drives the pin
+// and sets RBPU, so that a read sees the pin settled.  The second raises the write or
+// read line and puts the data on the bus, as a register access does, and reads the
+// bus.  The third lowers the line, as the clock does at Q4, which latches a write.
+// The fourth releases the bus, and reads the pin.
+std::vector<std::vector<BasicPortB::Result> > BasicPortB::sweep(const std::vector<Scenario> &a_scenarios,
+		const std::vector<Connection *> &a_probes) {
+	std::vector<Device *> devices({&m_iRBPU});
+	for (auto &c: components()) devices.push_back(&*c.second);
+	Netlist netlist(devices, name() + "::sweep", false);
+
+	std::vector<Connection *> inputs({&Data, &Port, &Tris, &rdPort, &rdTris, &m_RBPU, &Pin});
+	std::vector<Connection *> outputs({&Data, &Pin});
+	outputs.insert(outputs.end(), a_probes.begin(), a_probes.end());
+
+	std::vector<std::vector<Result> > results;
+	if (a_scenarios.empty()) return results;
+	size_t steps = a_scenarios[0].size();
+	for (auto &scenario: a_scenarios)
+		if (scenario.size() != steps) throw(name() + std::string(": scenarios differ in length"));
+
+	for (size_t first = 0; first < a_scenarios.size(); first += Netlist::lanes) {
+		size_t count = std::min(Netlist::lanes, a_scenarios.size() - first);
+		std::vector<std::vector<Netlist::Sample> > words;
+		for (size_t n = 0; n < steps; ++n) {
+			std::vector<Netlist::Sample> act(inputs.size(), Netlist::Sample{0, 0}), settle, latch, idle;
+			act[0].impeded = ~Netlist::Lanes(0);
+			for (size_t lane = 0; lane < count; ++lane) {
+				const Step &step = a_scenarios[first + lane][n];
+				Netlist::Lanes bit = Netlist::Lanes(1) << lane;
+				bool write = step.access == Step::WRITE_PORT || step.access == Step::WRITE_TRIS;
+				if (write) act[0].impeded &= ~bit;
+				if (write && step.data) act[0].level |= bit;
+				if (step.access == Step::WRITE_PORT) act[1].level |= bit;
+				if (step.access == Step::WRITE_TRIS) act[2].level |= bit;
+				if (step.access == Step::READ_PORT) act[3].level |= bit;
+				if (step.access == Step::READ_TRIS) act[4].level |= bit;
+				if (step.rbpu) act[5].level |= bit;
+				if (step.pin == Step::HIGH) act[6].level |= bit;
+				if (step.pin == Step::FLOAT) act[6].impeded |= bit;
+			}
+			latch = act;
+			for (size_t i = 1; i <= 4; ++i) latch[i].level = 0;
+			idle = latch;
+			idle[0] = Netlist::Sample{0, ~Netlist::Lanes(0)};
+			settle = idle;
+			words.push_back(settle);
+			words.push_back(act);
+			words.push_back(latch);
+			words.push_back(idle);
+		}
+
+		auto samples = netlist.batch(inputs, words, outputs);
+		for (size_t lane = 0; lane < count; ++lane) {
+			std::vector<Result> trace;
+			for (size_t n = 0; n < steps; ++n) {
+				auto &act = samples[4 * n + 1], &idle = samples[4 * n + 3];
+				Result r{(bool)((idle[1].level >> lane) & 1), (bool)((idle[1].impeded >> lane) & 1),
+					(bool)((act[0].level >> lane) & 1), {}};
+				for (size_t p = 2; p < outputs.size(); ++p) r.probes.push_back((idle[p].level >> lane) & 1);
+				trace.push_back(r);
+			}
+			results.push_back(trace);
+		}
+	}
+	return results;
+}
+
 
 //___________________________________________________________________________
 //  RB0 adds a schmitt trigger connected to an external interrupt signal
@@ -962,9 +1032,10 @@ PortB_RB2::PortB_RB2(Terminal &a_Pin, const std::string &a_name):
 //___________________________________________________________________________
 //  RB3 is the last of the familiar looking port functions
 void PortB_RB3::process_register_change(Register *r, const std::string &name, const std::vector<BYTE> &data) {
-	if (name == "CCP1CON") {
-		// TODO: What gets set here depends on CCP1CON contents
-		CCP_Out().set_value(Vdd, false);
+	if (name == "CCP1CON") {    // compare (set or clear on match) and PWM modes take over the pin
+		BYTE mode = data[Register::DVALUE::NEW] & (Flags::CCP1CON::CCP1M3 | Flags::CCP1CON::CCP1M2 | Flags::CCP1CON::CCP1M1 | Flags::CCP1CON::CCP1M0);
+		bool output = (mode == 0b1000) || (mode == 0b1001) || (mode >= 0b1100);
+		CCP1CON().set_value(output?Vdd:Vss, false);
 	}
 
 	if (name == "RCSTA") {
@@ -984,7 +1055,7 @@ PortB_RB3::PortB_RB3(Terminal &a_Pin, const std::string &a_name):
 	PU_en.inputs({&iRBPU(), &TrisLatch.Q(), &m_CCP1CON});
 
 	Schmitt *trigger = new Schmitt(PinOut(), false, false);
-	Wire *CCP_RECWire = new Wire(trigger->rd(), m_CCP_Out, "CCP_in");
+	Wire *CCP_RECWire = new Wire(trigger->rd(), m_CCP_in, "CCP_in");
 	Mux *dmux = new Mux({&DataLatch.Q(), &m_CCP_Out}, {&m_CCP1CON}, "Data Mux");
 	TS1.input(&dmux->rd());
 
@@ -998,7 +1069,7 @@ PortB_RB3::PortB_RB3(Terminal &a_Pin, const std::string &a_name):
 
 	CCP1CON().set_value(Vss, false);
 	Peripheral_OE().set_value(Vdd, false);
-	CCP_in().set_value(Vss, false);
+	CCP_in().set_value(Vss, true);     // driven by the trigger, not by us
 }
 
 
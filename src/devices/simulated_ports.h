@@ -269,11 +269,33 @@ protected:
 	virtual void process_register_change(Register *r, const std::string &name, const std::vector<BYTE> &data);
 
   public:
+	//  At each step of a sweep, the CPU may write or read this bit of PORTB or TRISB,
+	// OPTION.RBPU holds a level, and the pin is driven from outside, or left floating.
+	struct Step {
+		enum Access { NONE, WRITE_PORT, WRITE_TRIS, READ_PORT, READ_TRIS };
+		enum Drive { FLOAT, LOW, HIGH };
+		Access access;
+		bool data;                   // the bit written
+		bool rbpu;
+		Drive pin;
+	};
+	struct Result {
+		bool pin;                    // the level on the pin after the step
+		bool floating;               // nothing drives the pin
+		bool read;                   // the bit read, if the step reads
+		std::vector<bool> probes;    // each connection asked for, after the step
+	};
+	typedef std::vector<Step> Scenario;
+
 	BasicPortB(Terminal &a_Pin, const std::string &a_name, int port_bit_ofs);
 	virtual ~BasicPortB();
 	Connection &RBPU() { return m_RBPU; }
 	Connection &iRBPU() { return m_iRBPU; }
 	Connection &PinOut() { return m_PinOut; }
+
+	// Runs each scenario from the present state of the pin, compiled, 64 at a time.
+	std::vector<std::vector<Result> > sweep(const std::vector<Scenario> &a_scenarios,
+			const std::vector<Connection *> &a_probes={});
 };
 
 //___________________________________________________________________________________
@@ -15,25 +15,35 @@ const WORD SRAM::calc_index(const BYTE a_idx, bool indirect) const {
 }
 
 
+BYTE &SRAM::cell(WORD a_index) {
+	switch (a_index) {     // calc_index has already folded these into bank 0
+	  case PCL:    return m_core.PCL;
+	  case STATUS: return m_core.STATUS;
+	  case FSR:    return m_core.FSR;
+	  case PCLATH: return m_core.PCLATH;
+	}
+	return m_bank[a_index / BANK_SIZE][a_index % BANK_SIZE];
+}
+
 void SRAM::write(const WORD a_idx, const BYTE value, bool indirect) {
-	WORD index = calc_index(a_idx, indirect);
-	m_bank[index / BANK_SIZE][index % BANK_SIZE] = value;
+	cell(calc_index(a_idx, indirect)) = value;
 }
 
 const BYTE SRAM::read(const WORD a_idx, bool indirect) const {
-	WORD index = calc_index(a_idx, indirect);
-	return m_bank[index / BANK_SIZE][index % BANK_SIZE];
+	return const_cast<SRAM *>(this)->cell(calc_index(a_idx, indirect));
 }
 
 void SRAM::reset() {
 	set_PC(0);
+	m_core.STATUS = 0;
+	m_core.FSR = 0;
 	 for (int bank = 0; bank < RAM_BANKS; ++bank)
 		 for (int ofs = 0; ofs < BANK_SIZE; ++ofs)
 			 m_bank[bank][ofs] = 0;
 }
 
 
-SRAM::SRAM() : RAM_BANKS(4), BANK_SIZE(0x80) {
+SRAM::SRAM() : m_core(), RAM_BANKS(4) {
 	WORD all_banks[] = {INDF, PCL, STATUS, FSR, PCLATH, INTCON};
 	WORD even_banks[] = {TMR0, PORTB};
 	WORD odd_banks[] = {OPTION, TRISB};
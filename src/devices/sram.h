@@ -3,15 +3,43 @@
 #include <set>
 #include <iostream>
 #include <queue>
+#include <string>
 #include "constants.h"
 #include "device_base.h"
 
+//___________________________________________________________________________________
+//  The state the CPU touches on every instruction cycle, kept together in one cache line.
+// PCL, STATUS, FSR and PCLATH appear at the same address in every bank, so rather than
+// being stored in bank 0 they live here, and SRAM reads and writes of them, from any
+// bank, land in the same place.  The CPU keeps W, its stack and its pipeline state here
+// as well, so none of it needs a bank calculation to reach.
+struct alignas(64) CoreState {
+	static const int STACK = 8;     // levels of hardware stack, a power of two
+
+	BYTE W;
+	BYTE STATUS;
+	BYTE FSR;
+	BYTE PCL;
+	BYTE PCLATH;
+	BYTE SP;
+	bool skip;                      // the next instruction fetched becomes a NOP
+	bool interrupt_pending;         // raised by a device, taken at the next cycle
+	WORD execPC;                    // address of the instruction executing
+	WORD stack[STACK];
+	int  cycles;                    // cycles left of the instruction executing
+};
+static_assert(sizeof(CoreState) == 64, "CoreState should fill exactly one cache line");
+
 class SRAM: public Device{
+	CoreState m_core;
 	BYTE m_bank[4][0x80];
 	int  RAM_BANKS;
-	int  BANK_SIZE;
+
+	BYTE &cell(WORD a_index);       // storage for a calculated index
 
   public:
+	static const WORD BANK_SIZE = 0x80;    // the same for the whole family, so offsets are masks
+
 	static const WORD INDF    = 0x00;
 	static const WORD TMR0    = 0x01;
 	static const WORD PCL     = 0x02;
@@ -74,20 +102,28 @@ class SRAM: public Device{
 
 	const WORD calc_index(const BYTE a_idx, bool indirect) const;
 
+	CoreState &core() { return m_core; }
+	const CoreState &core() const { return m_core; }
+
 	BYTE fsr() const {
-		return (m_bank[0][FSR]);
+		return (m_core.FSR);
 	}
 
 	BYTE &fsr() {
-		return (m_bank[0][FSR]);
+		return (m_core.FSR);
 	}
 
 	BYTE status() const {
-		return (m_bank[0][STATUS]);
+		return (m_core.STATUS);
 	}
 
 	BYTE &status() {     // only way to set special bits is by this reference
-		return (m_bank[0][STATUS]);
+		return (m_core.STATUS);
+	}
+
+	BYTE &gpr(BYTE a_idx) {     // a general purpose register, 0x20 and above, in the current bank
+		WORD index = a_idx | ((status() & 0x60) << 2);
+		return m_bank[index / BANK_SIZE][index % BANK_SIZE];
 	}
 
 	const BYTE bank() const {
@@ -108,20 +144,21 @@ class SRAM: public Device{
 	}
 
 	WORD get_PC() const {
-		WORD hi = m_bank[0][PCLATH] & 0x1f;
-		WORD lo = m_bank[0][PCL];
+		WORD hi = m_core.PCLATH & 0x1f;
+		WORD lo = m_core.PCL;
 		WORD PC =  hi << 8 | lo;
 		return PC;
 	}
 
 	void set_PC(WORD PC) {
-		m_bank[0][PCLATH] = (BYTE)(PC >> 8) & 0x1f;
-		m_bank[0][PCL] = (BYTE)(PC & 0xff);
+		m_core.PCLATH = (BYTE)(PC >> 8) & 0x1f;
+		m_core.PCL = (BYTE)(PC & 0xff);
 	}
 
 	void init_params(int a_ram_banks, int a_bank_size) {
+		if (a_ram_banks > 4 || a_bank_size != BANK_SIZE)
+			throw std::string("SRAM has at most 4 banks of ") + std::to_string(BANK_SIZE) + " bytes";
 		RAM_BANKS = a_ram_banks;
-		BANK_SIZE = a_bank_size;
 	};
 
 	void reset();
@@ -1,5 +1,6 @@
 #pragma once
 #include "device_base.h"
+#include "netlist.h"
 #include "register.h"
 #include "clock.h"
 
@@ -25,6 +26,8 @@ class Timer0: public Device {
 	Timer0();
 	~Timer0();
 
+	void reset();            // as for OPTION = 0xff
+
 	void clock_source_select(bool a_use_RA4);
 	void clock_transition(bool a_falling_edge);
 	void assign_prescaler(bool a_assigned_to_wdt);
@@ -62,6 +65,14 @@ class Timer0: public Device {
 //     Is there a case for re-implementing timer0?  Perhaps, but there's no benefit other than
 //     esthetics, and a raw logic implementation in C is more efficient than an event driven
 //     component model.
+//
+//  The counting chain, from the clock source multiplexer through to TMR1, is compiled into
+// a Netlist, so that an edge on Fosc/4 or the external clock is one pass over the chain
+// rather than a cascade of events.  Only TMR1 is observed.  The counters set their own
+// bits, but the outputs of the multiplexers and the gate between them are not written
+// back, so a diagram shows them as they were when compiled.  The T1OSC tristate, its wire
+// and the RB6 Schmitt trigger are left to their own events, and remain unwired: RB6 and
+// RB7 follow the PORTB latch rather than the pins, and T1OSC drives a wire nothing reads.
 
 class Timer1: public Device {
 	DeviceEventQueue eq;
@@ -85,6 +96,7 @@ class Timer1: public Device {
 	Connection m_tmr1on;
 	AndGate    m_signal;
 	Counter    m_tmr1;
+	Netlist    m_chain;
 
 	void register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data);
 	void on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data);
@@ -116,7 +128,43 @@ class Timer1: public Device {
 };
 
 //___________________________________________________________________________________
+//  Timer2 is an 8 bit timer with a 1:1, 1:4 or 1:16 prescaler, which counts up to PR2
+// and then restarts at zero.  Each restart is a PR2 match, which clocks a 1:1 to 1:16
+// postscaler.  TMR2IF is set when the postscaler rolls over.
+//
+//  Nothing here happens every instruction cycle.  We remember the cycle at which TMR2
+// was last zero, and schedule a clock deadline for the next match.  The TMR2 value is
+// calculated only when someone asks for it.  At tens of kHz of PWM, that is the
+// difference between a few events per period, and hundreds.
 class Timer2: public Device {
+	Clock &m_clock;
+	DeviceEventQueue eq;
+
+	bool  m_on;
+	BYTE  m_pr2;
+	WORD  m_prescale;          // 1, 4 or 16 instruction cycles per count
+	BYTE  m_postscale;         // 1 to 16 matches per interrupt
+	BYTE  m_matches;           // postscaler count
+	BYTE  m_held;              // TMR2 value while the timer is off
+	WORD  m_wrap;              // count at which TMR2 next restarts; PR2+1, or 256 if TMR2 > PR2
+	Clock::Cycle m_start;      // cycle at which TMR2 was last zero
+
+	void restart(BYTE a_value, Clock::Cycle a_phase=0);
+	void schedule();
+	void register_changed(Register *r, const std::string &name, const std::vector<BYTE> &data);
+	void on_clock(Clock *c, const std::string &name, const std::vector<BYTE> &data);
+
+  public:
+	Timer2(Clock &a_clock);
+	~Timer2();
 
+	void reset();
+	BYTE value() const;
+	bool on() const { return m_on; }
+	BYTE period() const { return m_pr2; }
+	WORD prescale() const { return m_prescale; }
+	BYTE postscale() const { return m_postscale; }
+	Clock::Cycle period_start() const { return m_start; }
+	Clock::Cycle period_cycles() const { return ((Clock::Cycle)m_pr2 + 1) * m_prescale; }
 };
 
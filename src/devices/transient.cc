@@ -0,0 +1,187 @@
+/*
+ * transient.cc
+ *
+ *  Advances capacitors and inductors in simulated time.
+ */
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "transient.h"
+#include "nodal.h"
+
+double Transient::m_step = 1.0e-3;
+double Transient::m_tolerance = 1.0e-3;
+double Transient::m_time = 0;
+double Transient::m_interval = 0;
+unsigned long Transient::m_steps = 0;
+unsigned long Transient::m_updates = 0;
+Clock *Transient::m_clock = NULL;
+Clock::Cycle Transient::m_cycle = 0;
+Clock::Cycle Transient::m_period = 1000;
+
+std::set<Device *> &Transient::devices() {
+	static NeverDestroyed<std::set<Device *> > l_devices;
+	return *l_devices;
+}
+
+std::map<Connection *, Transient::Watch> &Transient::watches() {
+	static NeverDestroyed<std::map<Connection *, Watch> > l_watches;
+	return *l_watches;
+}
+
+Transient &Transient::engine() {
+	static NeverDestroyed<Transient> l_engine;
+	return *l_engine;
+}
+
+//___________________________________________________________________________________
+//  With nothing analog to advance, there is no alarm on the CPU clock, and no
+// subscription to Simulation::clock().
+void Transient::follow() {
+	DeviceEvent<Connection>::unsubscribe<Transient>(&engine(), &Transient::on_clock, &Simulation::clock());
+	if (m_clock) {
+		if (devices().empty())
+			m_clock->cancel("analog");
+		else if (!m_clock->scheduled("analog")) {
+			m_cycle = m_clock->time();
+			m_clock->alarm("analog", m_cycle + 1);     // soon, to learn how fast things move
+		}
+	} else if (devices().size()) {
+		engine().m_T = current_time_us();
+		DeviceEvent<Connection>::subscribe<Transient>(&engine(), &Transient::on_clock, &Simulation::clock());
+	}
+}
+
+void Transient::add(Device *a_device) {
+	Simulation::Lock lock;
+	devices().insert(a_device);
+	follow();
+}
+
+void Transient::remove(Device *a_device) {
+	Simulation::Lock lock;
+	devices().erase(a_device);
+	follow();
+}
+
+void Transient::on_clock(Connection *c, const std::string &a_name, const std::vector<BYTE> &a_data) {
+	auto ts = current_time_us();
+	double dT = ((ts - m_T).count() / 1000000.0) * Simulation::speed();   // dT in seconds
+	if (dT < m_step) return;
+	Simulation::Lock lock;
+	m_T = ts;
+	advance(std::min(dT, catch_up * m_step));
+}
+
+//___________________________________________________________________________________
+void Transient::attach(Clock &a_clock) {
+	Simulation::Lock lock;
+	if (m_clock) detach(*m_clock);
+	m_clock = &a_clock;
+	DeviceEvent<Clock>::subscribe<Transient>(&engine(), &Transient::on_alarm, m_clock);
+	follow();
+}
+
+void Transient::detach(Clock &a_clock) {
+	Simulation::Lock lock;
+	if (m_clock != &a_clock) return;
+	m_clock->cancel("analog");
+	DeviceEvent<Clock>::unsubscribe<Transient>(&engine(), &Transient::on_alarm, m_clock);
+	m_clock = NULL;
+	follow();
+}
+
+void Transient::on_alarm(Clock *c, const std::string &a_name, const std::vector<BYTE> &a_data) {
+	if (a_name != "analog") return;
+	Simulation::Lock lock;
+	Clock::Cycle now = c->time();
+	if (now > m_cycle) advance((now - m_cycle) * cycle);
+	m_cycle = now;
+	if (devices().size()) schedule();
+	follow();
+}
+
+void Transient::schedule() {
+	Clock::Cycle next = m_period;
+	double t = until_crossing() / cycle;
+	if (t < next) next = std::max((Clock::Cycle)t, (Clock::Cycle)1);
+	m_clock->alarm("analog", m_cycle + next);
+}
+
+//___________________________________________________________________________________
+//  Voltages are assumed to carry on changing at the rate they did over the last
+// update.  For a capacitor charging or discharging, that is sooner than they will
+// actually get there, so an alarm may come early, but never late.
+double Transient::until_crossing() {
+	double soonest = HUGE_VAL;
+	for (auto &w: watches()) {
+		double v = w.first->rd();
+		double rate = m_interval > 0 ? (v - w.second.last) / m_interval : 0;
+		w.second.last = v;
+		if (rate == 0) continue;
+		for (auto level: w.second.levels) {
+			double t = (level - v) / rate;
+			if (t > 0 && t < soonest) soonest = t;
+		}
+	}
+	return soonest;
+}
+
+void Transient::watch(Connection &c, double a_level) {
+	Simulation::Lock lock;
+	auto &w = watches()[&c];
+	if (w.levels.empty()) w.last = c.rd();
+	w.levels.insert(a_level);
+}
+
+void Transient::unwatch(Connection &c, double a_level) {
+	Simulation::Lock lock;
+	auto w = watches().find(&c);
+	if (w == watches().end()) return;
+	auto level = w->second.levels.find(a_level);
+	if (level != w->second.levels.end()) w->second.levels.erase(level);
+	if (w->second.levels.empty()) watches().erase(w);
+}
+
+void Transient::unwatch(Connection &c) {
+	Simulation::Lock lock;
+	watches().erase(&c);
+}
+
+//___________________________________________________________________________________
+void Transient::advance(NodalAnalysis &a_circuit, double a_seconds) {
+	double h = a_circuit.step() > 0 ? a_circuit.step() : m_step / 1024;
+	double t = 0;
+	std::vector<double> x, y;
+	while (a_seconds - t > a_seconds * 1e-12) {
+		double dT = std::min(h, a_seconds - t);
+		if (!a_circuit.solve(dT, Reactive::TRAPEZOIDAL, x) || !a_circuit.solve(dT, Reactive::EULER, y))
+			return;                                          // no unique solution
+		double error = a_circuit.error(dT, x, y);
+		if (error > 1 && dT > m_step * 1e-9) {
+			h = dT / 2;
+			continue;
+		}
+		a_circuit.accept(dT, Reactive::TRAPEZOIDAL, x);
+		t += dT;
+		++m_steps;
+		if (error < 0.25) h = std::min(2 * h, m_step);
+	}
+	a_circuit.step(h);
+	if (x.size()) a_circuit.publish(x);
+}
+
+void Transient::advance(double a_seconds) {
+	Simulation::Lock lock;
+	std::vector<SmartPtr<NodalAnalysis> > circuits;
+	std::set<NodalAnalysis *> seen;
+	for (auto dev: devices()) {
+		auto circuit = NodalAnalysis::circuit(dev);
+		if (seen.insert(circuit.operator->()).second) circuits.push_back(circuit);
+	}
+	for (auto &circuit: circuits)
+		advance(*circuit, a_seconds);
+	m_time += a_seconds;
+	m_interval = a_seconds;
+	++m_updates;
+}
@@ -0,0 +1,88 @@
+/*
+ * transient.h
+ *
+ *  Advances capacitors and inductors in simulated time.
+ */
+#pragma once
+#include <set>
+#include <map>
+#include "device_base.h"
+#include "clock.h"
+
+class NodalAnalysis;
+
+//___________________________________________________________________________________
+//  Every capacitor and inductor registers itself here.  Each circuit containing one
+// is solved by nodal analysis with its reactive devices stamped as companion models
+// (see Reactive), and advanced by the trapezoidal rule.  The same step taken by
+// backward Euler estimates the error, and a step is halved until its error is within
+// tolerance(), and doubled after one comfortably so, up to step().  A circuit keeps
+// the step it settled upon, so that the next advance starts from there.
+//  advance() takes every such circuit through the same interval, each in as many steps
+// as it needs, and publishes the result for each circuit only once, at the end.
+//
+//  The analog and digital domains run at different rates.  The digital domain steps
+// through every phase of every instruction cycle, while the analog domain needs only
+// to catch up now and then.  Once attach()ed to the CPU clock, the analog domain is
+// advanced by an alarm on that clock, every period() cycles.  Results are exchanged
+// at those points alone, so a connection which something digital reads as a level,
+// such as the input to a Schmitt trigger, is watch()ed at the voltage where its level
+// changes.  When a watched voltage is heading for such a threshold, the next alarm is
+// set for when it should get there, so that a crossing is seen within a cycle or two
+// of when it happens.
+//  Without a clock, as on a scratch pad, the engine follows Simulation::clock() and
+// advances when at least step() seconds of scaled wall clock time have passed.
+class Transient {
+	struct Watch {
+		std::multiset<double> levels;
+		double last;                      // the voltage at the last update
+	};
+
+	static double m_step;
+	static double m_tolerance;
+	static double m_time;
+	static double m_interval;             // the length of the last update, in seconds
+	static unsigned long m_steps;
+	static unsigned long m_updates;
+	static Clock *m_clock;                // the digital domain, once attached
+	static Clock::Cycle m_cycle;          // the time the analog domain has caught up to
+	static Clock::Cycle m_period;
+	time_stamp m_T;                       // when last advanced by Simulation::clock()
+
+	static std::set<Device *> &devices();
+	static std::map<Connection *, Watch> &watches();
+	static Transient &engine();
+	static void follow();                 // subscribe to whichever clock drives us
+	static void schedule();               // the next alarm on the CPU clock
+	static double until_crossing();       // seconds until the next watched crossing
+	static void advance(NodalAnalysis &a_circuit, double a_seconds);
+	void on_clock(Connection *c, const std::string &a_name, const std::vector<BYTE> &a_data);
+	void on_alarm(Clock *c, const std::string &a_name, const std::vector<BYTE> &a_data);
+
+  public:
+	static constexpr double abstol = 1.0e-9;    // the error tolerated in a value near zero
+	static constexpr size_t catch_up = 100;     // at most this many step()s on one clock
+	static constexpr double cycle = 1.0e-6;     // an instruction cycle at 4MHz, as for the WDT
+
+	static void add(Device *a_device);
+	static void remove(Device *a_device);
+
+	static void attach(Clock &a_clock);
+	static void detach(Clock &a_clock);
+	static void watch(Connection &c, double a_level);
+	static void unwatch(Connection &c, double a_level);
+	static void unwatch(Connection &c);                      // every level, as c is destroyed
+
+	static double step() { return m_step; }                  // the largest step, in seconds
+	static void step(double a_step) { m_step = a_step; }
+	static double tolerance() { return m_tolerance; }        // the relative error tolerated
+	static void tolerance(double a_tolerance) { m_tolerance = a_tolerance; }
+	static Clock::Cycle period() { return m_period; }        // cycles between updates
+	static void period(Clock::Cycle a_period) { m_period = a_period ? a_period : 1; }
+	static double time() { return m_time; }                  // simulated seconds so far
+	static unsigned long steps() { return m_steps; }         // steps accepted so far
+	static unsigned long updates() { return m_updates; }     // times the analog domain caught up
+	static size_t watching() { return watches().size(); }    // connections watched
+
+	static void advance(double a_seconds);
+};
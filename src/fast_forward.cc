@@ -0,0 +1,322 @@
+#include <set>
+#include <algorithm>
+#include "fast_forward.h"
+
+bool WaitLoop::recognise(DecodedFlash &a_flash, CPU_DATA &a_cpu, WORD a_start, WORD a_end) {
+	// indirect, or reading has a side effect, or the value changes without us hearing of it
+	static const std::set<std::string> unsuitable({"INDF", "PCL", "TMR2", "RCREG", "EECON2"});
+
+	m_inputs.clear();
+	m_ports = 0;
+	m_step = 0;
+	for (WORD pc = a_start; pc <= a_end; ++pc) {
+		const std::string &mnemonic = a_flash.at(pc)->mnemonic;
+		WORD opcode = a_cpu.flash.fetch(pc);
+		if (mnemonic == "NOP" || mnemonic == "GOTO") continue;
+
+		BYTE f = opcode & 0x7f;
+		auto name = a_cpu.RegisterNames.find((BYTE)a_cpu.sram.calc_index(f, false));
+		if (mnemonic == "DECFSZ" || mnemonic == "INCFSZ") {     // a delay loop counter
+			if (m_step || !(opcode & 0x80)) return false;         // one counter, and counted in place
+			if (name != a_cpu.RegisterNames.end()) return false;   // in general purpose RAM
+			m_counter = f;
+			m_step = mnemonic == "DECFSZ" ? -1 : 1;
+			continue;
+		}
+		if (mnemonic != "BTFSS" && mnemonic != "BTFSC" && mnemonic != "MOVF") return false;
+		if (mnemonic == "MOVF" && (opcode & 0x80)) return false;    // MOVF f,f writes f
+
+		if (name != a_cpu.RegisterNames.end()) {
+			if (unsuitable.find(name->second) != unsuitable.end()) return false;
+			if (name->second == "PORTA") m_ports |= 1;
+			if (name->second == "PORTB") m_ports |= 2;
+		}
+		m_inputs.push_back(f);
+	}
+	if (m_step) {      // a loop which tests its own counter does something different each pass
+		for (auto f: m_inputs)
+			if (a_cpu.sram.calc_index(f, false) == a_cpu.sram.calc_index(m_counter, false)) return false;
+	}
+	return true;
+}
+
+//  A nest of delay loops, innermost first.  Each GOTO follows the DECFSZ/INCFSZ of its
+// level, and goes back no further forward than the one inside it, so each loop encloses
+// the loops before it.  Anything else is a NOP, a MOVLW, or a CLRF or MOVWF which sets
+// the counter of a loop further in, before that loop starts.  A MOVWF stores the literal
+// just before it, unless nothing in the nest loads W.
+bool WaitLoop::recognise_nest(DecodedFlash &a_flash, CPU_DATA &a_cpu, WORD a_start, WORD a_end) {
+	auto index = [&](BYTE f) { return a_cpu.sram.calc_index(f, false); };
+	auto level_of = [&](BYTE f) {
+		for (size_t n = 0; n < m_levels.size(); ++n)
+			if (index(m_levels[n].counter) == index(f)) return (int)n;
+		return -1;
+	};
+
+	m_inputs.clear();
+	m_ports = 0;
+	m_step = 0;
+	m_levels.clear();
+	m_actions.assign(a_end - a_start + 1, {NOTHING, 0});
+	bool loads = false;
+	for (WORD pc = a_start; pc <= a_end; ++pc) {
+		const std::string &mnemonic = a_flash.at(pc)->mnemonic;
+		WORD opcode = a_cpu.flash.fetch(pc);
+		BYTE f = opcode & 0x7f;
+		bool gpr = a_cpu.RegisterNames.find((BYTE)index(f)) == a_cpu.RegisterNames.end();
+		auto &action = m_actions[pc - a_start];
+		if (mnemonic == "DECFSZ" || mnemonic == "INCFSZ") {
+			if (!gpr || !(opcode & 0x80) || level_of(f) >= 0) return false;
+			if (pc == a_end || a_flash.at(pc + 1)->mnemonic != "GOTO") return false;
+			WORD target = a_cpu.flash.fetch(pc + 1) & 0x7ff;
+			if (target < a_start || target > pc) return false;
+			if (m_levels.size() && target > m_levels.back().target) return false;
+			action = {COUNT, (int)m_levels.size()};
+			m_actions[pc + 1 - a_start] = {JUMP, (int)m_levels.size()};
+			m_levels.push_back(Level{pc, target, f, mnemonic == "DECFSZ" ? -1 : 1, 0});
+			++pc;
+		} else if (mnemonic == "CLRF" || mnemonic == "MOVWF") {
+			if (!gpr) return false;
+			action = {mnemonic == "CLRF" ? CLEAR : STORE_W, f};     // a level, once we know them all
+		} else if (mnemonic == "MOVLW") {
+			action = {LOAD_W, opcode & 0xff};
+			loads = true;
+		} else if (mnemonic != "NOP") {
+			return false;
+		}
+	}
+	if (m_levels.empty() || m_levels.size() > deepest) return false;
+	if (m_levels.back().at + 1 != a_end || m_levels.back().target != a_start) return false;
+
+	for (WORD pc = a_start; pc <= a_end; ++pc) {
+		auto &action = m_actions[pc - a_start];
+		if (action.first != CLEAR && action.first != STORE_W) continue;
+		int n = level_of(action.second);
+		if (n < 0 || pc >= m_levels[n].target) return false;    // only a loop further in
+		if (action.first == STORE_W && loads) {
+			if (pc == a_start || m_actions[pc - 1 - a_start].first != LOAD_W) return false;
+			for (auto &level: m_levels)
+				if (level.target == pc) return false;
+		}
+		action.second = n;
+	}
+	m_flash = &a_flash;
+	m_nop = a_flash.find(0);
+	return true;
+}
+
+void WaitLoop::sample(CPU_DATA &a_cpu, std::vector<BYTE> &a_values) const {
+	a_values.clear();
+	for (auto f: m_inputs)
+		a_values.push_back(a_cpu.sram.read(f));
+}
+
+bool WaitLoop::watches(const std::string &a_pin) const {   // pins are named RA0/AN0, RB3/CCP1, ...
+	if (!m_armed || a_pin.length() < 2 || a_pin[0] != 'R') return false;
+	return ((m_ports & 1) && a_pin[1] == 'A') || ((m_ports & 2) && a_pin[1] == 'B');
+}
+
+bool WaitLoop::arm(DecodedFlash &a_flash, CPU_DATA &a_cpu, WORD a_start, WORD a_end) {
+	disarm();
+	if (!recognise(a_flash, a_cpu, a_start, a_end) && !recognise_nest(a_flash, a_cpu, a_start, a_end)) {
+		m_levels.clear();
+		return false;
+	}
+	m_start = a_start;
+	m_end = a_end;
+	m_armed = true;
+	return true;
+}
+
+void WaitLoop::disarm() {
+	m_armed = false;
+	m_parked = false;
+	m_pass.clear();
+	m_counted.clear();
+	m_levels.clear();
+}
+
+bool WaitLoop::observe(CPU_DATA &a_cpu, Pipeline a_now) {
+	bool at_start = a_now.current && a_now.execPC == m_start && a_now.cycles == a_now.current->cycles;
+	BYTE count = m_step ? a_cpu.sram.read(m_counter) : 0;
+	if (at_start && m_levels.size()) {   // a nest parks at once, unless this is its last pass
+		if (park_nest(a_cpu, a_now)) return true;
+		disarm();         // and then the loops inside it may park instead
+		return false;
+	}
+	if (at_start) {       // we have just fetched the first instruction of the loop
+		if (m_pass.size() && !m_disturbed && !changed(a_cpu)) {
+			BYTE moved = count - m_count;
+			BYTE passes = m_step < 0 ? count - 1 : 0xff - count;   // before the one which exits
+			if (!m_step || (moved == (BYTE)m_step && passes)) {
+				m_parked = true;
+				m_elapsed = 0;
+				m_count = count;
+				m_limit = passes * m_pass.size();
+				return true;
+			}
+		}
+		m_pass.clear();
+		m_counted.clear();
+		m_pass.push_back(a_now);
+		m_counted.push_back(0);
+		m_count = count;
+		sample(a_cpu, m_values);
+		m_disturbed = false;
+	} else if (a_now.execPC < m_start || a_now.execPC > m_end || m_pass.size() > 3 * longest) {
+		disarm();         // we left the loop
+	} else if (m_pass.size()) {
+		m_pass.push_back(a_now);
+		m_counted.push_back(count - m_count);
+	}
+	return false;
+}
+
+bool WaitLoop::changed(CPU_DATA &a_cpu) const {
+	std::vector<BYTE> values;
+	sample(a_cpu, values);
+	return values != m_values;
+}
+
+bool WaitLoop::remaining(Clock::Cycle &a_cycles) const {
+	if (!counted()) return false;
+	a_cycles = m_elapsed < m_limit ? m_limit - m_elapsed : 0;
+	return true;
+}
+
+Clock::Cycle WaitLoop::to_zero(BYTE a_count, int a_step) {
+	BYTE steps = a_step < 0 ? a_count : -a_count;
+	return steps ? steps : 256;
+}
+
+//  Once round, the levels inside a loop have counted down to zero, and start again from
+// whatever sets them, so each level takes the same cycles every time round.  A nest
+// depends only on its counters, W and Z, so it parks as it is entered.
+bool WaitLoop::park_nest(CPU_DATA &a_cpu, const Pipeline &a_now) {
+	static const Clock::Cycle ever = ~(Clock::Cycle)0;
+	Nest nest{{}, a_cpu.W, (bool)(a_cpu.sram.status() & Flags::STATUS::Z), FETCHED, m_start, nop};
+	for (auto &level: m_levels) {
+		Nest round = nest;
+		round.counts.assign(m_levels.size(), 0);
+		Clock::Cycle left = ever;
+		advance(level.target, level.at, left, round);
+		level.loop = 3 + (ever - left);           // DECFSZ, GOTO and its flush, then back round
+		nest.counts.push_back(a_cpu.sram.read(level.counter));
+	}
+
+	const Level &outer = m_levels.back();
+	Clock::Cycle passes = to_zero(nest.counts.back(), outer.step);
+	if (passes < 2) return false;
+	Nest entry = nest;
+	Clock::Cycle left = ever;
+	advance(m_start, outer.at, left, entry);
+	m_limit = (ever - left) + (passes - 1) * outer.loop;    // to the last pass of the outer loop
+	m_entry = nest;
+	m_pass.assign(1, a_now);
+	m_parked = true;
+	m_elapsed = 0;
+	return true;
+}
+
+//  Move a nest on by up to a_cycles, through the instructions from a_from to just before
+// a_to.  True if it stops on the way, at a_nest.at, or else a_cycles is what is left.
+// Each level goes round as many times as it can in one step, and only where it stops
+// do we go inside.
+bool WaitLoop::advance(WORD a_from, WORD a_to, Clock::Cycle &a_cycles, Nest &a_nest) const {
+	for (WORD pc = a_from; pc < a_to; ) {
+		const auto &action = m_actions[pc - m_start];
+		if (action.first != COUNT) {
+			if (!a_cycles) return a_nest.stop(FETCHED, pc);
+			if (action.first == CLEAR) {
+				a_nest.counts[action.second] = 0;
+				a_nest.zero = true;
+			} else if (action.first == LOAD_W) {
+				a_nest.W = action.second;
+			} else if (action.first == STORE_W) {
+				a_nest.counts[action.second] = a_nest.W;
+			}
+			--a_cycles;
+			a_nest.last = pc++;
+			continue;
+		}
+
+		const Level &level = m_levels[action.second];
+		BYTE &count = a_nest.counts[action.second];
+		Clock::Cycle passes = to_zero(count, level.step);
+		Clock::Cycle round = (passes - 1) * level.loop;      // to the last DECFSZ/INCFSZ
+		Clock::Cycle done = std::min(a_cycles, round) / level.loop;
+		if (done) {       // every time round leaves the levels inside, W and Z the same
+			Clock::Cycle ever = ~(Clock::Cycle)0;
+			count += level.step * (int)(done % 256);
+			a_nest.zero = false;
+			a_nest.last = level.at + 1;
+			advance(level.target, level.at, ever, a_nest);
+			a_cycles -= done * level.loop;
+		}
+		if (done < passes - 1) {      // stops partway round
+			if (!a_cycles) return a_nest.stop(FETCHED, level.at);
+			count += level.step;
+			a_nest.zero = false;
+			a_nest.last = level.at;
+			if (a_cycles == 1) return a_nest.stop(FETCHED, level.at + 1);
+			a_nest.last = level.at + 1;
+			if (a_cycles == 2) return a_nest.stop(FLUSHED, level.at + 1);
+			a_cycles -= 3;
+			return advance(level.target, level.at, a_cycles, a_nest);
+		}
+		if (!a_cycles) return a_nest.stop(FETCHED, level.at);
+		count += level.step;          // to zero, and skip the GOTO
+		a_nest.zero = true;
+		a_nest.last = level.at;
+		if (a_cycles == 1) return a_nest.stop(SKIPPED, level.at + 1);
+		a_nest.last = nop;
+		a_cycles -= 2;
+		pc = level.at + 2;
+	}
+	return false;
+}
+
+Pipeline WaitLoop::pipeline(CPU_DATA &a_cpu, const Nest &a_nest) {
+	WORD at = a_nest.at;
+	Pipeline state{SmartPtr<Instruction>(), a_cpu.flash.fetch(at), a_cpu.flash.wrap(at + 1), at, 1, false, ""};
+	if (a_nest.stage == FETCHED) {
+		state.current = m_flash->at(at);
+		state.cycles = state.current->cycles;
+	} else if (a_nest.stage == FLUSHED) {      // the GOTO has set the PC, and its second cycle is to come
+		state.PC = m_levels[m_actions[at - m_start].second].target;
+	} else {                                   // a skip fetches no opcode, and executes a NOP
+		state.current = m_nop;
+		state.opcode = a_cpu.flash.fetch(at - 1);
+		state.skip = true;
+	}
+	if (a_nest.last == nop)
+		state.disassembled = m_nop->disasm(0, a_cpu);
+	else
+		state.disassembled = m_flash->at(a_nest.last)->disasm(a_cpu.flash.fetch(a_nest.last), a_cpu);
+	return state;
+}
+
+const Pipeline &WaitLoop::resume(CPU_DATA &a_cpu) {
+	if (m_levels.size()) {
+		m_parked = false;
+		m_armed = false;
+		if (!m_elapsed) return m_pass[0];
+		Nest nest = m_entry;
+		Clock::Cycle cycles = std::min(m_elapsed, m_limit + 1);   // at most, the last DECFSZ/INCFSZ has skipped
+		advance(m_start, m_end + 1, cycles, nest);
+		for (size_t n = 0; n < m_levels.size(); ++n)
+			a_cpu.write_sram(m_levels[n].counter, nest.counts[n]);
+		a_cpu.W = nest.W;
+		BYTE &status = a_cpu.sram.status();
+		status = nest.zero ? status | Flags::STATUS::Z : status & ~Flags::STATUS::Z;
+		m_resumed = pipeline(a_cpu, nest);
+		return m_resumed;
+	}
+	Clock::Cycle passes = m_elapsed / m_pass.size();
+	size_t offset = m_elapsed % m_pass.size();
+	if (m_step)
+		a_cpu.write_sram(m_counter, (BYTE)(m_count + m_step * passes + m_counted[offset]));
+	m_parked = false;
+	m_armed = false;    // the loop must prove itself again before we park it
+	return m_pass[offset];
+}
@@ -0,0 +1,125 @@
+#pragma once
+/*
+ * Firmware spends much of its time waiting.  Very often it does so by polling a register until
+ * some device changes it, as in "BTFSS PIR1,TMR1IF / GOTO $-1".  Executing such a loop one
+ * instruction at a time is correct, but it is also a great deal of work which changes nothing.
+ *
+ * A polling loop is a short backward jump over instructions which only read file registers:
+ * bit tests, MOVF f,w, NOP and GOTO.  Nothing the loop does changes its own inputs, so once
+ * one full pass has seen the same register values from beginning to end, every later pass
+ * will do exactly the same thing, until something outside the CPU changes one of them.
+ *
+ * So we record the state of the pipeline after every cycle of such a pass, and then "park"
+ * the loop, and stop executing instructions.  The moment anything might have changed an
+ * input, we restore the pipeline state for however many cycles have passed since, and
+ * carry on from exactly there, as if we had been executing all along.
+ *
+ * Delay loops, as in "DECFSZ count,f / GOTO $-1", are the same, but for one general purpose
+ * register which the loop counts.  Each pass moves the counter by one, so the counter after
+ * any number of cycles follows from the recorded pass, and we know how many passes remain
+ * before it reaches zero.  The loop is resumed just in time to execute the last of them.
+ *
+ * Longer delays nest such loops, each DECFSZ/INCFSZ followed by a GOTO back to the start of
+ * its own loop, which encloses the loops before it.  Between them there may be a CLRF, or a
+ * MOVLW/MOVWF pair, which sets an inner counter before its loop starts again, and NOP.  Such
+ * a nest touches only its counters, W and the Z flag, and reads nothing, so nothing need be
+ * recorded.  Once round, each level takes the same number of cycles, whatever the levels
+ * outside it are doing, so the nest parks as soon as it is entered, and the cycle count to
+ * the last pass of its outermost loop, or the counters, W, Z and pipeline at any cycle
+ * before that, follow by arithmetic, one level at a time.
+ */
+#include <vector>
+#include <string>
+#include "cpu_data.h"
+#include "instructions.h"
+
+//___________________________________________________________________________________
+// The fetch/execute pipeline between two instruction cycles
+struct Pipeline {
+	SmartPtr<Instruction> current;
+	WORD opcode;
+	WORD PC;
+	WORD execPC;
+	int  cycles;
+	bool skip;
+	std::string disassembled;
+};
+
+//___________________________________________________________________________________
+class WaitLoop {
+	enum Action { NOTHING, CLEAR, LOAD_W, STORE_W, COUNT, JUMP };   // what each instruction of a nest does
+	enum Stage { FETCHED, FLUSHED, SKIPPED };                        // and where the pipeline is
+
+	struct Level {                     // one DECFSZ/INCFSZ f,f of a nest, and the GOTO after it
+		WORD at;
+		WORD target;
+		BYTE counter;
+		int  step;
+		Clock::Cycle loop;             // cycles from one DECFSZ/INCFSZ to the next, going round
+	};
+
+	struct Nest {                      // a nest of delay loops at some cycle
+		std::vector<BYTE> counts;      // by level
+		BYTE W;
+		bool zero;
+		Stage stage;
+		WORD at;                       // the instruction fetched, flushed or skipped
+		WORD last;                     // and the one executed before it, or nop
+
+		bool stop(Stage a_stage, WORD a_at) { stage = a_stage; at = a_at; return true; }
+	};
+	static const WORD nop = 0xffff;
+
+	WORD m_start;
+	WORD m_end;
+	BYTE m_ports;                      // bit 0: reads PORTA; bit 1: reads PORTB
+	std::vector<BYTE> m_inputs;        // file registers read by the loop
+	std::vector<BYTE> m_values;        // what they held at the start of the recorded pass
+	std::vector<Pipeline> m_pass;      // pipeline state after each cycle of the pass
+	BYTE m_counter;                    // the register a delay loop counts
+	int  m_step;                       // -1 for DECFSZ, 1 for INCFSZ, or 0 if there is no counter
+	BYTE m_count;                      // the counter when we parked
+	std::vector<BYTE> m_counted;       // and how far it had moved after each cycle of the pass
+	bool m_armed;
+	bool m_parked;
+	bool m_disturbed;                  // something happened during the recorded pass
+	Clock::Cycle m_elapsed;            // cycles since we parked
+	Clock::Cycle m_limit;              // cycles we may stay parked, if there is a counter
+	std::vector<Level> m_levels;       // of a nest, innermost first
+	std::vector<std::pair<Action, int> > m_actions;   // by address, with a level or a literal
+	Nest m_entry;                      // the nest when we parked
+	Pipeline m_resumed;
+	DecodedFlash *m_flash;
+	SmartPtr<Instruction> m_nop;       // executed in place of a skipped instruction
+
+	bool recognise(DecodedFlash &a_flash, CPU_DATA &a_cpu, WORD a_start, WORD a_end);
+	bool recognise_nest(DecodedFlash &a_flash, CPU_DATA &a_cpu, WORD a_start, WORD a_end);
+	void sample(CPU_DATA &a_cpu, std::vector<BYTE> &a_values) const;
+	bool counted() const { return m_step || m_levels.size(); }
+	static Clock::Cycle to_zero(BYTE a_count, int a_step);   // how many steps take a counter to zero
+
+	bool park_nest(CPU_DATA &a_cpu, const Pipeline &a_now);
+	bool advance(WORD a_from, WORD a_to, Clock::Cycle &a_cycles, Nest &a_nest) const;
+	Pipeline pipeline(CPU_DATA &a_cpu, const Nest &a_nest);
+
+  public:
+	static const WORD longest = 12;    // instructions in a loop we will consider
+	static const size_t deepest = 4;   // levels in a nest, so that its cycles fit a Clock::Cycle
+
+	WaitLoop(): m_start(0), m_end(0), m_ports(0), m_counter(0), m_step(0), m_count(0),
+		m_armed(false), m_parked(false), m_disturbed(false), m_elapsed(0), m_limit(0), m_flash(NULL) {}
+
+	bool armed() const { return m_armed; }
+	bool parked() const { return m_parked; }
+	bool expired() const { return counted() && m_elapsed >= m_limit; }
+	bool remaining(Clock::Cycle &a_cycles) const;    // false if there is no limit
+	bool watches(const std::string &a_pin) const;
+
+	bool arm(DecodedFlash &a_flash, CPU_DATA &a_cpu, WORD a_start, WORD a_end);
+	void disarm();
+	bool observe(CPU_DATA &a_cpu, Pipeline a_now);   // true once parked
+	void disturb() { m_disturbed = true; }
+	bool changed(CPU_DATA &a_cpu) const;
+	void elapse(Clock::Cycle a_cycles) { m_elapsed += a_cycles; }
+	const Pipeline &resume(CPU_DATA &a_cpu);
+};
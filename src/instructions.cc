@@ -37,9 +37,11 @@
  */
 
 #include <iostream>
+#include <set>
 #include <cstdio>
 #include "cpu_data.h"
 #include "instructions.h"
+#include "alu.h"
 #include "utils/smart_ptr.cc"
 #include "utils/utility.h"
 #include "devices/constants.h"
@@ -58,111 +60,143 @@ const std::string Instruction::disasm(WORD opcode, CPU_DATA &cpu) {
 WORD Instruction::assemble(WORD f, BYTE b, bool d) {
 	return opcode;  // best effort
 }
+
+Handler Instruction::compile(WORD a_opcode, CPU_DATA &cpu) {
+	return [this, a_opcode](CPU_DATA &cpu) { return execute(a_opcode, cpu); };
+}
 // "\t" + cpu.register_name(idx) + std::string(to_file?",f":",w")  +"    \t; "
 
-class ADDWF: public Instruction {
+//___________________________________________________________________________________
+//  File register instructions all decode alike, and all read f, compute a result, and
+// write it to f or to W.  They differ only in the computation, which each supplies as
+//     static BYTE result(BYTE f, BYTE operand, BYTE &status);
+// together with the STATUS bits it affects.  The operand is W, or the bit for BCF/BSF.
+//  What costs most is reaching f.  A general purpose register is plain RAM, INDF is
+// always the same Register, and anything else must be looked up for the current bank.
+// So there is a handler for each destination and each kind of f; compile() chooses one
+// while the flash is decoded, and execute() chooses the same one as it goes.
+enum class FileTarget { GPR, INDF, SFR };
 
-  public:
-	ADDWF(): Instruction(0b00011100000000, 6, 1, "ADDWF", "Add W and f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
+template <FileTarget T> struct FileAccess {       // a special function register
+	static BYTE read(CPU_DATA &cpu, BYTE idx, Register *indf) { return cpu.read_sram(idx); }
+	static void write(CPU_DATA &cpu, BYTE idx, Register *indf, BYTE value) { cpu.write_sram(idx, value); }
+};
+
+template <> struct FileAccess<FileTarget::GPR> {
+	static BYTE read(CPU_DATA &cpu, BYTE idx, Register *indf) { return cpu.sram.gpr(idx); }
+	static void write(CPU_DATA &cpu, BYTE idx, Register *indf, BYTE value) { cpu.sram.gpr(idx) = value; }
+};
+
+template <> struct FileAccess<FileTarget::INDF> {
+	static BYTE read(CPU_DATA &cpu, BYTE idx, Register *indf) { return indf->read(cpu.sram); }
+	static void write(CPU_DATA &cpu, BYTE idx, Register *indf, BYTE value) { indf->write(cpu.sram, value); }
+};
+
+template <class Op, bool to_file, FileTarget T> struct FileHandler {
+	BYTE idx;
+	BYTE bit;
+	Register *indf;
+
+	static bool run(CPU_DATA &cpu, BYTE idx, BYTE bit, Register *indf) {
+		BYTE &status = cpu.sram.status();
+		BYTE flags = status;
+		BYTE result = Op::result(FileAccess<T>::read(cpu, idx, indf), Op::bitwise ? bit : (BYTE)cpu.W, flags);
+		if (to_file)
+			FileAccess<T>::write(cpu, idx, indf, result);
+		else
+			cpu.W = result;
+		status = (status & ~Op::affects) | (flags & Op::affects);
+		return Op::skips && result == 0;
 	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
+	bool operator()(CPU_DATA &cpu) const { return run(cpu, idx, bit, indf); }
+};
+
+template <class Op> class FileInstruction: public Instruction {
+	static FileTarget target(BYTE idx) {
+		if (idx == SRAM::INDF) return FileTarget::INDF;
+		return idx < 0x20 ? FileTarget::SFR : FileTarget::GPR;     // 0x20 and above is RAM in every bank
 	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		WORD ldata = (data & 0x0f) + (cpu.W & 0x0f);
-		data = data + cpu.W;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE C = data&0x100?Flags::STATUS::C:0;
-		BYTE DC = ldata&0x10?Flags::STATUS::DC:0;
 
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
+	template <bool to_file> static bool run(CPU_DATA &cpu, BYTE idx, BYTE bit) {
+		switch (target(idx)) {
+		  case FileTarget::GPR:  return FileHandler<Op, to_file, FileTarget::GPR>::run(cpu, idx, bit, NULL);
+		  case FileTarget::INDF: return FileHandler<Op, to_file, FileTarget::INDF>::run(cpu, idx, bit, &*cpu.Registers["INDF"]);
+		  default:               return FileHandler<Op, to_file, FileTarget::SFR>::run(cpu, idx, bit, NULL);
+		}
+	}
 
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
+	template <bool to_file> static Handler bind(CPU_DATA &cpu, BYTE idx, BYTE bit) {
+		switch (target(idx)) {
+		  case FileTarget::GPR:  return FileHandler<Op, to_file, FileTarget::GPR>{idx, bit, NULL};
+		  case FileTarget::INDF: return FileHandler<Op, to_file, FileTarget::INDF>{idx, bit, &*cpu.Registers["INDF"]};
+		  default:               return FileHandler<Op, to_file, FileTarget::SFR>{idx, bit, NULL};
 		}
-		status = (status & ~mask) | Z | C | DC ;
-		return false;
 	}
-};
 
-class ANDWF: public Instruction {
   public:
-	ANDWF(): Instruction(0b00010100000000, 6, 1, "ANDWF", "AND W with f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
+	static const bool bitwise = false;
+	static const bool skips = false;
+
+	FileInstruction(WORD a_opcode, BYTE a_bits, const std::string &a_mnemonic, const std::string &a_description):
+		Instruction(a_opcode, a_bits, 1, a_mnemonic, a_description) {}
+
+	inline void decode(WORD opcode, BYTE &idx, bool &to_file, BYTE &bit) {
 		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
+		to_file = Op::bitwise || (opcode & 0x80);
+		bit = 1 << ((opcode & 0x0380) >> 7);
 	};
 	virtual WORD assemble(WORD f, BYTE b, bool d) {
 		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
+		return (opcode & 0x3f80) | (f & 0xff);
 	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
+	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {   // CLRF and MOVWF have no d bit
+		BYTE idx, bit;
 		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
+		decode(opcode, idx, to_file, bit);
+		std::string destination = bits == 7 ? "" : to_file ? ",f" : ",w";
+		return mnemonic + pad(cpu.register_name(idx) + destination) + description;
 	}
 	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
+		BYTE idx, bit;
 		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		data = data & cpu.W;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return false;
+		decode(opcode, idx, to_file, bit);
+		return to_file ? run<true>(cpu, idx, bit) : run<false>(cpu, idx, bit);
+	}
+	virtual Handler compile(WORD opcode, CPU_DATA &cpu) {
+		BYTE idx, bit;
+		bool to_file;
+		decode(opcode, idx, to_file, bit);
+		return to_file ? bind<true>(cpu, idx, bit) : bind<false>(cpu, idx, bit);
 	}
 };
 
-class CLRF: public Instruction {
+class ADDWF: public FileInstruction<ADDWF> {
   public:
-	CLRF(): Instruction(0b00000110000000, 7, 1, "CLRF", "Clear f") {}
-	inline void decode(WORD opcode, BYTE &idx) {
-		idx = opcode & 0x7f;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return (opcode & 0x3f80) | (f & 0xff);
+	ADDWF(): FileInstruction(0b00011100000000, 6, "ADDWF", "Add W and f") {}
+	static const BYTE affects = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		return ALU::add(f, w, status);
 	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		decode(opcode, idx);
-		return mnemonic + pad(cpu.register_name(idx)) + description;
+};
+
+class ANDWF: public FileInstruction<ANDWF> {
+  public:
+	ANDWF(): FileInstruction(0b00010100000000, 6, "ANDWF", "AND W with f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f & w;
+		status = ALU::zero(data);
+		return data;
 	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		decode(opcode, idx);
-		BYTE Z = true;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-		cpu.read_sram(idx);
-		cpu.write_sram(idx, (BYTE)0);
-		status = (status & ~mask) | Z;
-		return false;
+};
+
+class CLRF: public FileInstruction<CLRF> {
+  public:
+	CLRF(): FileInstruction(0b00000110000000, 7, "CLRF", "Clear f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		status = Flags::STATUS::Z;
+		return 0;
 	}
 };
 
@@ -176,296 +210,106 @@ class CLRW: public Instruction {
 		return mnemonic + pad("") + description;
 	}
 	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE Z = true;
 		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-		status = (status & ~mask) | Z;
+		status |= Flags::STATUS::Z;
 		cpu.W = 0;
 		return false;
 	}
+	virtual Handler compile(WORD opcode, CPU_DATA &cpu) {
+		return [](CPU_DATA &cpu) {
+			cpu.sram.status() |= Flags::STATUS::Z;
+			cpu.W = 0;
+			return false;
+		};
+	}
 };
 
-class COMF: public Instruction {
+class COMF: public FileInstruction<COMF> {
   public:
-	COMF(): Instruction(0b00100100000000, 6, 1, "COMF", "Complement f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		data = ~data;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return false;
+	COMF(): FileInstruction(0b00100100000000, 6, "COMF", "Complement f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = ~f;
+		status = ALU::zero(data);
+		return data;
 	}
 };
 
-class DECF: public Instruction {
+class DECF: public FileInstruction<DECF> {
   public:
-	DECF(): Instruction(0b00001100000000, 6, 1, "DECF", "Decrement f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		--data;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return false;
+	DECF(): FileInstruction(0b00001100000000, 6, "DECF", "Decrement f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f - 1;
+		status = ALU::zero(data);
+		return data;
 	}
 };
 
-class DECFSZ: public Instruction {
+class DECFSZ: public FileInstruction<DECFSZ> {
   public:
-	DECFSZ(): Instruction(0b00101100000000, 6, 1, "DECFSZ", "Decrement f, Skip if 0") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		--data;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return Z != 0;
+	DECFSZ(): FileInstruction(0b00101100000000, 6, "DECFSZ", "Decrement f, Skip if 0") {}
+	static const bool skips = true;
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f - 1;
+		status = ALU::zero(data);
+		return data;
 	}
 };
 
-class INCF: public Instruction {
+class INCF: public FileInstruction<INCF> {
   public:
-	INCF(): Instruction(0b00101000000000, 6, 1, "INCF", "Increment f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = (opcode & 0x80) != 0;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		++data;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return false;
+	INCF(): FileInstruction(0b00101000000000, 6, "INCF", "Increment f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f + 1;
+		status = ALU::zero(data);
+		return data;
 	}
 };
 
-class INCFSZ: public Instruction {
+class INCFSZ: public FileInstruction<INCFSZ> {
   public:
-	INCFSZ(): Instruction(0b00111100000000, 6, 1, "INCFSZ", "Increment f, Skip if 0") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		--data;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return Z != 0;
+	INCFSZ(): FileInstruction(0b00111100000000, 6, "INCFSZ", "Increment f, Skip if 0") {}
+	static const bool skips = true;
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f + 1;
+		status = ALU::zero(data);
+		return data;
 	}
 };
 
-class IORWF: public Instruction {
+class IORWF: public FileInstruction<IORWF> {
   public:
-	IORWF(): Instruction(0b00010000000000, 6, 1, "IORWF", "Inclusive OR W with f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		data = data | cpu.W;
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return false;
+	IORWF(): FileInstruction(0b00010000000000, 6, "IORWF", "Inclusive OR W with f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f | w;
+		status = ALU::zero(data);
+		return data;
 	}
 };
 
 
-class MOVF: public Instruction {
+class MOVF: public FileInstruction<MOVF> {
   public:
-	MOVF(): Instruction(0b00100000000000, 6, 1, "MOVF", "Move f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
-		return false;
+	MOVF(): FileInstruction(0b00100000000000, 6, "MOVF", "Move f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		status = ALU::zero(f);
+		return f;
 	}
 };
 
 
-class MOVWF: public Instruction {
+class MOVWF: public FileInstruction<MOVWF> {
   public:
-	MOVWF(): Instruction(0b00000010000000, 7, 1, "MOVWF", "Move W to f") {}
-	inline void decode(WORD opcode, BYTE &idx) {
-		idx = opcode & 0x7f;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return (opcode & 0x3f80) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		decode(opcode, idx);
-		return mnemonic + pad(cpu.register_name(idx)) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		decode(opcode, idx);
-		WORD data = cpu.W;
-		cpu.read_sram(idx);
-		cpu.write_sram(idx, data & 0xff);
-		return false;
+	MOVWF(): FileInstruction(0b00000010000000, 7, "MOVWF", "Move W to f") {}
+	static const BYTE affects = 0;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		return w;
 	}
 };
 
@@ -474,203 +318,87 @@ class NOP: public Instruction {
   public:
 	NOP(): Instruction(0b00000000000000, 14, 1, "NOP", "No Operation") {}
 	virtual bool execute(WORD opcode, CPU_DATA &cpu) { return false; }
+	virtual Handler compile(WORD opcode, CPU_DATA &cpu) {
+		return [](CPU_DATA &cpu) { return false; };
+	}
 };
 
 
-class RLF: public Instruction {
+class RLF: public FileInstruction<RLF> {
   public:
-	RLF(): Instruction(0b00110100000000, 6, 1, "RLF", "Rotate Left f through Carry") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		BYTE &status = cpu.sram.status();
-		data = data << 1;
-		if (status & Flags::STATUS::C) data |= 1;
-
-		BYTE C = data&0x100?Flags::STATUS::C:0;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~Flags::STATUS::C) | C;
-		return false;
+	RLF(): FileInstruction(0b00110100000000, 6, "RLF", "Rotate Left f through Carry") {}
+	static const BYTE affects = Flags::STATUS::C;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f << 1 | (status & Flags::STATUS::C);
+		status = f >> 7;
+		return data;
 	}
 };
 
-class RRF: public Instruction {
+class RRF: public FileInstruction<RRF> {
   public:
-	RRF(): Instruction(0b00110000000000, 6, 1, "RRF", "Rotate Right f through Carry") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		BYTE &status = cpu.sram.status();
-		BYTE C = data&0x01?Flags::STATUS::C:0;
-		data = data >> 1;
-
-		if (status & Flags::STATUS::C) data |= 0x80;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~Flags::STATUS::C) | C;
-		return false;
+	RRF(): FileInstruction(0b00110000000000, 6, "RRF", "Rotate Right f through Carry") {}
+	static const BYTE affects = Flags::STATUS::C;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f >> 1 | (status & Flags::STATUS::C) << 7;
+		status = f & Flags::STATUS::C;
+		return data;
 	}
 };
 
-class SUBWF: public Instruction {
+class SUBWF: public FileInstruction<SUBWF> {
   public:
-	SUBWF(): Instruction(0b00001000000000, 6, 1, "SUBWF", "Subtract W from f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		bool lborrow = (data & 0x0f) < (cpu.W & 0x0f);
-		bool borrow = data < cpu.W;
-
-		data = borrow?0x100 + data - cpu.W:data - cpu.W;
-
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE C = borrow?Flags::STATUS::C:0;
-		BYTE DC = lborrow?Flags::STATUS::DC:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z | C | DC ;
-		return false;
+	SUBWF(): FileInstruction(0b00001000000000, 6, "SUBWF", "Subtract W from f") {}
+	static const BYTE affects = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		return ALU::sub(f, w, status);
 	}
 };
 
 
-class SWAPF: public Instruction {
+class SWAPF: public FileInstruction<SWAPF> {
   public:
-	SWAPF(): Instruction(0b00111000000000, 6, 1, "SWAPF", "Swap nibbles in f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		data = (data << 4) + (data >> 4);
-
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		return false;
+	SWAPF(): FileInstruction(0b00111000000000, 6, "SWAPF", "Swap nibbles in f") {}
+	static const BYTE affects = 0;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		return (f << 4) | (f >> 4);
 	}
 };
 
-class XORWF: public Instruction {
+class XORWF: public FileInstruction<XORWF> {
   public:
-	XORWF(): Instruction(0b00011000000000, 6, 1, "XORWF", "Exclusive OR W with f") {}
-	inline void decode(WORD opcode, BYTE &idx, bool &to_file) {
-		idx = opcode & 0x7f;
-		to_file = opcode & 0x80;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		if (d) f |= 0x80;
-		return (opcode & 0x3f00) | (f & 0xff);
+	XORWF(): FileInstruction(0b00011000000000, 6, "XORWF", "Exclusive OR W with f") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE f, BYTE w, BYTE &status) {
+		BYTE data = f ^ w;
+		status = ALU::zero(data);
+		return data;
 	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		return mnemonic + pad(cpu.register_name(idx) + std::string(to_file?",f":",w")) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		bool to_file;
-		decode(opcode, idx, to_file);
-		WORD data = cpu.read_sram(idx);
-		BYTE &status = cpu.sram.status();
-		data = data ^ cpu.W;
+};
 
-		BYTE Z = data==0?Flags::STATUS::Z:0;
-		BYTE mask = Flags::STATUS::Z;
+//___________________________________________________________________________________
+//  Literal instructions combine W with the literal in their OP code, and leave the
+// result in W.  Like the file register instructions, each supplies only
+//     static BYTE result(BYTE literal, BYTE w, BYTE &status);
+// and the STATUS bits it affects.  compile() decodes the literal once, into a handler.
+template <class Op> struct LiteralHandler {
+	BYTE literal;
 
-		if (to_file) {
-			cpu.write_sram(idx, data & 0xff);
-		} else {
-			cpu.W = data & 0xff;
-		}
-		status = (status & ~mask) | Z;
+	static bool run(CPU_DATA &cpu, BYTE literal) {
+		BYTE &status = cpu.sram.status();
+		BYTE flags = status;
+		cpu.W = Op::result(literal, cpu.W, flags);
+		status = (status & ~Op::affects) | (flags & Op::affects);
 		return false;
 	}
+	bool operator()(CPU_DATA &cpu) const { return run(cpu, literal); }
 };
 
-class MOVLW: public Instruction {
+template <class Op> class LiteralInstruction: public Instruction {
   public:
-	MOVLW(): Instruction(0b11000000000000, 4, 1, "MOVLW", "Move literal to W") {}
+	LiteralInstruction(WORD a_opcode, BYTE a_bits, const std::string &a_mnemonic, const std::string &a_description):
+		Instruction(a_opcode, a_bits, 1, a_mnemonic, a_description) {}
+
 	inline void decode(WORD opcode, BYTE &literal) {
 		literal = opcode & 0xff;
 	};
@@ -685,11 +413,23 @@ class MOVLW: public Instruction {
 	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
 		BYTE literal;
 		decode(opcode, literal);
-		cpu.W = literal;
-		return false;
+		return LiteralHandler<Op>::run(cpu, literal);
+	}
+	virtual Handler compile(WORD opcode, CPU_DATA &cpu) {
+		BYTE literal;
+		decode(opcode, literal);
+		return LiteralHandler<Op>{literal};
 	}
 };
 
+class MOVLW: public LiteralInstruction<MOVLW> {
+  public:
+	MOVLW(): LiteralInstruction(0b11000000000000, 4, "MOVLW", "Move literal to W") {}
+	static const BYTE affects = 0;
+	static BYTE result(BYTE literal, BYTE w, BYTE &status) {
+		return literal;
+	}
+};
 class RETLW: public Instruction {
   public:
 	RETLW(): Instruction(0b11010000000000, 4, 2, "RETLW", "Return with literal in W") {}
@@ -714,157 +454,60 @@ class RETLW: public Instruction {
 	}
 };
 
-class SUBLW: public Instruction {
+class SUBLW: public LiteralInstruction<SUBLW> {
   public:
-	SUBLW(): Instruction(0b11110000000000, 5, 1, "SUBLW", "Subtract W from literal") {}
-	inline void decode(WORD opcode, BYTE &literal) {
-		literal = opcode & 0xff;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return opcode | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-		return mnemonic + pad(int_to_hex(literal)) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-
-		bool lborrow = (literal & 0x0f) < (cpu.W & 0x0f);
-		bool borrow = literal < cpu.W;
-
-		cpu.W = borrow?0x100 + literal - cpu.W:literal - cpu.W;
-
-		BYTE Z = cpu.W==0?Flags::STATUS::Z:0;
-		BYTE C = borrow?Flags::STATUS::C:0;
-		BYTE DC = lborrow?Flags::STATUS::DC:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
-
-		status = (status & ~mask) | Z | C | DC ;
-		return false;
+	SUBLW(): LiteralInstruction(0b11110000000000, 5, "SUBLW", "Subtract W from literal") {}
+	static const BYTE affects = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
+	static BYTE result(BYTE literal, BYTE w, BYTE &status) {
+		return ALU::sub(literal, w, status);
 	}
 };
-
-class ADDLW: public Instruction {
+class ADDLW: public LiteralInstruction<ADDLW> {
   public:
-	ADDLW(): Instruction(0b11111000000000, 5, 1, "ADDLW", "Add literal and W") {}
-	inline void decode(WORD opcode, BYTE &literal) {
-		literal = opcode & 0xff;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return opcode | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-		return mnemonic + pad(int_to_hex(literal)) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-
-		WORD data = (WORD)literal + cpu.W;
-		bool dcarry = (literal & 0x0f) + (cpu.W & 0x0f) > 0xf;
-		bool carry = (data & 0x100) == 0x100;
-
-		cpu.W = data & 0xff;
-		BYTE Z = cpu.W==0?Flags::STATUS::Z:0;
-		BYTE C = carry?Flags::STATUS::C:0;
-		BYTE DC = dcarry?Flags::STATUS::DC:0;
-		BYTE &status = cpu.sram.status();
-		BYTE mask = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
-		status = (status & ~mask) | Z | C | DC ;
-		return false;
+	ADDLW(): LiteralInstruction(0b11111000000000, 5, "ADDLW", "Add literal and W") {}
+	static const BYTE affects = Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC;
+	static BYTE result(BYTE literal, BYTE w, BYTE &status) {
+		return ALU::add(literal, w, status);
 	}
 };
-
-class XORLW: public Instruction {
+class XORLW: public LiteralInstruction<XORLW> {
   public:
-	XORLW(): Instruction(0b11101000000000, 6, 1, "XORLW", "Exclusive OR literal with W") {}
-	inline void decode(WORD opcode, BYTE &literal) {
-		literal = opcode & 0xff;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return opcode | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-		return mnemonic + pad(int_to_hex(literal)) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-
-		cpu.W = literal ^ cpu.W;
-
-		BYTE Z = cpu.W==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		status = (status & ~Flags::STATUS::Z) | Z;
-		return false;
+	XORLW(): LiteralInstruction(0b11101000000000, 6, "XORLW", "Exclusive OR literal with W") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE literal, BYTE w, BYTE &status) {
+		BYTE data = literal ^ w;
+		status = ALU::zero(data);
+		return data;
 	}
 };
-
-class IORLW: public Instruction {
+class IORLW: public LiteralInstruction<IORLW> {
   public:
-	IORLW(): Instruction(0b11100000000000, 6, 1, "IORLW", "Inclusive OR literal with W") {}
-	inline void decode(WORD opcode, BYTE &literal) {
-		literal = opcode & 0xff;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return opcode | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-		return mnemonic + pad(int_to_hex(literal)) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-
-		cpu.W = literal | cpu.W;
-
-		BYTE Z = cpu.W==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		status = (status & ~Flags::STATUS::Z) | Z;
-		return false;
+	IORLW(): LiteralInstruction(0b11100000000000, 6, "IORLW", "Inclusive OR literal with W") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE literal, BYTE w, BYTE &status) {
+		BYTE data = literal | w;
+		status = ALU::zero(data);
+		return data;
 	}
 };
-
-class ANDLW: public Instruction {
+class ANDLW: public LiteralInstruction<ANDLW> {
   public:
-	ANDLW(): Instruction(0b11100100000000, 6, 1, "ANDLW", "AND literal with W") {}
-	inline void decode(WORD opcode, BYTE &literal) {
-		literal = opcode & 0xff;
-	};
-	virtual WORD assemble(WORD f, BYTE b, bool d) {
-		return opcode | (f & 0xff);
-	}
-	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-		return mnemonic + pad(int_to_hex(literal)) + description;
-	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE literal;
-		decode(opcode, literal);
-
-		cpu.W = literal & cpu.W;
-
-		BYTE Z = cpu.W==0?Flags::STATUS::Z:0;
-		BYTE &status = cpu.sram.status();
-		status = (status & ~Flags::STATUS::Z) | Z;
-		return false;
+	ANDLW(): LiteralInstruction(0b11100100000000, 6, "ANDLW", "AND literal with W") {}
+	static const BYTE affects = Flags::STATUS::Z;
+	static BYTE result(BYTE literal, BYTE w, BYTE &status) {
+		BYTE data = literal & w;
+		status = ALU::zero(data);
+		return data;
 	}
 };
-
-class BCF: public Instruction {
+class BCF: public FileInstruction<BCF> {
   public:
-	BCF(): Instruction(0b01000000000000, 4, 1, "BCF", "Bit Clear f") {}
+	BCF(): FileInstruction(0b01000000000000, 4, "BCF", "Bit Clear f") {}
+	static const bool bitwise = true;
+	static const BYTE affects = 0;
+	static BYTE result(BYTE f, BYTE bit, BYTE &status) {
+		return f & ~bit;
+	}
 	inline void decode(WORD opcode, BYTE &idx, BYTE &cbits) {
 		idx   = opcode & 0x7f;
 		cbits = (opcode & 0x0380) >> 7;
@@ -886,21 +529,16 @@ class BCF: public Instruction {
 		const std::string bitname = Flags::bit_name_for_register_bit(bank+idx, cbits);
 		return mnemonic + pad(cpu.register_name(idx) + "," + (bitname.length()?bitname:int_to_string(cbits))) + description;
 	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		BYTE cbits;
-		decode(opcode, idx, cbits);
-		cbits = 1 << cbits;
-		BYTE data = cpu.read_sram(idx);
-		data = data & ~cbits;
-		cpu.write_sram(idx, data);
-		return false;
-	}
 };
 
-class BSF: public Instruction {
+class BSF: public FileInstruction<BSF> {
   public:
-	BSF(): Instruction(0b01010000000000, 4, 1, "BSF", "Bit Set f") {}
+	BSF(): FileInstruction(0b01010000000000, 4, "BSF", "Bit Set f") {}
+	static const bool bitwise = true;
+	static const BYTE affects = 0;
+	static BYTE result(BYTE f, BYTE bit, BYTE &status) {
+		return f | bit;
+	}
 	inline void decode(WORD opcode, BYTE &idx, BYTE &cbits) {
 		idx   = opcode & 0x7f;
 		cbits = (opcode & 0x0380) >> 7;
@@ -921,16 +559,6 @@ class BSF: public Instruction {
 		const std::string bitname = Flags::bit_name_for_register_bit(bank+idx, cbits);
 		return mnemonic + pad(cpu.register_name(idx) + "," + (bitname.length()?bitname:int_to_string(cbits))) + description;
 	}
-	virtual bool execute(WORD opcode, CPU_DATA &cpu) {
-		BYTE idx;
-		BYTE cbits;
-		decode(opcode, idx, cbits);
-		cbits = 1 << cbits;
-		WORD data = cpu.read_sram(idx);
-		data = data | cbits;
-		cpu.write_sram(idx, data);
-		return false;
-	}
 };
 
 class BTFSC: public Instruction {
@@ -1092,6 +720,7 @@ class SLEEP: public Instruction {
 		BYTE mask = Flags::STATUS::TO | Flags::STATUS::PD;
 		status = (status & ~mask) | Flags::STATUS::TO;
 		cpu.wdt.sleep();
+		cpu.clock.sleep();     // the oscillator stops until something wakes us
 		return false;
 	}
 };
@@ -1217,3 +846,56 @@ InstructionSet::InstructionSet() {
 		}
 	}
 }
+
+void DecodedFlash::refresh() {
+	if (m_version == m_flash.version() && m_entries.size() == m_flash.size()) return;
+	m_entries.assign(m_flash.size(), Entry());
+	m_blocks.assign(m_flash.size(), Block());
+	m_version = m_flash.version();
+}
+
+SmartPtr<Instruction> &DecodedFlash::at(WORD a_address) {
+	refresh();
+	Entry &entry = m_entries[m_flash.wrap(a_address)];
+	if (!entry.decoded) {
+		entry.instruction = m_instructions.find(m_flash.fetch(a_address));
+		entry.decoded = true;
+	}
+	return entry.instruction;
+}
+
+bool DecodedFlash::straight(const Instruction &a_instruction, WORD a_opcode, CPU_DATA &a_cpu) {
+	static const std::set<std::string> literal({"NOP", "CLRW", "MOVLW", "ADDLW", "ANDLW", "IORLW", "SUBLW", "XORLW"});
+	static const std::set<std::string> file({
+		"ADDWF", "ANDWF", "CLRF", "COMF", "DECF", "INCF", "IORWF", "MOVF", "MOVWF",
+		"RLF", "RRF", "SUBWF", "SWAPF", "XORWF", "BCF", "BSF"});
+
+	if (literal.find(a_instruction.mnemonic) != literal.end()) return true;
+	if (file.find(a_instruction.mnemonic) == file.end()) return false;
+	WORD index = a_cpu.sram.calc_index(a_opcode & 0x7f, false);
+	return a_cpu.RegisterNames.find((BYTE)index) == a_cpu.RegisterNames.end() && (index % 0x80) >= 0x20;
+}
+
+bool DecodedFlash::valid(const Block &a_block, CPU_DATA &a_cpu) {
+	return a_block.compiled && a_block.bank == a_cpu.sram.bank();
+}
+
+void DecodedFlash::compile(Block &a_block, WORD a_address, CPU_DATA &a_cpu) {
+	a_block.compiled = true;
+	a_block.bank = a_cpu.sram.bank();
+	a_block.steps.clear();
+	for (WORD pc = a_address; pc < m_flash.size() && a_block.steps.size() < longest; ++pc) {
+		WORD opcode = m_flash.fetch(pc);
+		SmartPtr<Instruction> &instruction = at(pc);
+		if (!instruction || !straight(*instruction, opcode, a_cpu)) break;
+		a_block.steps.push_back(instruction->compile(opcode, a_cpu));
+	}
+}
+
+const DecodedFlash::Block &DecodedFlash::block(WORD a_address, CPU_DATA &a_cpu) {
+	refresh();
+	a_address = m_flash.wrap(a_address);
+	Block &block = m_blocks[a_address];
+	if (!valid(block, a_cpu)) compile(block, a_address, a_cpu);
+	return block;
+}
@@ -19,11 +19,15 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <functional>
 
 #include "utils/smart_ptr.h"
 #include "devices/constants.h"
 #include "cpu_data.h"
 
+// An instruction bound to its operands, ready to execute.  Returns true to skip the next.
+typedef std::function<bool(CPU_DATA &)> Handler;
+
 //___________________________________________________________________________________
 // A CPU instruction.
 class Instruction {
@@ -45,6 +49,7 @@ public:
 	virtual bool execute(WORD opcode, CPU_DATA &cpu){ throw(std::string("Unimplemented Instruction")); }
 	virtual const std::string disasm(WORD opcode, CPU_DATA &cpu);
 	virtual WORD assemble(WORD f, BYTE b, bool d);
+	virtual Handler compile(WORD opcode, CPU_DATA &cpu);
 	bool flush() { return(cycles > 1); }
 };
 
@@ -72,4 +77,51 @@ class InstructionSet {
 	WORD assemble(const std::string &mnemonic, WORD f, WORD b, bool d);
 };
 
+//___________________________________________________________________________________
+// Flash, decoded.  Finding an instruction walks the tree one OP code bit at a time,
+// so we do that once per address, and again only once the flash has been written.
+//  Straight-line code which touches nothing but W, STATUS flags and general purpose
+// registers cannot affect any device, nor be affected by one.  We compile such a basic
+// block into a list of handlers, which may run one after the other in a single call.
+// A block ends before any branch, skip, or access to a special function register.  It
+// is only good for the register bank it was compiled in.  Every write to the flash
+// changes its version(), and we drop all we have decoded when we next see that.
+class DecodedFlash {
+	struct Entry {
+		bool decoded;
+		SmartPtr<Instruction> instruction;
+		Entry(): decoded(false) {}
+	};
+
+  public:
+	struct Block {
+		bool compiled;
+		BYTE bank;
+		std::vector<Handler> steps;      // one per instruction cycle
+		Block(): compiled(false), bank(0) {}
+	};
+	static const WORD longest = 16;      // instructions in a block
+
+  private:
+	InstructionSet &m_instructions;
+	Flash &m_flash;
+	std::vector<Entry> m_entries;
+	std::vector<Block> m_blocks;
+	unsigned long m_version = 0;     // of the flash they were decoded from
+
+	void refresh();
+
+	bool straight(const Instruction &a_instruction, WORD a_opcode, CPU_DATA &a_cpu);
+	bool valid(const Block &a_block, CPU_DATA &a_cpu);
+	void compile(Block &a_block, WORD a_address, CPU_DATA &a_cpu);
+
+  public:
+	DecodedFlash(InstructionSet &a_instructions, Flash &a_flash): m_instructions(a_instructions), m_flash(a_flash) {}
+
+	SmartPtr<Instruction> &at(WORD a_address);
+	SmartPtr<Instruction> find(WORD a_opcode) { return m_instructions.find(a_opcode); }   // not from the flash
+	const Block &block(WORD a_address, CPU_DATA &a_cpu);
+	void clear() { m_entries.clear(); m_blocks.clear(); }
+};
+
 #endif
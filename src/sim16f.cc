@@ -86,6 +86,9 @@ int main(int argc, char *argv[]) {
 		std::cout << "    -r              - run the emulator\n";
 		std::cout << "    -g              - run the emulator in debug mode\n";
 		std::cout << "    -m model        - select the kind of processor [default 16f628a]\n";
+		std::cout << "    -s device       - connect the USART to 'pty' (a new pseudo-terminal), a terminal,\n";
+		std::cout << "                      a named pipe or a file.\n";
+		std::cout << "    -S filename     - read USART input from a named pipe or file.\n";
 		std::cout << "\n";
 		std::cout << "Options may be used together.  For example,\n";
 		std::cout << "  'sim16f -c 0x10,0x20 -a test.a -e 0x10,0x20 -u -o test.hex'\n";
@@ -139,6 +142,9 @@ int main(int argc, char *argv[]) {
 		if (cmdline.cmdOptionExists("-e")) {
 			cpu.load_eeprom(cmdline.getCmdOption("-e"));
 		}
+		if (cmdline.cmdOptionExists("-s")) {
+			cpu.serial(cmdline.getCmdOption("-s"), cmdline.getCmdOption("-S"));
+		}
 		if (cmdline.cmdOptionExists("-o")) {
 			outfile = cmdline.getCmdOption("-o");
 		}
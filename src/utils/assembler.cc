@@ -218,7 +218,7 @@ bool assemble(const std::string &a_filename, CPU_DATA &cpu, InstructionSet &inst
 								WORD opcode = instructions.assemble("RETLW", waddr, 0, false);
 								SmartPtr<Instruction> op = instructions.find(opcode);   // check
 								if (!op || op->mnemonic != mnemonic) throw(std::string("Error while checking assembly: ") + mnemonic);
-								cpu.flash.data[PC] = opcode;
+								cpu.flash.write(PC, opcode);
 								++PC;  // all instructions are single word
 								if (PC > cpu.flash.size())
 									throw(std::string("PC exceeds device limits: @") + int_to_hex(PC));
@@ -238,7 +238,7 @@ bool assemble(const std::string &a_filename, CPU_DATA &cpu, InstructionSet &inst
 						if (pass) { // write flash data on second pass
 							std::vector<WORD> DD = as_numbers(address, args, radix, std::string("Invalid DATA directive: [")+address+"] @"+int_to_hex(PC));
 							for (WORD data: DD) {
-								cpu.flash.data[PC] = data;
+								cpu.flash.write(PC, data);
 								++PC;  // Increment EE offset counter
 								if (PC > cpu.flash.size())
 									throw(std::string("PC exceeds device limits: @") + int_to_hex(PC));
@@ -326,7 +326,7 @@ bool assemble(const std::string &a_filename, CPU_DATA &cpu, InstructionSet &inst
 							WORD opcode = instructions.assemble(mnemonic, waddr, warg, to_file);
 							SmartPtr<Instruction> op = instructions.find(opcode);   // check
 							if (!op || op->mnemonic != mnemonic) throw(std::string("Error while checking assembly: ") + mnemonic);
-							cpu.flash.data[PC] = opcode;
+							cpu.flash.write(PC, opcode);
 						}
 						++PC;  // all instructions are single word
 					}
@@ -0,0 +1,61 @@
+/*
+ * disjoint_sets.h
+ *
+ *  Union-find over any ordered key.
+ */
+#pragma once
+
+#include <map>
+
+//___________________________________________________________________________________
+//  Each member belongs to exactly one set, named by one of its members.  unite() merges
+// two sets, and find() names the set of a member.  Paths are halved as they are found,
+// and the smaller set is merged into the larger, so both are close to constant time.
+template <class T> class DisjointSets {
+	struct Entry {
+		T parent;
+		size_t size;
+	};
+	std::map<T, Entry> m_entries;
+
+	Entry &entry(const T &a_member) {
+		auto found = m_entries.find(a_member);
+		if (found == m_entries.end())
+			found = m_entries.insert({a_member, Entry{a_member, 1}}).first;
+		return found->second;
+	}
+
+  public:
+	bool contains(const T &a_member) const { return m_entries.find(a_member) != m_entries.end(); }
+	void add(const T &a_member) { entry(a_member); }
+	void clear() { m_entries.clear(); }
+	size_t members() const { return m_entries.size(); }
+
+	T find(const T &a_member) {
+		T at = a_member;
+		while (true) {
+			Entry &e = entry(at);
+			if (e.parent == at) return at;
+			Entry &up = entry(e.parent);
+			e.parent = up.parent;
+			at = up.parent;
+		}
+	}
+
+	// the name of the merged set
+	T unite(const T &a, const T &b) {
+		T ra = find(a), rb = find(b);
+		if (ra == rb) return ra;
+		Entry &ea = entry(ra), &eb = entry(rb);
+		if (ea.size < eb.size) {
+			ea.parent = rb;
+			eb.size += ea.size;
+			return rb;
+		}
+		eb.parent = ra;
+		ea.size += eb.size;
+		return ra;
+	}
+
+	size_t size(const T &a_member) { return entry(find(a_member)).size; }   // members in its set
+};
@@ -0,0 +1,185 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "host_stream.h"
+
+HostStream::HostStream(const std::string &a_output, const std::string &a_input):
+		m_in(-1), m_out(-1), m_name(a_output), m_running(false) {
+	if (a_output == "pty") {
+		int fd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+			if (fd >= 0) close(fd);
+			throw(std::string("Cannot create a pseudo-terminal"));
+		}
+		struct termios raw;
+		if (tcgetattr(fd, &raw) == 0) {     // pass bytes through unchanged
+			cfmakeraw(&raw);
+			tcsetattr(fd, TCSANOW, &raw);
+		}
+		m_name = ptsname(fd);
+		m_in = m_out = fd;
+	} else {
+		struct stat st;
+		bool exists = stat(a_output.c_str(), &st) == 0;
+		if (exists && S_ISCHR(st.st_mode)) {            // a terminal goes both ways
+			m_out = open(a_output.c_str(), O_RDWR | O_NOCTTY);
+			if (a_input.empty()) m_in = m_out;
+		} else if (exists && S_ISFIFO(st.st_mode)) {    // read/write, so that we need not wait for a reader
+			m_out = open(a_output.c_str(), O_RDWR);
+		} else {
+			m_out = open(a_output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		}
+		if (m_out < 0)
+			throw(std::string("Cannot open host stream: ") + a_output);
+	}
+	if (a_input.length() && m_in < 0) {
+		m_in = open(a_input.c_str(), O_RDONLY | O_NONBLOCK | O_NOCTTY);
+		if (m_in < 0)
+			throw(std::string("Cannot open host stream: ") + a_input);
+	}
+	fcntl(m_out, F_SETFL, fcntl(m_out, F_GETFL) | O_NONBLOCK);
+	if (m_in >= 0) fcntl(m_in, F_SETFL, fcntl(m_in, F_GETFL) | O_NONBLOCK);
+
+	if (pipe(m_wake) < 0)
+		throw(std::string("Cannot create a pipe for the host stream"));
+	fcntl(m_wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(m_wake[1], F_SETFL, O_NONBLOCK);
+
+	m_running = true;
+	m_thread = std::thread(&HostStream::run, this);
+}
+
+HostStream::~HostStream() {
+	flush();
+	m_running = false;
+	char c = 0;
+	if (::write(m_wake[1], &c, 1)) {}
+	if (m_thread.joinable()) m_thread.join();
+	close(m_wake[0]);
+	close(m_wake[1]);
+	if (m_in >= 0 && m_in != m_out) close(m_in);
+	close(m_out);
+}
+
+void HostStream::write(unsigned char a_byte) {
+	bool was_empty;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		was_empty = m_sending.empty();
+		m_sending.push_back(a_byte);
+	}
+	if (was_empty) {
+		char c = 0;
+		if (::write(m_wake[1], &c, 1)) {}
+	}
+}
+
+bool HostStream::read(unsigned char &a_byte) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_received.empty()) return false;
+	a_byte = m_received.front();
+	m_received.pop_front();
+	return true;
+}
+
+size_t HostStream::available() {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_received.size();
+}
+
+void HostStream::flush(unsigned long a_timeout_us) {
+	auto expire = std::chrono::steady_clock::now() + std::chrono::microseconds(a_timeout_us);
+	while (m_running && std::chrono::steady_clock::now() < expire) {
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			if (m_sending.empty()) return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void HostStream::on_input(std::function<void()> a_callback) {
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_on_input = a_callback;
+}
+
+bool HostStream::pump_input() {    // false if the host has gone away
+	unsigned char buf[4096];
+	ssize_t n = ::read(m_in, buf, sizeof(buf));
+	if (n > 0) {
+		std::function<void()> notify;
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_received.insert(m_received.end(), buf, buf + n);
+			notify = m_on_input;
+		}
+		if (notify) notify();
+		return true;
+	}
+	return n < 0 && (errno == EAGAIN || errno == EINTR);
+}
+
+bool HostStream::pump_output() {   // false if the host cannot take data
+	std::vector<unsigned char> chunk;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		size_t len = std::min(m_sending.size(), (size_t)4096);
+		chunk.assign(m_sending.begin(), m_sending.begin() + len);
+	}
+	if (chunk.empty()) return true;
+	ssize_t n = ::write(m_out, chunk.data(), chunk.size());
+	if (n > 0) {
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_sending.erase(m_sending.begin(), m_sending.begin() + n);
+		return true;
+	}
+	return n < 0 && (errno == EAGAIN || errno == EINTR);
+}
+
+void HostStream::run() {
+	while (m_running) {
+		bool sending;
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			sending = !m_sending.empty();
+		}
+		struct pollfd fds[3];
+		int nfds = 0;
+		fds[nfds++] = {m_wake[0], POLLIN, 0};
+		int out_idx = -1, in_idx = -1;
+		if (m_in >= 0) {
+			in_idx = nfds;
+			fds[nfds++] = {m_in, POLLIN, 0};
+		}
+		if (sending) {
+			if (m_out == m_in) {
+				fds[in_idx].events |= POLLOUT;
+				out_idx = in_idx;
+			} else {
+				out_idx = nfds;
+				fds[nfds++] = {m_out, POLLOUT, 0};
+			}
+		}
+
+		if (poll(fds, nfds, 100) <= 0) continue;
+
+		if (fds[0].revents & POLLIN) {
+			char drain[64];
+			while (::read(m_wake[0], drain, sizeof(drain)) > 0) {}
+		}
+		bool ok = true;
+		if (in_idx >= 0 && (fds[in_idx].revents & POLLIN))
+			ok = pump_input() && ok;
+		if (out_idx >= 0 && (fds[out_idx].revents & POLLOUT))
+			ok = pump_output() && ok;
+		if (!ok || (in_idx >= 0 && (fds[in_idx].revents & (POLLHUP | POLLERR))))
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));   // nobody on the other end yet
+	}
+}
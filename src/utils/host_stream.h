@@ -0,0 +1,54 @@
+#pragma once
+//______________________________________________________________________________________________
+//  A byte stream between the simulator and the host, used by the USART.
+//
+//  The simulation must never wait on the host, so bytes are buffered in both directions,
+// and a separate thread moves them to and from the host using non-blocking I/O.  Writing
+// a byte only appends it to a buffer, and reading only takes one from a buffer.
+//
+//  The output path may be:
+//     "pty"            - a new pseudo-terminal is created for both directions; name()
+//                        reports its slave device.
+//     a terminal       - used for both directions (eg. /dev/pts/3).
+//     a named pipe     - receives what we write.
+//     any other file   - is created or truncated, and receives what we write.
+//  An input path may also be given, which can be a named pipe or a file to read from.
+//
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+class HostStream {
+	int m_in;                  // descriptor we read from, or -1
+	int m_out;                 // descriptor we write to
+	int m_wake[2];             // a pipe to wake the I/O thread when there is output
+	std::string m_name;
+
+	std::mutex m_mtx;
+	std::deque<unsigned char> m_received;
+	std::deque<unsigned char> m_sending;
+	std::function<void()> m_on_input;
+	std::atomic<bool> m_running;
+	std::thread m_thread;
+
+	void run();
+	bool pump_input();
+	bool pump_output();
+
+  public:
+	HostStream(const std::string &a_output, const std::string &a_input="");
+	~HostStream();
+
+	const std::string &name() const { return m_name; }
+
+	void write(unsigned char a_byte);          // never blocks
+	bool read(unsigned char &a_byte);          // false if nothing has arrived
+	size_t available();
+	void flush(unsigned long a_timeout_us=1000000);   // wait for output to reach the host
+
+	// called from the I/O thread when new data arrives
+	void on_input(std::function<void()> a_callback);
+};
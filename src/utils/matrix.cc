@@ -1,6 +1,7 @@
 #include "matrix.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 
 void Matrix::copy_data(SPARSE_MATRIX &data) const {
 	data.clear();
@@ -256,6 +257,148 @@ Matrix Matrix::invert() const {
 	return m;
 }
 
+//______________________________________________________________________________
+//  Copies A into the factor storage, row k from row m_order[k] of A.  Reusing the
+// storage keeps every term of the last factorisation, fill-in included, so sparse
+// elimination then only updates existing entries.
+void LUSolver::load(const Matrix &a_matrix, bool a_reuse) {
+	std::vector<size_t> position(m_n);
+	for (size_t k=0; k < m_n; ++k) position[m_order[k]] = k;
+	m_scale.assign(m_n, 0);
+	a_matrix.each([&](size_t i, size_t j, double v) { m_scale[i] = std::max(m_scale[i], std::fabs(v)); });
+
+	if (m_sparse) {
+		if (a_reuse)
+			for (auto &row: m_rows) for (auto &c: row) c.second = 0;
+		else
+			m_rows.assign(m_n, SPARSE_ROW());
+		a_matrix.each([&](size_t i, size_t j, double v) { m_rows[position[j]][i] = v; });
+	} else {
+		m_dense.assign(m_n * m_n, 0);
+		a_matrix.each([&](size_t i, size_t j, double v) { m_dense[position[j] * m_n + i] = v; });
+	}
+}
+
+bool LUSolver::factor(const Matrix &a_matrix) {
+	if (!a_matrix.is_square())
+		throw std::string("Attempting to factor a non-square matrix");
+	m_n = a_matrix.rows();
+	m_sparse = m_n > dense_limit;
+	m_sign = 1;
+	m_order.resize(m_n);
+	for (size_t k=0; k < m_n; ++k) m_order[k] = k;
+	m_dense.clear();
+	m_rows.clear();
+	load(a_matrix, false);
+	return m_sparse ? factor_sparse(true) : factor_dense(true);
+}
+
+bool LUSolver::refactor(const Matrix &a_matrix) {
+	if (!m_n || !a_matrix.is_square() || a_matrix.rows() != m_n)
+		return factor(a_matrix);
+	load(a_matrix, true);
+	if (m_sparse ? factor_sparse(false) : factor_dense(false)) return true;
+	return factor(a_matrix);          // a pivot became too small in the old order
+}
+
+bool LUSolver::factor_dense(bool a_pivot) {
+	double *a = m_dense.data();
+	for (size_t k=0; k < m_n; ++k) {
+		size_t p = k;
+		if (a_pivot)
+			for (size_t r=k+1; r < m_n; ++r)
+				if (std::fabs(a[r*m_n + k]) > std::fabs(a[p*m_n + k])) p = r;
+		if (negligible(a[p*m_n + k], k)) return false;
+		if (p != k) {
+			std::swap_ranges(a + k*m_n, a + (k+1)*m_n, a + p*m_n);
+			std::swap(m_order[k], m_order[p]);
+			m_sign = -m_sign;
+		}
+		const double *u = a + k*m_n;
+		for (size_t r=k+1; r < m_n; ++r) {
+			double *row = a + r*m_n;
+			if (row[k] == 0) continue;
+			double l = row[k] /= u[k];
+			for (size_t c=k+1; c < m_n; ++c)
+				row[c] -= l * u[c];
+		}
+	}
+	return true;
+}
+
+bool LUSolver::factor_sparse(bool a_pivot) {
+	for (size_t k=0; k < m_n; ++k) {
+		size_t p = k;
+		double best = 0;
+		for (size_t r = k; r < (a_pivot ? m_n : k+1); ++r) {
+			auto v = m_rows[r].find(k);
+			if (v != m_rows[r].end() && std::fabs(v->second) > best) {
+				best = std::fabs(v->second);
+				p = r;
+			}
+		}
+		if (negligible(best, k)) return false;
+		if (p != k) {
+			std::swap(m_rows[k], m_rows[p]);
+			std::swap(m_order[k], m_order[p]);
+			m_sign = -m_sign;
+		}
+		const SPARSE_ROW &u = m_rows[k];
+		double pivot = u.at(k);
+		for (size_t r=k+1; r < m_n; ++r) {
+			auto v = m_rows[r].find(k);
+			if (v == m_rows[r].end() || v->second == 0) continue;
+			double l = v->second /= pivot;
+			for (auto c = u.upper_bound(k); c != u.end(); ++c)
+				m_rows[r][c->first] -= l * c->second;
+		}
+	}
+	return true;
+}
+
+double LUSolver::determinant() const {
+	double d = m_sign;
+	for (size_t k=0; k < m_n; ++k)
+		d *= m_sparse ? m_rows[k].at(k) : m_dense[k*m_n + k];
+	return d;
+}
+
+void LUSolver::solve(std::vector<double> &b) const {
+	std::vector<double> x(m_n);
+	for (size_t k=0; k < m_n; ++k) x[k] = b[m_order[k]];
+
+	if (m_sparse) {
+		for (size_t k=0; k < m_n; ++k)             // L.y = Pb
+			for (auto &c: m_rows[k]) {
+				if (c.first >= k) break;
+				x[k] -= c.second * x[c.first];
+			}
+		for (size_t k=m_n; k-- > 0; ) {             // U.x = y
+			for (auto c = m_rows[k].upper_bound(k); c != m_rows[k].end(); ++c)
+				x[k] -= c->second * x[c->first];
+			x[k] /= m_rows[k].at(k);
+		}
+	} else {
+		const double *a = m_dense.data();
+		for (size_t k=0; k < m_n; ++k)
+			for (size_t c=0; c < k; ++c)
+				x[k] -= a[k*m_n + c] * x[c];
+		for (size_t k=m_n; k-- > 0; ) {
+			for (size_t c=k+1; c < m_n; ++c)
+				x[k] -= a[k*m_n + c] * x[c];
+			x[k] /= a[k*m_n + k];
+		}
+	}
+	b.swap(x);
+}
+
+std::vector<double> LUSolver::solve(const Matrix &a_column) const {
+	std::vector<double> b(m_n);
+	for (size_t j=0; j < m_n; ++j) b[j] = a_column(0, j);
+	solve(b);
+	return b;
+}
+
 // #define __test__matrix__
 #ifdef __test__matrix__
 int main() {
@@ -9,6 +9,7 @@
 
 #include <cmath>
 #include <map>
+#include <vector>
 #include <initializer_list>
 
 class Matrix {
@@ -84,4 +85,46 @@ class Matrix {
 	Matrix invert() const;
 	Matrix transpose() const;
 
+	template <typename F> void each(F a_fn) const {   // a_fn(i, j, value) for each non-zero term
+		for (auto &d: m_matrix) a_fn(d.first % m_cols, d.first / m_cols, d.second);
+	}
+};
+
+//______________________________________________________________________________
+//  Solves the square system A.x = b by LU factorisation with partial pivoting.  A is
+// factored once, after which any number of right hand sides may be solved in O(n^2).
+//  Small systems are held densely, row by row in one contiguous block, so that the
+// elimination loops run over adjacent memory.  Larger ones are mostly zeros in a
+// circuit, and are held as sparse rows, so elimination only visits non-zero terms.
+//  When only the values of A change, refactor() reuses the row order and the fill
+// pattern of the last factorisation, and only redoes the arithmetic.
+//  As with Matrix, A(i, j) is column i of row j.  L and U share the same storage,
+// with L below the diagonal and its unit diagonal implied.
+class LUSolver {
+  public:
+	static const size_t dense_limit = 32;       // largest system held densely
+
+  private:
+	typedef std::map<size_t, double> SPARSE_ROW;
+
+	size_t m_n = 0;
+	bool   m_sparse = false;
+	int    m_sign = 1;                           // of the row permutation
+	std::vector<double> m_dense;                 // m_n * m_n, row major
+	std::vector<SPARSE_ROW> m_rows;
+	std::vector<size_t> m_order;                 // row k of LU is row m_order[k] of A
+	std::vector<double> m_scale;                 // largest term in each column of A
+
+	void load(const Matrix &a_matrix, bool a_reuse);
+	bool factor_dense(bool a_pivot);
+	bool factor_sparse(bool a_pivot);
+	bool negligible(double a_pivot, size_t k) const { return std::fabs(a_pivot) <= m_scale[k] * 1e-13; }
+
+  public:
+	bool factor(const Matrix &a_matrix);        // false if the matrix is singular
+	bool refactor(const Matrix &a_matrix);      // the same, keeping the last row order if it will do
+	size_t size() const { return m_n; }
+	double determinant() const;
+	void solve(std::vector<double> &b) const;   // replaces b with x
+	std::vector<double> solve(const Matrix &a_column) const;
 };
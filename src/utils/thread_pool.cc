@@ -0,0 +1,102 @@
+/*
+ * thread_pool.cc
+ *
+ *  Runs batches of independent tasks over several threads.
+ */
+#include <algorithm>
+#include "thread_pool.h"
+#include "utility.h"
+
+ThreadPool::ThreadPool(size_t a_workers): m_queues(a_workers + 1), m_queued(0), m_pending(0) {
+	for (size_t n = 0; n < a_workers; ++n)
+		m_threads.push_back(std::thread(&ThreadPool::work, this, n));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto &t: m_threads) t.join();
+}
+
+ThreadPool &ThreadPool::shared() {
+	static NeverDestroyed<ThreadPool> l_pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	return *l_pool;
+}
+
+//___________________________________________________________________________________
+// Our own tasks from the front, and anyone else's from the back.
+bool ThreadPool::take(size_t a_queue, std::function<void()> &a_task) {
+	for (size_t n = 0; n < m_queues.size(); ++n) {
+		auto &q = m_queues[(a_queue + n) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(q.lock);
+		if (q.tasks.empty()) continue;
+		if (n == 0) {
+			a_task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		} else {
+			a_task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+		--m_queued;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::finish(std::function<void()> &a_task) {
+	try {
+		a_task();
+	} catch (...) {}
+	if (--m_pending == 0) {
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_done.notify_all();
+	}
+}
+
+void ThreadPool::work(size_t a_queue) {
+	std::function<void()> task;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_wake.wait(lock, [this]{ return m_stop || m_queued > 0; });
+			if (m_stop) return;
+		}
+		while (take(a_queue, task))
+			finish(task);
+	}
+}
+
+//___________________________________________________________________________________
+void ThreadPool::run(std::vector<std::function<void()> > &a_tasks) {
+	if (a_tasks.empty()) return;
+	std::lock_guard<std::mutex> running(m_running);
+	size_t caller = m_threads.size();
+	if (!caller) {
+		for (auto &task: a_tasks) {
+			try {
+				task();
+			} catch (...) {}
+		}
+		return;
+	}
+	m_pending += a_tasks.size();
+	for (size_t n = 0; n < a_tasks.size(); ++n) {
+		auto &q = m_queues[n % m_queues.size()];
+		std::lock_guard<std::mutex> lock(q.lock);
+		q.tasks.push_back(std::move(a_tasks[n]));
+		++m_queued;                          // counted once it can be taken, so a worker never waits on nothing
+	}
+	{   // a worker between its test of m_queued and its wait sees the wakeup
+		std::lock_guard<std::mutex> lock(m_lock);
+	}
+	m_wake.notify_all();
+
+	std::function<void()> task;
+	while (take(caller, task))
+		finish(task);
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_done.wait(lock, [this]{ return m_pending == 0; });
+}
@@ -0,0 +1,52 @@
+/*
+ * thread_pool.h
+ *
+ *  Runs batches of independent tasks over several threads.
+ */
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+//___________________________________________________________________________________
+//  Each worker has a queue of its own, and so does the caller.  run() deals a batch of
+// tasks out evenly among them, and the caller works through its share alongside the
+// workers.  Whoever runs out of tasks of their own takes from the back of someone
+// else's queue, so that one slow task does not hold up the rest of its queue.  run()
+// returns once every task in the batch is done, and only one batch runs at a time.
+//  A task should not throw.  If one does, the exception is dropped, as it would be by
+// DeviceEventQueue::process_events().
+class ThreadPool {
+	struct Queue {
+		std::mutex lock;
+		std::deque<std::function<void()> > tasks;
+	};
+
+	std::vector<std::thread> m_threads;
+	std::vector<Queue> m_queues;          // one for each worker, and the last for the caller
+	std::atomic<size_t> m_queued;         // tasks not yet taken
+	std::atomic<size_t> m_pending;        // tasks not yet done
+	std::mutex m_lock;
+	std::mutex m_running;                 // one batch at a time
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	bool m_stop = false;
+
+	bool take(size_t a_queue, std::function<void()> &a_task);
+	void finish(std::function<void()> &a_task);
+	void work(size_t a_queue);
+
+  public:
+	ThreadPool(size_t a_workers);
+	~ThreadPool();
+
+	void run(std::vector<std::function<void()> > &a_tasks);
+	size_t size() const { return m_threads.size(); }   // workers, besides the caller
+
+	static ThreadPool &shared();          // a worker for each core, less the caller's own
+};
@@ -5,6 +5,7 @@
 
 #include <string>
 #include <algorithm>
+#include <utility>
 #include <iostream>
 #include <fstream>
 #include <mutex>
@@ -81,5 +82,17 @@ class ScopedRedirect
     std::streambuf * mOldBuffer;
 };
 
+//_____________________________________________________________________________________________________________
+//  Devices may be global or static, so they may be destroyed as late as static destruction, and in any
+// order.  A registry which they update from their destructors must outlive every one of them, and so must
+// anything with threads still running at exit.  Such a thing is made the first time it is used, as a
+// static local NeverDestroyed, and is deliberately never destroyed.
+template <class T> class NeverDestroyed {
+	T *m_value;
+
+  public:
+	template <class... Args> NeverDestroyed(Args&&... args): m_value(new T(std::forward<Args>(args)...)) {}
+	T &operator*() const { return *m_value; }
+};
 
 #endif
@@ -24,6 +24,31 @@ int main(int a_argc, char *a_argv[]) {
 	std::cout << "Testing PORTA & PORTB devices" << std::endl;
 	std::cout << "============================================================================" << std::endl;
 	Tests::test_ports();
+	std::cout << std::endl << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	std::cout << "Testing Timer2, CCP1, SLEEP & WDT" << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	Tests::test_timers();
+	std::cout << std::endl << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	std::cout << "Testing the USART" << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	Tests::test_usart();
+	std::cout << std::endl << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	std::cout << "Testing fast forwarding" << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	Tests::test_fast_forward();
+	std::cout << std::endl << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	std::cout << "Testing the ALU" << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	Tests::test_alu();
+	std::cout << std::endl << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	std::cout << "Testing circuit analysis" << std::endl;
+	std::cout << "============================================================================" << std::endl;
+	Tests::test_circuits();
 }
 
 #endif
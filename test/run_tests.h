@@ -4,5 +4,10 @@ namespace Tests {
 	void test_assembler();
 	void test_comparator_module();
 	void test_ports();
+	void test_timers();
+	void test_usart();
+	void test_fast_forward();
+	void test_alu();
+	void test_circuits();
 }
 #endif
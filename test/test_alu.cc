@@ -0,0 +1,74 @@
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include "../src/alu.h"
+
+#ifdef TESTING
+namespace Tests {
+
+	// Every pair of operands, both ways
+	void test_flags() {
+		const ALU::FlagTable &table = ALU::FlagTable::instance();
+		for (unsigned int a = 0; a < 0x100; ++a) {
+			for (unsigned int b = 0; b < 0x100; ++b) {
+				BYTE flags;
+				assert(ALU::add(a, b, flags) == ((a + b) & 0xff));
+				assert(flags == table.add(a, b));
+				assert(ALU::sub(a, b, flags) == ((a - b) & 0xff));
+				assert(flags == table.sub(a, b));
+			}
+		}
+		BYTE flags;
+		ALU::sub(5, 5, flags);               // no borrow, and zero
+		assert(flags == (Flags::STATUS::Z | Flags::STATUS::C | Flags::STATUS::DC));
+		ALU::sub(0x10, 0x01, flags);         // a borrow from the high nibble only
+		assert(flags == Flags::STATUS::C);
+		ALU::add(0x80, 0x80, flags);         // carry, and zero
+		assert(flags == (Flags::STATUS::Z | Flags::STATUS::C));
+		std::cout << "ALU flags: all tests concluded successfully" << std::endl;
+	}
+
+	//  A running checksum, much like CRC or filter code, where each step depends on the
+	// flags from the last one.  Prints the time per add and subtract for each approach.
+	void benchmark_flags() {
+		const unsigned long n = 20000000;
+		const ALU::FlagTable &table = ALU::FlagTable::instance();
+		volatile BYTE seed = 0x5a;
+
+		auto timed = [](const char *a_name, std::function<BYTE()> a_run) {
+			auto start = std::chrono::steady_clock::now();
+			BYTE sum = a_run();
+			std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+			std::cout << a_name << ": " << took.count() / n << " ns per step (" << (int)sum << ")" << std::endl;
+			return sum;
+		};
+
+		BYTE by_arithmetic = timed("Bit arithmetic", [&]() {
+			BYTE acc = seed, x = seed, flags = 0;
+			for (unsigned long i = 0; i < n; ++i) {
+				acc = ALU::add(acc, x, flags);
+				x = ALU::sub(x ^ flags, acc, flags) + flags;
+			}
+			return (BYTE)(acc ^ x);
+		});
+		BYTE by_table = timed("Lookup tables ", [&]() {
+			BYTE acc = seed, x = seed, flags = 0;
+			for (unsigned long i = 0; i < n; ++i) {
+				flags = table.add(acc, x);
+				acc = acc + x;
+				BYTE y = x ^ flags;
+				flags = table.sub(y, acc);
+				x = (BYTE)(y - acc) + flags;
+			}
+			return (BYTE)(acc ^ x);
+		});
+		assert(by_arithmetic == by_table);
+	}
+
+	void test_alu() {
+		test_flags();
+		benchmark_flags();
+	}
+}
+#endif
@@ -11,7 +11,7 @@ namespace Tests {
 		test_assembler_parse_args();
 		CPU_DATA cpu;
 		InstructionSet instructions;
-		cpu.set_params(Params{"PIC16f628a", 2048, 128, 4, 0x80, 18, 8});
+		cpu.set_params(PIC16f628a::params("PIC16f628a"));
 
 		FILE *f = fopen("assembler_test.a", "w+");
 		fputs("\tradix hex\n", f);
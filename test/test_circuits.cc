@@ -0,0 +1,591 @@
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <atomic>
+#include "../src/utils/matrix.h"
+#include "../src/utils/thread_pool.h"
+#include "../src/devices/device_base.h"
+#include "../src/devices/nodal.h"
+#include "../src/devices/connection_node.h"
+#include "../src/devices/netlist.h"
+#include "../src/devices/transient.h"
+#include "../src/devices/clock.h"
+#include "../src/devices/simulated_ports.h"
+
+#ifdef TESTING
+namespace Tests {
+
+	// the mesh matrix of a ladder of resistors: each mesh shares one resistor with the next
+	Matrix ladder(size_t n, double r_series, double r_shunt) {
+		Matrix m(n);
+		for (size_t i = 0; i < n; ++i) {
+			m(i, i) = r_series + r_shunt + (i ? r_shunt : 0);
+			if (i) {
+				m(i, i-1) = -r_shunt;
+				m(i-1, i) = -r_shunt;
+			}
+		}
+		return m;
+	}
+
+	// the largest difference between M.x and V
+	double residual(const Matrix &m, const std::vector<double> &x, const Matrix &v) {
+		double worst = 0;
+		for (size_t j = 0; j < m.rows(); ++j) {
+			double sum = 0;
+			for (size_t i = 0; i < m.cols(); ++i) sum += m(i, j) * x[i];
+			worst = std::max(worst, std::fabs(sum - v(0, j)));
+		}
+		return worst;
+	}
+
+	void test_lu_solver() {
+		Matrix m({{1,0,0,1},{0,2,1,2},{2,1,0,1},{2,0,1,4}});     // needs pivoting: m(2,2) is zero
+		Matrix v(1, 4);
+		for (size_t j = 0; j < 4; ++j) v(0, j) = j + 1;
+		LUSolver lu;
+		assert(lu.factor(m));
+		assert(std::fabs(lu.determinant() - m.determinant()) < 1e-9);
+		assert(residual(m, lu.solve(v), v) < 1e-9);
+
+		assert(!lu.factor(Matrix({{1,2},{2,4}})));                  // singular
+
+		for (size_t n: {6, 200}) {                                   // dense, then sparse
+			Matrix r = ladder(n, 100, 1000);
+			Matrix e(1, n);
+			e(0, 0) = 5;                                             // a 5V source in the first mesh
+			assert(lu.factor(r));
+			std::vector<double> I = lu.solve(e);
+			assert(residual(r, I, e) < 1e-12);
+			for (size_t i = 1; i < n; ++i)
+				assert(I[i] > 0 && I[i] < I[i-1]);                    // current falls along the ladder
+		}
+		std::cout << "LU solver: all tests concluded successfully" << std::endl;
+	}
+
+	void test_nodal_analysis() {
+		for (bool nodal: {false, true}) {                          // both engines agree on a divider
+			Simulation::nodal(nodal);
+			Voltage vdd(5, "Vdd");
+			Terminal r1("R1"), r2("R2");
+			Ground gnd;
+			r1.R(1000); r2.R(1000);
+			r1.connect(vdd); r2.connect(r1); gnd.connect(r2);
+			vdd.query_voltage();
+			assert(std::fabs(r1.rd() - 2.5) < 1e-5);
+			assert(std::fabs(r2.I() + 0.0025) < 1e-8);
+		}
+
+		Simulation::nodal(true);
+		{
+			Voltage vdd(5, "Vdd");                                   // R1 feeding R2 and R3 in parallel
+			Terminal r1("R1"), r2("R2"), r3("R3");
+			Ground gnd;
+			r1.R(1000); r2.R(1000); r3.R(1000);
+			r1.connect(vdd); r2.connect(r1); r3.connect(r1);
+			gnd.connect(r2); gnd.connect(r3);
+			vdd.query_voltage();
+			assert(std::fabs(r1.rd() - 5.0/3) < 1e-5);
+			assert(std::fabs(r2.I() - r3.I()) < 1e-9 && std::fabs(r1.I() + 5/1500.0) < 1e-8);
+
+			r2.R(3000);                                              // the circuit is resolved in place
+			assert(std::fabs(r1.rd() - (5 - 5/1.75)) < 1e-5);
+			assert(std::fabs(r2.I() * 3 - r3.I()) < 1e-9);
+		}
+		{
+			const size_t n = 100;                                    // a ladder big enough to solve sparsely
+			Voltage vdd(5, "Vdd");
+			Ground gnd;
+			std::vector<Terminal> series(n), shunt(n);
+			for (size_t k = 0; k < n; ++k) {
+				series[k].R(100);
+				shunt[k].R(1000);
+				series[k].connect(k ? (Connection &)series[k-1] : (Connection &)vdd);
+				shunt[k].connect(series[k]);
+				gnd.connect(shunt[k]);
+			}
+			vdd.query_voltage();
+			for (size_t k = 1; k < n; ++k) {
+				assert(series[k].rd(false) < series[k-1].rd(false) && series[k].rd(false) > 0);   // voltage falls along the ladder
+				assert(std::fabs(series[k-1].I() - shunt[k-1].I() - series[k].I()) < 1e-9);       // and current is conserved
+			}
+		}
+		Simulation::nodal(false);
+		std::cout << "Nodal analysis: all tests concluded successfully" << std::endl;
+	}
+
+	void test_topology_cache() {
+		Voltage vdd(5, "Vdd");                                       // R1 feeding R2, and later R3
+		Terminal r1("R1"), r2("R2"), r3("R3");
+		Ground gnd;
+		r1.R(1000); r2.R(1000); r3.R(1000);
+		r1.connect(vdd); r2.connect(r1); gnd.connect(r2);
+		vdd.query_voltage();
+		assert(std::fabs(r1.rd() - 2.5) < 1e-5);
+
+		unsigned long topology = Simulation::topology();
+		r2.R(3000);                                                  // values change, but the net stands
+		vdd.set_value(4, false);
+		r1.query_voltage();
+		assert(Simulation::topology() == topology);
+		assert(std::fabs(r1.rd() - 3.0) < 1e-5);
+		assert(std::fabs(r2.I() + 0.001) < 1e-8);
+
+		r3.connect(r1); gnd.connect(r3);                             // R3 in parallel with R2
+		assert(Simulation::topology() != topology);
+		vdd.query_voltage();
+		assert(std::fabs(r1.rd() - 4 * 750.0 / 1750) < 1e-5);
+		assert(std::fabs(r2.I() * 3 - r3.I()) < 1e-9);
+
+		r3.disconnect(r1);                                           // and out again
+		vdd.query_voltage();
+		assert(std::fabs(r1.rd() - 3.0) < 1e-5);
+		std::cout << "Topology cache: all tests concluded successfully" << std::endl;
+	}
+
+	void test_memoised_solutions() {
+		Voltage vdd(5, "Vdd");                                       // a pin, driven through R1 and pulled down by R2
+		Terminal r1("R1"), r2("R2");
+		Ground gnd;
+		r1.R(100); r2.R(10000);
+		r1.connect(vdd); r2.connect(r1); gnd.connect(r2);
+		vdd.query_voltage();
+
+		unsigned long solved = Connection_Node::solved();
+		for (int n = 0; n < 10; ++n) {                               // toggle the drive between three levels
+			for (double v: {5.0, 0.0, 2.5}) {
+				vdd.set_value(v, false); vdd.query_voltage();
+				assert(std::fabs(r1.rd() - v * 10000 / 10100) < 1e-5);
+				assert(std::fabs(r2.I() + v / 10100) < 1e-9);
+			}
+		}
+		assert(Connection_Node::solved() - solved == 2);             // three states, one of which was known
+
+		r2.R(5000);                                                  // a new state is solved, not recalled
+		vdd.set_value(5, false); vdd.query_voltage();
+		assert(std::fabs(r1.rd() - 5 * 5000.0 / 5100) < 1e-5);
+
+		auto drive = [&](double v) { vdd.set_value(v, false); vdd.query_voltage(); };
+		for (size_t n = 0; n < Connection_Data::max_solutions; ++n) drive(n + 0.5);   // fill it with new states
+		solved = Connection_Node::solved();
+		drive(0.5);                                                  // the oldest, used again
+		drive(Connection_Data::max_solutions + 0.5);                 // forgets the least recently used
+		assert(Connection_Node::solved() - solved == 1);
+		drive(0.5);
+		assert(Connection_Node::solved() - solved == 1);
+		drive(1.5);
+		assert(Connection_Node::solved() - solved == 2);
+		std::cout << "Memoised solutions: all tests concluded successfully" << std::endl;
+	}
+
+	// a tristate buffer driving a divider, as a port drives its pin
+	void test_memoised_tristate() {
+		DeviceEventQueue eq;
+		Connection in(5, false), en(0, false);
+		Tristate ts(in, en);
+		Terminal r1("R1"), r2("R2");
+		Ground gnd;
+		r1.R(1000); r2.R(1000);
+		r1.connect(ts.rd()); r2.connect(r1); gnd.connect(r2);
+
+		auto gate = [&](bool a_on) {
+			en.set_value(a_on ? 5 : 0, false);
+			eq.process_events();
+			ts.rd().query_voltage();
+			assert(ts.rd().impeded() == !a_on);
+		};
+		gate(true); gate(false);                                     // both states are seen
+
+		unsigned long topology = Simulation::topology();
+		unsigned long solved = Connection_Node::solved();
+		for (int n = 0; n < 10; ++n) {
+			gate(true);
+			assert(std::fabs(r1.rd() - 2.5) < 1e-5);
+			gate(false);
+			assert(std::fabs(r1.rd()) < 1e-5);
+		}
+		assert(Simulation::topology() == topology);                  // opening the net is not rewiring it
+		assert(Connection_Node::solved() == solved);                 // and both states are recalled
+		std::cout << "Memoised tristate: all tests concluded successfully" << std::endl;
+	}
+
+	void test_digital_nets() {
+		DeviceEventQueue eq;
+		Output out(5, "out");                                        // a logic output through two wires to an inverter
+		Terminal w1("W1"), w2("W2");
+		w1.connect(out); w2.connect(w1);
+		Inverter inv(w2);
+		eq.process_events();
+		assert(w2.rd() == 5 && !inv.rd().signal());
+
+		unsigned long solved = Connection_Node::solved();
+		for (int n = 0; n < 10; ++n) {
+			out.set_value(n & 1 ? 5 : 0, false);
+			eq.process_events();
+			assert(w1.rd() == w2.rd() && w2.rd() == (n & 1 ? 5 : 0));
+			assert(w1.I() == 0 && inv.rd().signal() == !(n & 1));
+		}
+		assert(Connection_Node::solved() == solved);                 // propagated, not solved
+
+		Capacitor c("C");                                            // a capacitor makes the net analog
+		c.connect(w2);
+		out.set_value(0, false);
+		eq.process_events();
+		assert(Connection_Node::solved() > solved);
+		c.disconnect(w2);
+		std::cout << "Digital nets: all tests concluded successfully" << std::endl;
+	}
+
+	// a little of everything: gates through a wire, a flip flop, a tristate buffer and a counter
+	struct LogicCircuit {
+		Connection a, b, ck, en;
+		AndGate gate;
+		Terminal wire;
+		Inverter inv;
+		XOrGate x;
+		Latch ff;
+		Tristate ts;
+		Counter count;
+
+		LogicCircuit(): a(0, false), b(0, false), ck(0, false), en(0, false),
+			gate({&a, &b}), inv(wire), x({&inv.rd(), &a}), ff(x.rd(), ck, true, true),
+			ts(ff.Q(), en), count(ff.Q(), true, 3) {
+			wire.connect(gate.rd());
+		}
+		std::vector<Device *> devices() { return {&gate, &inv, &x, &ff, &ts, &count}; }
+	};
+
+	void test_netlist() {
+		DeviceEventQueue eq;
+		LogicCircuit events, compiled;
+		Netlist netlist(compiled.devices());
+		netlist.observe(compiled.ts.rd());
+		netlist.observe(compiled.ff.Qc());
+		eq.process_events();
+		assert(netlist.operations() == 6 && !netlist.feedback());
+		assert(netlist.signals() == 6 + 3 + 4);                          // outputs, counter bits and inputs; the wire is the gate
+
+		unsigned int seed = 1;
+		for (int n = 0; n < 500; ++n) {                                  // the same changes to both
+			seed = seed * 1103515245 + 12345;
+			int which = (seed >> 16) % 4;
+			for (auto c: {&events, &compiled}) {
+				Connection *in[] = {&c->a, &c->b, &c->ck, &c->en};
+				in[which]->set_value(in[which]->signal() ? 0 : Device::Vdd, false);
+			}
+			eq.process_events();
+			assert(events.ts.rd().signal() == compiled.ts.rd().signal());
+			assert(events.ts.rd().impeded() == compiled.ts.rd().impeded());
+			assert(events.ff.Qc().signal() == compiled.ff.Qc().signal());
+			assert(events.count.get() == compiled.count.get());
+			assert(netlist.signal(compiled.x.rd()) == events.x.rd().signal());
+		}
+		assert(events.count.get() || events.count.overflow());
+		std::cout << "Netlist: all tests concluded successfully" << std::endl;
+	}
+
+	void test_netlist_batch() {
+		DeviceEventQueue eq;
+		LogicCircuit compiled;
+		Netlist netlist(compiled.devices());
+		std::vector<Connection *> inputs = {&compiled.a, &compiled.b, &compiled.ck, &compiled.en};
+		std::vector<Connection *> outputs = {&compiled.ts.rd(), &compiled.ff.Qc()};
+		for (size_t n = 0; n < compiled.count.nbits(); ++n) outputs.push_back(&compiled.count.bit(n));
+
+		const size_t scenarios = 70, steps = 40;                         // more than one batch
+		std::vector<Netlist::Stimulus> stimuli;
+		unsigned int seed = 7;
+		for (size_t k = 0; k < scenarios; ++k) {
+			Netlist::Stimulus stimulus;
+			std::vector<bool> levels(inputs.size(), false);
+			for (size_t n = 0; n < steps; ++n) {                          // one input changes at each step
+				seed = seed * 1103515245 + 12345;
+				levels[(seed >> 16) % inputs.size()].flip();
+				stimulus.push_back(levels);
+			}
+			stimuli.push_back(stimulus);
+		}
+		auto traces = netlist.simulate(inputs, stimuli, outputs);
+		assert(traces.size() == scenarios);
+		assert(!compiled.count.get() && !compiled.ts.rd().signal());    // the circuit itself is untouched
+
+		for (size_t k = 0; k < scenarios; k += 9) {                      // replay some, one event at a time
+			LogicCircuit events;
+			Connection *in[] = {&events.a, &events.b, &events.ck, &events.en};
+			for (size_t n = 0; n < steps; ++n) {
+				for (size_t i = 0; i < inputs.size(); ++i)
+					in[i]->set_value(stimuli[k][n][i] * Device::Vdd, false);
+				eq.process_events();
+				assert(traces[k][n][0] == events.ts.rd().signal());
+				assert(traces[k][n][1] == events.ff.Qc().signal());
+				for (size_t b = 0; b < events.count.nbits(); ++b)
+					assert(traces[k][n][2 + b] == (bool)((events.count.get() >> b) & 1));
+			}
+		}
+		std::cout << "Netlist batches: all tests concluded successfully" << std::endl;
+	}
+
+	// every combination of PORTB, TRISB, OPTION.RBPU and an outside drive on RB0
+	void test_port_sweep() {
+		Terminal pin("pin");
+		PortB_RB0 rb0(pin, "RB0");
+		typedef BasicPortB::Step Step;
+
+		std::vector<BasicPortB::Scenario> scenarios;
+		for (int k = 0; k < 24; ++k) {
+			bool port = k & 1, tris = k & 2, rbpu = k & 4;
+			Step::Drive drive = Step::Drive(k / 8);
+			scenarios.push_back({
+				{Step::WRITE_PORT, port, rbpu, Step::FLOAT},
+				{Step::WRITE_TRIS, tris, rbpu, Step::FLOAT},
+				{Step::READ_PORT, false, rbpu, drive},
+				{Step::READ_TRIS, false, rbpu, drive}});
+		}
+		auto results = rb0.sweep(scenarios, {&rb0.INT()});
+		assert(results.size() == scenarios.size());
+		assert(!rb0.components()["Tristate1"]->compiled());            // the port itself is untouched
+
+		for (int k = 0; k < 24; ++k) {
+			bool port = k & 1, tris = k & 2, rbpu = k & 4;
+			Step::Drive drive = Step::Drive(k / 8);
+			bool level;                                                  // as the pin should read
+			if (!tris) level = drive == Step::FLOAT ? port : port && drive == Step::HIGH;
+			else level = drive == Step::FLOAT ? rbpu : drive == Step::HIGH;
+			bool floating = tris && !rbpu && drive == Step::FLOAT;      // the model pulls up with RBPU set
+
+			auto &r = results[k];
+			assert(r[2].pin == level && r[2].floating == floating);
+			assert(r[2].read == level && r[3].read == tris);
+			assert(r[3].probes.size() == 1 && r[3].probes[0] == level);  // INT follows the pin
+
+			auto alone = rb0.sweep({scenarios[k]}, {&rb0.INT()});       // each lane stands alone
+			for (size_t n = 0; n < r.size(); ++n)
+				assert(alone[0][n].pin == r[n].pin && alone[0][n].read == r[n].read && alone[0][n].floating == r[n].floating);
+		}
+		std::cout << "Port sweeps: all tests concluded successfully" << std::endl;
+	}
+
+	void test_transient() {
+		Voltage v1(5, "V1"), v2(5, "V2");                         // two independent nets
+		Terminal r1("R1"), r2("R2");
+		Capacitor c("C");
+		Inductor l("L");
+		r1.R(1000); c.F(1e-6);                                    // RC = 1ms
+		r2.R(100); l.H(1e-2);                                     // L/R = 0.1ms
+		r1.connect(v1); c.connect(r1);
+		r2.connect(v2); l.connect(r2);
+
+		unsigned long steps = Transient::steps();
+		Transient::advance(1e-4);
+		assert(std::fabs(c.Vc() - 5 * (1 - std::exp(-0.1))) < 5e-3);
+		assert(std::fabs(l.IL() - 0.05 * (1 - std::exp(-1.0))) < 5e-5);
+		assert(std::fabs(r1.I() + (5 - c.Vc()) / 1000) < 1e-6);   // the result is published
+
+		Transient::advance(9e-4);
+		assert(std::fabs(c.Vc() - 5 * (1 - std::exp(-1.0))) < 5e-3);
+		assert(std::fabs(l.IL() - 0.05 * (1 - std::exp(-10.0))) < 5e-5);
+		assert(Transient::steps() - steps < 1000);                 // far fewer than a fixed step would need
+
+		Transient::advance(4e-3);
+		assert(std::fabs(c.Vc() - 5 * (1 - std::exp(-5.0))) < 5e-3);
+		v1.set_value(0, false);                                    // and discharge
+		Transient::advance(1e-3);
+		assert(std::fabs(c.Vc() - 5 * (1 - std::exp(-5.0)) * std::exp(-1.0)) < 5e-3);
+		std::cout << "Transients: all tests concluded successfully" << std::endl;
+	}
+
+	void test_analog_scheduling() {
+		DeviceEventQueue eq;
+		Clock clock;
+		clock.start();
+		Transient::attach(clock);
+		Voltage vdd(5, "Vdd");
+		Terminal r("R");
+		Capacitor c("C");
+		r.R(1000); c.F(1e-6);                                     // RC = 1ms, or 1000 cycles
+		r.connect(vdd); c.connect(r);
+		Schmitt trigger(r);                                       // watches for 2V and 3V
+		assert(clock.scheduled("analog"));
+
+		unsigned long updates = Transient::updates();
+		Clock::Cycle high = 0;
+		while (clock.cycles() < 3000) {
+			for (int n = 0; n < 8; ++n) clock.toggle();               // an instruction cycle
+			eq.process_events();
+			if (!high && trigger.rd().signal()) high = clock.cycles();
+		}
+		double expected = -std::log(1 - 3.0/5) / Transient::cycle * 1e-3;   // when 3V is crossed
+		assert(high && std::fabs(high - expected) <= 3);
+		assert(Transient::updates() - updates < 60);              // not one for every cycle
+
+		Transient::detach(clock);
+		assert(!clock.scheduled("analog"));
+
+		size_t watching = Transient::watching();
+		{
+			Terminal t("T");
+			Transient::watch(t, 2.5);
+			assert(Transient::watching() == watching + 1);
+		}
+		assert(Transient::watching() == watching);                // forgotten as it is destroyed
+		std::cout << "Analog scheduling: all tests concluded successfully" << std::endl;
+	}
+
+	void test_parallel_solves() {
+		ThreadPool pool(3);                                          // every task runs exactly once
+		std::atomic<int> total(0);
+		std::vector<std::function<void()> > tasks;
+		for (int n = 1; n <= 100; ++n) tasks.push_back([&total, n]{ total += n; });
+		pool.run(tasks);
+		assert(total == 5050);
+
+		const size_t n = 8;                                          // independent dividers, as on separate pins
+		std::vector<std::unique_ptr<Voltage> > vdd;
+		std::vector<std::unique_ptr<Terminal> > r1, r2;
+		std::vector<std::unique_ptr<Ground> > gnd;
+		for (size_t k = 0; k < n; ++k) {
+			vdd.emplace_back(new Voltage(5, "Vdd"));
+			r1.emplace_back(new Terminal("R1")); r2.emplace_back(new Terminal("R2"));
+			gnd.emplace_back(new Ground());
+			r1[k]->R(1000); r2[k]->R(1000 * (k + 1));
+			r1[k]->connect(*vdd[k]); r2[k]->connect(*r1[k]); gnd[k]->connect(*r2[k]);
+			vdd[k]->query_voltage();
+			assert(std::fabs(r1[k]->rd() - 5.0 * (k + 1) / (k + 2)) < 1e-5);
+		}
+
+		unsigned long solved = Connection_Node::solved();
+		{
+			Connection_Node::Defer defer;
+			for (size_t k = 0; k < n; ++k) {
+				vdd[k]->set_value(3, false); vdd[k]->query_voltage();
+				vdd[k]->query_voltage();                                 // the same net, solved only once
+			}
+			assert(Connection_Node::solved() == solved);             // nothing solved yet
+			assert(std::fabs(r1[0]->rd() - 2.5) < 1e-5);
+			std::thread([&vdd]{ vdd[0]->query_voltage(); }).join();      // another thread's query is not deferred
+			assert(Connection_Node::solved() - solved == 1 && std::fabs(r1[0]->rd() - 1.5) < 1e-5);
+			assert(defer.settle());
+			assert(!defer.settle());
+			vdd[1]->query_voltage();                                    // queried, but nothing has changed
+			assert(!defer.settle());
+		}
+		assert(Connection_Node::solved() - solved == n);             // the first net was recalled
+		for (size_t k = 0; k < n; ++k)
+			assert(std::fabs(r1[k]->rd() - 3.0 * (k + 1) / (k + 2)) < 1e-5);
+
+		Simulation::rewired();                                       // two threads walking nets at once
+		std::thread other([&vdd]{ for (int m = 0; m < 200; ++m) vdd[1]->query_voltage(); });
+		for (int m = 0; m < 200; ++m) vdd[2]->query_voltage();
+		other.join();
+		assert(std::fabs(r1[1]->rd() - 2.0) < 1e-5 && std::fabs(r1[2]->rd() - 2.25) < 1e-5);
+		std::cout << "Parallel solves: all tests concluded successfully" << std::endl;
+	}
+
+	struct WireEvents {
+		std::map<Wire *, int> count;
+		void on_wire(Wire *w, const std::string &name) { ++count[w]; }
+	};
+
+	void test_wire_nets() {
+		DeviceEventQueue eq;
+		Connection c[4] = {Connection("c0"), Connection("c1"), Connection("c2"), Connection("c3")};
+		for (auto &conn: c) conn.set_value(0, true);
+		Wire w1("w1"), w2("w2"), w3("w3");                           // w1 and w2 share c1
+		w1.connect(c[0]); w1.connect(c[1]);
+		w2.connect(c[1]); w2.connect(c[2]);
+		w3.connect(c[3]);
+		eq.process_events();
+		assert(w1.net_size() == 2 && w2.net_size() == 2 && w3.net_size() == 1);
+
+		WireEvents events;
+		DeviceEvent<Wire>::subscribe<WireEvents>(&events, &WireEvents::on_wire);
+		c[0].set_value(5, false);                                    // driven from one end of the net
+		eq.process_events();
+		assert(w1.rd() == 5 && w2.rd() == 5 && c[2].rd() == 5);
+		assert(events.count[&w1] == 1 && events.count[&w2] == 1 && !events.count[&w3]);
+		c[0].set_value(0, false);
+		eq.process_events();
+		assert(c[2].rd() == 0 && events.count[&w1] == 2 && events.count[&w2] == 2);
+		DeviceEvent<Wire>::unsubscribe<WireEvents>(&events, &WireEvents::on_wire);
+
+		w2.disconnect(c[1]);                                         // splits the net
+		assert(w1.net_size() == 1 && w2.net_size() == 1);
+		w3.connect(c[2]);
+		assert(w2.net_size() == 2 && w3.net_size() == 2 && w1.net_size() == 1);
+		std::cout << "Wire nets: all tests concluded successfully" << std::endl;
+	}
+
+	void test_released_slots() {
+		Terminal t("t");
+		Wire w("w");
+		{
+			Connection c(5, false, "c");
+			t.connect(c); w.connect(c);
+			assert(t.sources().size() == 1 && w.rd() == 5);
+		}                                                            // gone before what it feeds
+		assert(t.sources().empty() && !w.determinate());
+		std::cout << "Released slots: all tests concluded successfully" << std::endl;
+	}
+
+	void test_connection_copies() {
+		Connection a(3, false, "a");
+		Terminal t("t");
+		a.R(500);
+		t.connect(a);
+		{
+			Connection b(a);                                         // a copy has the same state
+			assert(b.rd(false) == 3 && b.I() == a.I() && b.determinate());
+			assert(a.targets().size() == 1 && b.targets().empty() && b.impeded());   // but not its slots
+			b.set_value(1, false);
+			assert(a.rd(false) == 3 && b.rd(false) == 1);
+		}
+		assert(a.targets().size() == 1 && !a.impeded());             // the original keeps them
+
+		std::vector<Connection> bits;                                // copied as the vector grows
+		for (int n = 0; n < 100; ++n) bits.push_back(Connection(n, false));
+		for (int n = 0; n < 100; ++n) assert(bits[n].rd(false) == n);
+		std::cout << "Connection copies: all tests concluded successfully" << std::endl;
+	}
+
+	void test_lazy_counter() {
+		DeviceEventQueue eq;
+		Connection in(0, false, "in");
+		Counter count(in, false, 4);                                 // counts every change to its input
+		for (int n = 0; n < 5; ++n) {
+			in.set_value(n & 1 ? 0 : 5, false);
+			eq.process_events();
+		}
+		assert(count.get() == 5 && !count.overflow());
+		assert(count.bit(0).signal() && !count.bit(1).signal() && count.bit(2).signal());   // made as they are asked for
+		for (int n = 5; n < 16; ++n) {
+			in.set_value(n & 1 ? 0 : 5, false);
+			eq.process_events();
+			assert(count.bit(0).signal() == ((n + 1) & 1 && n < 15));
+		}
+		assert(count.get() == 0 && count.overflow());
+		assert(!count.bit(2).signal() && !count.bit(3).signal());
+		std::cout << "Lazy counter: all tests concluded successfully" << std::endl;
+	}
+
+	void test_circuits() {
+		test_lu_solver();
+		test_nodal_analysis();
+		test_topology_cache();
+		test_memoised_solutions();
+		test_memoised_tristate();
+		test_digital_nets();
+		test_netlist();
+		test_netlist_batch();
+		test_port_sweep();
+		test_transient();
+		test_analog_scheduling();
+		test_parallel_solves();
+		test_wire_nets();
+		test_released_slots();
+		test_connection_copies();
+		test_lazy_counter();
+	}
+}
+#endif
@@ -3,6 +3,7 @@
 #include "test_clockcycler.h"
 #include "../src/devices/clock.h"
 #include "../src/devices/simulated_ports.h"
+#include "../src/devices/transient.h"
 
 #ifdef TESTING
 namespace Tests {
@@ -228,7 +229,40 @@ namespace Tests {
 	}
 
 
+	// The pins in use are watched at the voltage on the other input, so that a crossing
+	// is not left for the next time the analog domain catches up.
+	void test_comparator_watches() {
+		MiniMachine m;
+		ClockedRegister CMCON(SRAM::CMCON, "CMCON");
+		ClockedRegister TRISA(SRAM::TRISA, "TRISA");
+		ClockedRegister VRCON(SRAM::VRCON, "VRCON");
+
+		TRISA.write(m.sram, (Flags::TRISA::TRISA0 | Flags::TRISA::TRISA1 | Flags::TRISA::TRISA2 | Flags::TRISA::TRISA3));
+		m.pin[0].set_value(1, false);   m.pin[1].set_value(2, false);
+		m.pin[2].set_value(3, false);   m.pin[3].set_value(4, false);
+
+		CMCON.write(m.sram, 7);         // off, so nothing is watched
+		size_t idle = Transient::watching();
+
+		CMCON.write(m.sram, 4);         // RA3 against RA0, RA2 against RA1
+		assert(Transient::watching() == idle + 4);
+
+		CMCON.write(m.sram, 5);         // C1 is off
+		assert(Transient::watching() == idle + 2);
+
+		VRCON.write(m.sram, Flags::VRCON::VREN | Flags::VRCON::VRR | 12);
+		CMCON.write(m.sram, 2);         // VREF against RA0 and RA1
+		assert(Transient::watching() == idle + 2);
+		CMCON.write(m.sram, Flags::CMCON::CIS | 2);   // VREF against RA3 and RA2
+		assert(Transient::watching() == idle + 2);
+
+		CMCON.write(m.sram, 7);
+		assert(Transient::watching() == idle);
+		std::cout << "Comparator: inputs are watched for crossings" << std::endl;
+	}
+
 	void test_comparator_module() {
+		test_comparator_watches();
 		test_comparator();
 	}
 }
@@ -0,0 +1,337 @@
+#include <cassert>
+#include <functional>
+#include "../src/cpu.h"
+
+#ifdef TESTING
+namespace Tests {
+
+	// A CPU with a program of our own, clocked one instruction cycle at a time.
+	class Program {
+		InstructionSet is;
+		WORD pc;
+
+	  public:
+		CPU cpu;
+		unsigned long steps;
+
+		void code(const std::string &mnemonic, WORD f=0, WORD b=0, bool d=false) {
+			cpu.cpu_data().flash.write(pc++, is.assemble(mnemonic, f, b, d));
+		}
+
+		void cycle() {
+			for (int q = 0; q < 8; ++q) cpu.toggle_clock();
+			while (cpu.process_queue()) {}
+			++steps;
+		}
+
+		// run until the program counter reaches the address, and return the cycle count
+		Clock::Cycle run_to(WORD a_address, unsigned long a_limit=100000) {
+			CPU_DATA &data = cpu.cpu_data();
+			while (data.execPC != a_address && steps < a_limit) cycle();
+			assert(data.execPC == a_address);
+			return data.clock.cycles();
+		}
+
+		Program(bool a_fast): pc(0), steps(0) {
+			cpu.trace(false);                          // no execution trace
+			cpu.model("16f628a");
+			cpu.fast_forward(a_fast);
+			cpu.cpu_data().control.push(ControlEvent("play"));
+		}
+	};
+
+	// Wait for Timer2 to match PR2 four times, by polling TMR2IF
+	void timer2_poll(Program &p) {
+		p.code("MOVLW", 199);
+		p.code("BSF", SRAM::STATUS, 5);             // bank 1
+		p.code("MOVWF", SRAM::PR2 & 0x7f);
+		p.code("BCF", SRAM::STATUS, 5);
+		p.code("MOVLW", Flags::T2CON::TMR2ON);
+		p.code("MOVWF", SRAM::T2CON);
+		p.code("BTFSS", SRAM::PIR1, 1);             // 6: wait for TMR2IF
+		p.code("GOTO", 6);
+		p.code("BCF", SRAM::PIR1, 1);
+		p.code("INCF", 0x20, 0, true);
+		p.code("BTFSS", 0x20, 2);
+		p.code("GOTO", 6);
+		p.code("GOTO", 12);                         // 12: done
+	}
+
+	void test_polling_loop() {
+		Program slow(false);
+		timer2_poll(slow);
+		Clock::Cycle start = slow.cpu.cpu_data().clock.cycles();
+		Clock::Cycle expected = slow.run_to(12) - start;
+
+		Program fast(true);
+		timer2_poll(fast);
+		start = fast.cpu.cpu_data().clock.cycles();
+		assert(fast.run_to(12) - start == expected);    // to the cycle
+		assert(fast.cpu.cpu_data().sram.read(0x20) == 4);
+		assert(fast.cpu.cpu_data().W == Flags::T2CON::TMR2ON);
+		assert(fast.steps < slow.steps / 4);             // the clock skipped ahead to each match
+		std::cout << "Polling loops: all tests concluded successfully" << std::endl;
+	}
+
+	// With interrupts, Timer2 interrupts every 100 cycles, and the interrupt routine counts
+	// them in 0x22.  The program goes on at 18.
+	void timer2_interrupts(Program &p, bool a_interrupts) {
+		p.code("GOTO", 8);
+		p.code("NOP");
+		p.code("NOP");
+		p.code("NOP");
+		p.code("INCF", 0x22, 0, true);              // 4: interrupt
+		p.code("BCF", SRAM::PIR1, 1);
+		p.code("RETFIE");
+		p.code("NOP");
+		p.code("MOVLW", 99);                        // 8
+		p.code("BSF", SRAM::STATUS, 5);
+		p.code("MOVWF", SRAM::PR2 & 0x7f);
+		p.code("MOVLW", a_interrupts ? Flags::PIE1::TMR2IE : 0);
+		p.code("MOVWF", SRAM::PIE1 & 0x7f);
+		p.code("BCF", SRAM::STATUS, 5);
+		p.code("MOVLW", Flags::T2CON::TMR2ON);
+		p.code("MOVWF", SRAM::T2CON);
+		p.code("MOVLW", Flags::INTCON::GIE | Flags::INTCON::PEIE);
+		p.code("MOVWF", SRAM::INTCON);
+	}
+
+	// Count 0x21 * 256 passes of an inner DECFSZ loop.
+	void delay_loop(Program &p, bool a_interrupts) {
+		timer2_interrupts(p, a_interrupts);
+		p.code("MOVLW", 10);                        // 18
+		p.code("MOVWF", 0x21);
+		p.code("CLRF", 0x20);                       // 20
+		p.code("DECFSZ", 0x20, 0, true);            // 21
+		p.code("GOTO", 21);
+		p.code("DECFSZ", 0x21, 0, true);
+		p.code("GOTO", 20);
+		p.code("GOTO", 25);                         // 25: done
+	}
+
+	// Run a program both ways until it reaches a_end, and return what it left in 0x20..0x27,
+	// STATUS and W.  Register events reach every CPU, so we run one at a time.
+	std::vector<BYTE> compare(std::function<void(Program &)> a_program, WORD a_end, unsigned long a_speedup) {
+		auto outcome = [](CPU_DATA &c) {
+			std::vector<BYTE> state;
+			for (BYTE r = 0x20; r < 0x28; ++r) state.push_back(c.sram.read(r));
+			state.push_back(c.sram.status());
+			state.push_back(c.W);
+			return state;
+		};
+		Clock::Cycle expected;
+		std::vector<BYTE> state;
+		unsigned long steps;
+		{
+			Program slow(false);
+			a_program(slow);
+			expected = slow.run_to(a_end);
+			state = outcome(slow.cpu.cpu_data());
+			steps = slow.steps;
+		}
+		Program fast(true);
+		a_program(fast);
+		assert(fast.run_to(a_end) == expected);         // to the cycle
+		assert(outcome(fast.cpu.cpu_data()) == state);
+		assert(fast.steps * a_speedup < steps);
+		return state;
+	}
+
+	void test_delay_loop() {
+		compare([](Program &p) { delay_loop(p, false); }, 25, 20);
+		auto state = compare([](Program &p) { delay_loop(p, true); }, 25, 2);
+		assert(state[2] > 70);                          // every interrupt was taken
+		std::cout << "Delay loops: all tests concluded successfully" << std::endl;
+	}
+
+	// Three loops, each inside the last: 3 passes of 5 passes of 256 passes, which set the
+	// counters inside them afresh each time round.  The middle one may count up.
+	void nested_loop(Program &p, bool a_interrupts, bool a_up) {
+		timer2_interrupts(p, a_interrupts);
+		p.code("MOVLW", 3);                         // 18
+		p.code("MOVWF", 0x23);
+		p.code("MOVLW", a_up ? 0xfb : 5);           // 20: outer loop
+		p.code("MOVWF", 0x21);
+		p.code("CLRF", 0x20);                       // 22: middle loop
+		p.code("NOP");                              // 23: inner loop
+		p.code("DECFSZ", 0x20, 0, true);
+		p.code("GOTO", 23);
+		p.code(a_up ? "INCFSZ" : "DECFSZ", 0x21, 0, true);
+		p.code("GOTO", 22);
+		p.code("DECFSZ", 0x23, 0, true);
+		p.code("GOTO", 20);
+		p.code("GOTO", 30);                         // 30: done
+	}
+
+	void test_nested_loops() {
+		for (bool up: {false, true}) {
+			auto state = compare([=](Program &p) { nested_loop(p, false, up); }, 30, 50);
+			assert(state[0] == 0 && state[1] == 0 && state[3] == 0);
+			assert(state[8] & Flags::STATUS::Z);
+			assert(state[9] == (up ? 0xfb : 5));
+			state = compare([=](Program &p) { nested_loop(p, true, up); }, 30, 2);
+			assert(state[2] > 140);                     // every interrupt was taken
+		}
+		std::cout << "Nested delay loops: all tests concluded successfully" << std::endl;
+	}
+
+	// Mix up 0x20 and 0x21 a few hundred times, CRC fashion, in general purpose registers only
+	void mixer(Program &p) {
+		p.code("MOVLW", 0x5a);
+		p.code("MOVWF", 0x20);
+		p.code("CLRF", 0x21);
+		p.code("MOVF", 0x20);                       // 3
+		p.code("ADDWF", 0x21, 0, true);
+		p.code("RLF", 0x20, 0, true);
+		p.code("SWAPF", 0x21, 0, true);
+		p.code("XORWF", 0x21, 0, true);
+		p.code("INCF", 0x22, 0, true);
+		p.code("COMF", 0x23, 0, true);
+		p.code("BSF", 0x24, 3);
+		p.code("SUBWF", 0x25, 0, true);
+		p.code("DECFSZ", 0x26, 0, true);            // 12
+		p.code("GOTO", 3);
+		p.code("GOTO", 14);                         // 14: done
+	}
+
+	void test_basic_blocks() {
+		compare(mixer, 14, 2);
+
+		InstructionSet is;
+		Program p(false);
+		CPU_DATA &data = p.cpu.cpu_data();
+		DecodedFlash flash(is, data.flash);
+		mixer(p);
+		assert(flash.block(3, data).steps.size() == 9);
+		assert(flash.block(12, data).steps.size() == 0);
+		data.flash.write(8, is.assemble("XORWF", SRAM::PORTB, 0, true));
+		assert(flash.block(3, data).steps.size() == 5);  // the flash changed, and a port is not ours
+		data.sram.bank(1);
+		assert(flash.block(3, data).steps.size() == 5);  // TRISB is not ours either
+		data.flash.write(8, is.assemble("XORWF", 0x21, 0, true));
+		assert(flash.block(3, data).steps.size() == 9);
+		data.flash.data[8] = is.assemble("XORWF", SRAM::PORTB, 0, true);
+		assert(flash.block(3, data).steps.size() == 9);  // not written(), so not yet seen
+		data.flash.reset();
+		assert(flash.block(3, data).steps.size() == 5);
+		std::cout << "Basic blocks: all tests concluded successfully" << std::endl;
+	}
+
+	// A handler compiled for an instruction must do just what executing it does
+	void test_file_handlers() {
+		InstructionSet is;
+		Program p(false);
+		CPU_DATA &data = p.cpu.cpu_data();
+		const std::vector<std::string> mnemonics({
+			"ADDWF", "ANDWF", "CLRF", "COMF", "DECF", "DECFSZ", "INCF", "INCFSZ", "IORWF",
+			"MOVF", "MOVWF", "RLF", "RRF", "SUBWF", "SWAPF", "XORWF", "BCF", "BSF"});
+		const std::vector<BYTE> files({0x20, SRAM::INDF, SRAM::FSR});
+
+		auto prepare = [&](BYTE a_status) {         // 0x21 is read through INDF, from bank 0
+			for (BYTE bank = 0; bank < 2; ++bank) {
+				data.sram.bank(bank);
+				data.sram.write(0x20, 0x9c);
+				data.sram.write(0x21, 0xff);
+			}
+			data.sram.status() = a_status;
+			data.sram.fsr() = 0x21;
+			data.W = 0x5a;
+		};
+		auto outcome = [&](bool a_skip) {
+			data.device_events.process_events();
+			std::vector<BYTE> state({data.sram.fsr(), data.sram.status(), (BYTE)data.W, a_skip});
+			for (BYTE bank = 0; bank < 2; ++bank) {
+				data.sram.bank(bank);
+				state.push_back(data.sram.read(0x20));
+				state.push_back(data.sram.read(0x21));
+			}
+			return state;
+		};
+
+		for (auto mnemonic: mnemonics) for (auto f: files) for (int d = 0; d < 2; ++d) for (BYTE status: {0x18, 0x39}) {
+			WORD opcode = is.assemble(mnemonic, f, 3, d);
+			SmartPtr<Instruction> instruction = is.find(opcode);
+			assert(instruction->mnemonic == mnemonic);
+			prepare(status);
+			auto executed = outcome(instruction->execute(opcode, data));
+			prepare(status);
+			auto compiled = outcome(instruction->compile(opcode, data)(data));
+			assert(executed == compiled);
+		}
+
+		prepare(0x18);
+		WORD opcode = is.assemble("INCFSZ", SRAM::INDF, 0, true);
+		assert(is.find(opcode)->compile(opcode, data)(data));       // 0xff + 1 skips
+		assert(data.sram.read(0x21) == 0);
+		opcode = is.assemble("CLRF", 0x20, 0, true);
+		is.find(opcode)->compile(opcode, data)(data);
+		assert(data.sram.read(0x20) == 0 && (data.sram.status() & Flags::STATUS::Z) && !(data.sram.status() & Flags::STATUS::C));
+		std::cout << "File register handlers: all tests concluded successfully" << std::endl;
+	}
+
+	void test_literal_handlers() {
+		InstructionSet is;
+		Program p(false);
+		CPU_DATA &data = p.cpu.cpu_data();
+		const std::vector<std::string> mnemonics({"NOP", "CLRW", "MOVLW", "ADDLW", "ANDLW", "IORLW", "SUBLW", "XORLW"});
+
+		for (auto mnemonic: mnemonics) for (BYTE literal: {0x00, 0x5a, 0xa6}) for (BYTE status: {0x18, 0x3f}) {
+			WORD opcode = is.assemble(mnemonic, literal, 0, false);
+			SmartPtr<Instruction> instruction = is.find(opcode);
+			assert(instruction->mnemonic == mnemonic);
+			data.sram.status() = status;
+			data.W = 0x5a;
+			bool skip = instruction->execute(opcode, data);
+			std::vector<BYTE> executed({data.sram.status(), (BYTE)data.W, skip});
+			data.sram.status() = status;
+			data.W = 0x5a;
+			skip = instruction->compile(opcode, data)(data);
+			assert(executed == std::vector<BYTE>({data.sram.status(), (BYTE)data.W, skip}));
+		}
+		std::cout << "Literal handlers: all tests concluded successfully" << std::endl;
+	}
+
+	// The registers of every bank, W and the stack, seen through SRAM or the CPU, are the core's
+	void test_core_state() {
+		Program p(false);
+		CPU_DATA &data = p.cpu.cpu_data();
+		CoreState &core = data.sram.core();
+		assert(alignof(CoreState) == 64 && ((size_t)&core % 64) == 0);
+
+		data.sram.reset();
+		data.sram.bank(1);
+		data.sram.write(SRAM::FSR | 0x80, 0x42);
+		data.sram.write(SRAM::PCLATH | 0x80, 0x03);
+		assert(core.FSR == 0x42 && core.PCLATH == 0x03 && core.STATUS == 0x20);
+		data.sram.write(SRAM::STATUS | 0x80, 0x40);        // to bank 2
+		assert(data.sram.bank() == 2 && data.sram.read(SRAM::FSR) == 0x42);
+		assert(data.Registers["STATUS"]->read(data.sram) == 0x40);
+		data.sram.set_PC(0x1234);
+		assert(core.PCL == 0x34 && core.PCLATH == 0x12 && data.sram.read(SRAM::PCL) == 0x34);
+
+		data.W = 0x5a;
+		assert(core.W == 0x5a);
+		data.SP = 8;
+		for (WORD n = 0; n < 9; ++n) data.push(0x100 + n);    // the ninth overwrites the first
+		assert(core.SP == 7 && core.stack[7] == 0x108);
+		for (WORD n = 9; n-- > 1; ) assert(data.pop() == 0x100 + n);
+
+		assert(data.flash.size() == 2048 && data.flash.wrap(2048 + 5) == 5);
+		bool refused = false;                               // the core wraps addresses by masking
+		try { data.set_params(Params{"PIC16f6xx", 2000, 128, 4, 0x80, 18, 8}); } catch (std::string &) { refused = true; }
+		assert(refused && data.flash.size() == 2048 && data.params.flash_size == 2048);   // and left as it was
+		data.model("16f628a");
+		std::cout << "Core state: all tests concluded successfully" << std::endl;
+	}
+
+	void test_fast_forward() {
+		test_polling_loop();
+		test_delay_loop();
+		test_nested_loops();
+		test_basic_blocks();
+		test_file_handlers();
+		test_literal_handlers();
+		test_core_state();
+	}
+}
+#endif
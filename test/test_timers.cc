@@ -0,0 +1,412 @@
+#include <cassert>
+#include <vector>
+#include "../src/devices/devices.h"
+#include "../src/cpu.h"
+
+#ifdef TESTING
+namespace Tests {
+
+	// Timer2, CCP1 and the watchdog with their own clock, and a record of what they signal.
+	class TimedMachine {
+	  public:
+		SRAM sram;
+		Clock clock;
+		Timer1 tmr1;
+		Timer2 tmr2;
+		CCP1 ccp1;
+		WDT wdt;
+		DeviceEventQueue eq;
+
+		Register T2CON;
+		Register PR2;
+		Register TMR2;
+		Register CCPR1L;
+		Register CCPR1H;
+		Register CCP1CON;
+		Register TMR1L;
+		Register TMR1H;
+		Register T1CON;
+		Register CONFIG1;
+		Register OPTION;
+
+		std::vector<WORD> tmr1_overflows;          // TMR1 as each was signalled
+		std::vector<Clock::Cycle> tmr2_interrupts;
+		std::vector<Clock::Cycle> ccp1_edges;
+		std::vector<WORD> ccp1_interrupts;         // TMR1 as each was signalled
+		unsigned long special_events;
+		std::vector<Clock::Cycle> alarms;
+		std::vector<Clock::Cycle> timeouts;
+		unsigned long tmr2_events;
+
+		void timer1_changed(Timer1 *t, const std::string &name, const std::vector<BYTE> &data) {
+			if (name == "Overflow") tmr1_overflows.push_back(tmr1.tmr1().get());
+		}
+
+		void timer2_changed(Timer2 *t, const std::string &name, const std::vector<BYTE> &data) {
+			++tmr2_events;
+			if (name == "Interrupt") tmr2_interrupts.push_back(clock.cycles());
+		}
+
+		void ccp1_changed(CCP1 *c, const std::string &name, const std::vector<BYTE> &data) {
+			if (name == "Output") ccp1_edges.push_back(clock.cycles());
+			else if (name == "Interrupt") ccp1_interrupts.push_back(tmr1.tmr1().get());
+			else if (name == "Special Event") ++special_events;
+		}
+
+		void wdt_changed(WDT *w, const std::string &name, const std::vector<BYTE> &data) {
+			if (name == "Timeout") timeouts.push_back(clock.time());
+		}
+
+		void alarm(Clock *c, const std::string &name, const std::vector<BYTE> &data) {
+			if (name == "Alarm") alarms.push_back(clock.time());
+		}
+
+		void cycle(int n=1) {
+			for (int i = 0; i < n; ++i) {
+				for (int q = 0; q < 8; ++q) clock.toggle();
+				eq.process_events();
+			}
+		}
+
+		void tick(int n=1) {                     // Timer1 hears every edge of Fosc/4, so events go as they come
+			for (int i = 0; i < n * 8; ++i) {
+				clock.toggle();
+				eq.process_events();
+			}
+		}
+
+		void write(Register &r, BYTE value) {
+			r.write(sram, value);
+			eq.process_events();
+		}
+
+		TimedMachine(): tmr2(clock), ccp1(clock, tmr1, tmr2), wdt(clock),
+			T2CON(SRAM::T2CON, "T2CON"), PR2(SRAM::PR2, "PR2"), TMR2(SRAM::TMR2, "TMR2"),
+			CCPR1L(SRAM::CCPR1L, "CCPR1L"), CCPR1H(SRAM::CCPR1H, "CCPR1H"), CCP1CON(SRAM::CCP1CON, "CCP1CON"),
+			TMR1L(SRAM::TMR1L, "TMR1L"), TMR1H(SRAM::TMR1H, "TMR1H"), T1CON(SRAM::T1CON, "T1CON"),
+			CONFIG1(0, "CONFIG1"), OPTION(SRAM::OPTION, "OPTION"), special_events(0), tmr2_events(0)
+		{
+			sram.init_params(4, 0x80);
+			clock.start();
+			DeviceEvent<Timer1>::subscribe<TimedMachine>(this, &TimedMachine::timer1_changed, &tmr1);
+			DeviceEvent<Timer2>::subscribe<TimedMachine>(this, &TimedMachine::timer2_changed, &tmr2);
+			DeviceEvent<CCP1>::subscribe<TimedMachine>(this, &TimedMachine::ccp1_changed, &ccp1);
+			DeviceEvent<Clock>::subscribe<TimedMachine>(this, &TimedMachine::alarm, &clock);
+			DeviceEvent<WDT>::subscribe<TimedMachine>(this, &TimedMachine::wdt_changed, &wdt);
+			eq.process_events();
+		}
+		~TimedMachine() {
+			DeviceEvent<Timer1>::unsubscribe<TimedMachine>(this, &TimedMachine::timer1_changed, &tmr1);
+			DeviceEvent<Timer2>::unsubscribe<TimedMachine>(this, &TimedMachine::timer2_changed, &tmr2);
+			DeviceEvent<CCP1>::unsubscribe<TimedMachine>(this, &TimedMachine::ccp1_changed, &ccp1);
+			DeviceEvent<Clock>::unsubscribe<TimedMachine>(this, &TimedMachine::alarm, &clock);
+			DeviceEvent<WDT>::unsubscribe<TimedMachine>(this, &TimedMachine::wdt_changed, &wdt);
+		}
+	};
+
+	//  Timer1 counts through its compiled chain.  Synchronised, at 1:2, from Fosc/4.
+	void test_timer1() {
+		TimedMachine m;
+
+		m.write(m.TMR1H, 0xff);
+		m.write(m.TMR1L, 0xf0);
+		m.write(m.T1CON, Flags::T1CON::T1CKPS0 | Flags::T1CON::TMR1ON);
+		m.tick(10);
+		assert(m.tmr1.tmr1().get() == 0xfff5);
+		assert(m.tmr1_overflows.empty());
+		m.tick(30);
+		assert(m.tmr1.tmr1().get() == 0x0004);
+		assert(m.tmr1_overflows.size() == 1 && m.tmr1_overflows[0] == 0);
+
+		m.write(m.T1CON, Flags::T1CON::T1CKPS0);      // stopped, TMR1 holds
+		m.tick(10);
+		assert(m.tmr1.tmr1().get() == 0x0004);
+		m.write(m.TMR1H, 0x12);                      // and the chain counts on from what we write
+		m.write(m.TMR1L, 0x34);
+		m.write(m.T1CON, Flags::T1CON::T1CKPS0 | Flags::T1CON::TMR1ON);
+		m.tick(4);
+		unsigned long counted = m.tmr1.tmr1().get();
+		assert(counted > 0x1234 && counted <= 0x1238);
+		m.tick(20);
+		assert(m.tmr1.tmr1().get() == counted + 10);
+		assert(m.tmr1_overflows.size() == 1);
+		std::cout << "Timer1: all tests concluded successfully" << std::endl;
+	}
+
+	void test_timer2() {
+		TimedMachine m;
+
+		m.write(m.PR2, 9);
+		m.write(m.T2CON, Flags::T2CON::TMR2ON | Flags::T2CON::TOUTPS0);   // 1:1 prescale, 1:2 postscale
+		Clock::Cycle start = m.clock.cycles();
+
+		m.cycle(4);
+		assert(m.tmr2.value() == 4);
+		m.cycle(6);
+		assert(m.tmr2.value() == 0);            // matched PR2 and restarted
+		m.cycle(55);
+		assert(m.tmr2.value() == 5);
+
+		assert(m.tmr2_interrupts.size() == 3);  // every second period of 10 cycles
+		for (size_t n = 0; n < m.tmr2_interrupts.size(); ++n)
+			assert(m.tmr2_interrupts[n] == start + 20 * (n+1));
+		assert(m.tmr2_events == 9);             // one event per match, and one per interrupt; none per cycle
+
+		m.write(m.TMR2, 2);                     // a write restarts the count from the written value
+		m.cycle(3);
+		assert(m.tmr2.value() == 5);
+
+		m.write(m.PR2, 3);                      // TMR2 is already past the new PR2, so it runs to overflow
+		m.cycle(250);
+		assert(m.tmr2.value() == 255);
+		m.cycle(1);
+		assert(m.tmr2.value() == 0);
+		m.cycle(4);
+		assert(m.tmr2.value() == 0);            // and then counts to the new period
+
+		m.write(m.T2CON, 0);                    // off; TMR2 holds its value
+		m.cycle(10);
+		assert(m.tmr2.value() == 0);
+		std::cout << "Timer2: all tests concluded successfully" << std::endl;
+	}
+
+	void test_ccp1_pwm() {
+		TimedMachine m;
+
+		m.write(m.PR2, 99);                          // 100 cycle period
+		m.write(m.CCPR1L, 10);                       // duty = 10:00 = 40 oscillator periods = 10 cycles
+		m.write(m.CCP1CON, 0b00001100);              // PWM mode
+		m.write(m.T2CON, Flags::T2CON::TMR2ON);
+		Clock::Cycle start = m.clock.cycles();
+
+		m.cycle(1050);
+		assert(m.ccp1_edges.size() == 20);           // a rising and a falling edge per period, nothing else
+		for (size_t n = 0; n < m.ccp1_edges.size(); n += 2) {
+			assert(m.ccp1_edges[n]   == start + 100 * (n/2 + 1));
+			assert(m.ccp1_edges[n+1] == start + 100 * (n/2 + 1) + 10);
+		}
+		assert(m.ccp1.output() == false);
+
+		m.write(m.T2CON, Flags::T2CON::TMR2ON | Flags::T2CON::T2CKPS0);   // 1:4 prescale, period of 400 cycles
+		m.write(m.CCP1CON, 0b00111100);              // duty = 10:11 = 43 * 4 oscillator periods = 43 cycles
+		m.ccp1_edges.clear();
+		m.cycle(800);
+		assert(m.ccp1_edges.size() == 4);
+		assert(m.ccp1_edges[1] - m.ccp1_edges[0] == 43);
+		assert(m.ccp1_edges[2] - m.ccp1_edges[0] == 400);
+
+		m.write(m.CCP1CON, 0);                       // module off
+		m.ccp1_edges.clear();
+		m.cycle(800);
+		assert(m.ccp1_edges.size() == 0);
+		std::cout << "CCP1 PWM: all tests concluded successfully" << std::endl;
+	}
+
+	//  Timer1 is stopped, and TMR1 written where we want it, so that CCP1 sees just the
+	// values we choose.  A write to TMR1 is compared on the following cycle.
+	void test_ccp1_compare() {
+		TimedMachine m;
+		auto tmr1 = [&](WORD a_value) {
+			m.write(m.TMR1H, a_value >> 8);
+			m.write(m.TMR1L, a_value & 0xff);
+			m.cycle(2);
+		};
+
+		m.write(m.CCPR1H, 0x12);
+		m.write(m.CCPR1L, 0x34);
+		m.write(m.CCP1CON, 0b00001000);              // set the output on match
+		tmr1(0x1233);
+		assert(m.ccp1_interrupts.empty() && !m.ccp1.output());
+		tmr1(0x1234);
+		assert(m.ccp1_interrupts.size() == 1 && m.ccp1_interrupts[0] == 0x1234);
+		assert(m.ccp1.output() && m.ccp1_edges.size() == 1);
+		m.cycle(10);
+		assert(m.ccp1_interrupts.size() == 1);       // one match, however long TMR1 stays there
+
+		tmr1(0);
+		m.write(m.CCP1CON, 0b00001001);              // clear the output on match, so it starts high
+		assert(m.ccp1.output() && m.ccp1_edges.size() == 1);
+		tmr1(0x1234);
+		assert(m.ccp1_interrupts.size() == 2);
+		assert(!m.ccp1.output() && m.ccp1_edges.size() == 2);
+
+		tmr1(0);
+		m.write(m.CCP1CON, 0b00001010);              // interrupt only; the pin is left alone
+		tmr1(0x1234);
+		assert(m.ccp1_interrupts.size() == 3 && m.ccp1_edges.size() == 2 && m.special_events == 0);
+
+		tmr1(0);
+		m.write(m.CCP1CON, 0b00001011);              // special event trigger
+		tmr1(0x1234);
+		assert(m.ccp1_interrupts.size() == 4 && m.ccp1_edges.size() == 2 && m.special_events == 1);
+
+		tmr1(0);
+		m.write(m.CCPR1L, 0x56);                     // a new CCPR1 is what we compare against
+		tmr1(0x1234);
+		assert(m.ccp1_interrupts.size() == 4);
+		tmr1(0x1256);
+		assert(m.ccp1_interrupts.size() == 5 && m.special_events == 2);
+
+		m.write(m.CCP1CON, 0);
+		tmr1(0);
+		tmr1(0x1256);
+		assert(m.ccp1_interrupts.size() == 5);
+		std::cout << "CCP1 compare: all tests concluded successfully" << std::endl;
+	}
+
+	//  Capture hears RB3 through PORTB, so this one is a whole CPU, left paused, whose
+	// devices run as we process its queue.  We stand in for the Schmitt trigger on RB3,
+	// and tell CCP1 what PORTB would.  Timer1 is off, and holds what we write.
+	void test_ccp1_capture() {
+		CPU cpu;
+		cpu.trace(false);
+		cpu.model("16f628a");
+		CPU_DATA &data = cpu.cpu_data();
+
+		auto write = [&](const std::string &a_register, BYTE a_value) {
+			data.Registers[a_register]->write(data.sram, a_value);
+			while (cpu.process_queue()) {}
+		};
+		auto rb3_to = [&](bool a_level) {
+			data.device_events.queue_event(new DeviceEvent<PORTB>(data.portb, "PORTB::CCP1", {(BYTE)a_level}));
+			while (cpu.process_queue()) {}
+		};
+		auto tmr1 = [&](WORD a_value) {
+			write("TMR1H", a_value >> 8);
+			write("TMR1L", a_value & 0xff);
+		};
+		auto captured = [&]() -> int {              // CCPR1, or -1 if there was no interrupt
+			if (!(data.sram.read(SRAM::PIR1) & Flags::PIR1::CCP1IF)) return -1;
+			write("PIR1", 0);
+			return data.sram.read(SRAM::CCPR1L) | data.sram.read(SRAM::CCPR1H) << 8;
+		};
+
+		rb3_to(false);
+		write("CCP1CON", 0b00000101);                // every rising edge
+		write("PIR1", 0);
+		tmr1(0x0102);
+		rb3_to(true);
+		assert(captured() == 0x0102);
+		tmr1(0x0203);
+		rb3_to(false);
+		assert(captured() == -1);
+
+		write("CCP1CON", 0b00000100);                // every falling edge
+		rb3_to(true);
+		assert(captured() == -1);
+		rb3_to(false);
+		assert(captured() == 0x0203);
+
+		write("CCP1CON", 0b00000110);                // every 4th rising edge
+		for (WORD n = 1; n <= 8; ++n) {
+			tmr1(0x1000 + n);
+			rb3_to(true);
+			rb3_to(false);
+			assert(captured() == (n % 4 ? -1 : 0x1000 + n));
+		}
+
+		write("CCP1CON", 0b00000111);                // every 16th rising edge, counted afresh
+		for (WORD n = 1; n <= 16; ++n) {
+			tmr1(0x2000 + n);
+			rb3_to(true);
+			rb3_to(false);
+			assert(captured() == (n % 16 ? -1 : 0x2000 + n));
+		}
+
+		write("CCP1CON", 0);
+		rb3_to(true);
+		rb3_to(false);
+		assert(captured() == -1);
+		std::cout << "CCP1 capture: all tests concluded successfully" << std::endl;
+	}
+
+	void test_sleep() {
+		TimedMachine m;
+
+		m.write(m.PR2, 9);
+		m.write(m.T2CON, Flags::T2CON::TMR2ON | Flags::T2CON::TOUTPS0);   // interrupts every 20 cycles
+		m.cycle(5);
+		Clock::Cycle cycles = m.clock.cycles();
+		m.clock.alarm("Alarm", m.clock.time() + 1000000);
+
+		m.clock.sleep();                             // the oscillator stops, and Timer2 with it
+		m.cycle(100);
+		assert(m.clock.cycles() == cycles);
+		assert(m.tmr2.value() == 5);
+
+		Clock::Cycle when;
+		assert(m.clock.next_alarm(when));
+		m.clock.advance(when);                       // straight to the alarm
+		m.eq.process_events();
+		assert(m.alarms.size() == 1);
+		assert(m.alarms[0] == when);
+		assert(m.clock.time() == when);
+		assert(m.clock.cycles() == cycles);
+		assert(!m.clock.next_alarm(when));
+		assert(m.tmr2_interrupts.empty());          // Timer2 missed nothing, since it never ran
+
+		m.clock.wake();
+		m.cycle(15);
+		assert(m.tmr2_interrupts.size() == 1);
+		assert(m.tmr2_interrupts[0] == cycles + 15);
+		assert(m.clock.time() == when + 15);
+		std::cout << "SLEEP: all tests concluded successfully" << std::endl;
+	}
+
+	void test_wdt() {
+		TimedMachine m;
+
+		m.write(m.OPTION, Flags::OPTION::PSA);          // prescaler to the watchdog, at 1:1
+		m.write(m.CONFIG1, Flags::CONFIG::WDTE);
+		Clock::Cycle start = m.clock.time();
+		assert(m.wdt.enabled());
+		assert(m.wdt.timeout() == WDT::period);
+
+		m.cycle(WDT::period);
+		assert(m.timeouts.size() == 1);
+		assert(m.timeouts[0] == start + WDT::period);
+
+		m.cycle(10000);
+		m.wdt.clear();                                  // CLRWDT pushes the timeout back
+		m.cycle(WDT::period - 1);
+		assert(m.timeouts.size() == 1);
+		m.cycle(1);
+		assert(m.timeouts.size() == 2);
+
+		m.write(m.OPTION, Flags::OPTION::PSA | 0x07);   // 1:128, about 2.3 seconds
+		m.wdt.sleep();
+		m.clock.sleep();
+		Clock::Cycle slept = m.clock.time();
+		Clock::Cycle when;
+		assert(m.clock.next_alarm(when));
+		assert(when == slept + 128 * WDT::period);
+		m.clock.advance(when);
+		m.eq.process_events();
+		assert(m.timeouts.size() == 3);
+		assert(m.timeouts[2] == when);
+		assert(m.clock.next_alarm(when));               // and the watchdog carries on
+		assert(when == m.timeouts[2] + 128 * WDT::period);
+		m.clock.wake();
+
+		m.write(m.OPTION, 0);                           // prescaler back to Timer0, so 1:1 again
+		assert(m.clock.next_alarm(when));
+		assert(when == m.timeouts[2] + WDT::period);
+
+		m.write(m.CONFIG1, 0);
+		assert(!m.clock.next_alarm(when));
+		m.cycle(2 * WDT::period);
+		assert(m.timeouts.size() == 3);
+		std::cout << "WDT: all tests concluded successfully" << std::endl;
+	}
+
+	void test_timers() {
+		test_timer1();
+		test_timer2();
+		test_ccp1_pwm();
+		test_ccp1_compare();
+		test_ccp1_capture();
+		test_sleep();
+		test_wdt();
+	}
+}
+#endif
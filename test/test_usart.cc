@@ -0,0 +1,137 @@
+#include <cassert>
+#include <vector>
+#include <fstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../src/devices/devices.h"
+
+#ifdef TESTING
+namespace Tests {
+
+	class SerialMachine {
+	  public:
+		SRAM sram;
+		Clock clock;
+		USART usart;
+		DeviceEventQueue eq;
+
+		Register TXSTA;
+		Register RCSTA;
+		Register SPBRG;
+		Register TXREG;
+
+		bool txif;
+		bool rcif;
+		bool trmt;
+		std::vector<Clock::Cycle> sent;     // when TXIF went high
+
+		void usart_changed(USART *u, const std::string &name, const std::vector<BYTE> &data) {
+			if (name == "TXIF") {
+				txif = data[0];
+				if (txif) sent.push_back(clock.cycles());
+			}
+			if (name == "RCIF") rcif = data[0];
+			if (name == "TRMT") trmt = data[0];
+		}
+
+		void cycle(int n=1) {
+			for (int i = 0; i < n; ++i) {
+				for (int q = 0; q < 8; ++q) clock.toggle();
+				eq.process_events();
+			}
+		}
+
+		void write(Register &r, BYTE value) {
+			if (!r.set_value(value, r.get_value()))
+				r.trigger_change(value, value, 0);      // TXREG must see every write
+			eq.process_events();
+		}
+
+		SerialMachine(): usart(clock),
+			TXSTA(SRAM::TXSTA, "TXSTA"), RCSTA(SRAM::RCSTA, "RCSTA"), SPBRG(SRAM::SPBRG, "SPBRG"), TXREG(SRAM::TXREG, "TXREG"),
+			txif(false), rcif(false), trmt(true)
+		{
+			sram.init_params(4, 0x80);
+			clock.start();
+			DeviceEvent<USART>::subscribe<SerialMachine>(this, &SerialMachine::usart_changed, &usart);
+		}
+		~SerialMachine() {
+			DeviceEvent<USART>::unsubscribe<SerialMachine>(this, &SerialMachine::usart_changed, &usart);
+		}
+	};
+
+	void test_usart_transmit() {
+		std::string fn = "/tmp/sim16f_usart_test.out";
+		{
+			SerialMachine m;
+			m.usart.attach(new HostStream(fn));
+
+			m.write(m.SPBRG, 0);
+			m.write(m.TXSTA, Flags::TXSTA::TXEN | Flags::TXSTA::BRGH);   // 4 cycles per bit, 40 per frame
+			m.write(m.RCSTA, Flags::RCSTA::SPEN);
+			assert(m.txif);
+			assert(m.usart.frame_cycles(false) == 40);
+
+			std::string text = "Hello, World!";
+			Clock::Cycle start = m.clock.cycles();
+			for (auto c: text) {
+				while (!m.txif) m.cycle();
+				m.write(m.TXREG, c);
+			}
+			assert(!m.trmt);
+			while (!m.trmt) m.cycle();
+			assert(m.clock.cycles() == start + 40 * text.length());   // frames follow back to back
+
+			// TXIF goes high once as each byte moves into the shift register
+			assert(m.sent.size() == text.length() + 1);
+			for (size_t n = 2; n < m.sent.size(); ++n)
+				assert(m.sent[n] - m.sent[n-1] == 40);
+		}   // and the host stream is flushed when the USART goes away
+
+		std::ifstream f(fn);
+		std::string received((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		assert(received == "Hello, World!");
+		unlink(fn.c_str());
+		std::cout << "USART transmit: all tests concluded successfully" << std::endl;
+	}
+
+	void test_usart_receive() {
+		SerialMachine m;
+		HostStream *host = new HostStream("pty");
+		m.usart.attach(host);
+
+		m.write(m.SPBRG, 1);
+		m.write(m.TXSTA, 0);                                         // 2*16 cycles per bit, 320 per frame
+		m.write(m.RCSTA, Flags::RCSTA::SPEN | Flags::RCSTA::CREN);
+
+		int fd = open(host->name().c_str(), O_RDWR | O_NOCTTY);
+		assert(fd >= 0);
+		assert(write(fd, "abc", 3) == 3);
+		for (int n = 0; n < 1000 && host->available() < 3; ++n) sleep_for_us(1000);
+		assert(host->available() == 3);
+		m.eq.process_events();
+
+		m.cycle(319);
+		assert(!m.rcif);
+		m.cycle(1);
+		assert(m.rcif);
+		m.cycle(320);                            // two bytes in the FIFO
+		assert(m.usart.receive() == 'a');
+		assert(m.rcif);
+		assert(m.usart.receive() == 'b');
+		m.eq.process_events();
+		assert(!m.rcif);
+
+		m.cycle(320);
+		assert(m.rcif);
+		assert(m.usart.receive() == 'c');
+		close(fd);
+		std::cout << "USART receive: all tests concluded successfully" << std::endl;
+	}
+
+	void test_usart() {
+		test_usart_transmit();
+		test_usart_receive();
+	}
+}
+#endif